@@ -1,3 +1,6 @@
 #!/usr/bin/env bash
-~/VulkanSDK/1.1.70.1/x86_64/bin/glslangValidator -V shader.vert
-~/VulkanSDK/1.1.70.1/x86_64/bin/glslangValidator -V shader.frag
+#run from resources/, the cmake build does the same before linking cw
+~/VulkanSDK/1.1.70.1/x86_64/bin/glslangValidator -V shader.vert || exit 1
+~/VulkanSDK/1.1.70.1/x86_64/bin/glslangValidator -V shader.frag || exit 1
+~/VulkanSDK/1.1.70.1/x86_64/bin/spirv-val vert.spv || exit 1
+~/VulkanSDK/1.1.70.1/x86_64/bin/spirv-val frag.spv || exit 1
@@ -8,6 +8,22 @@ layout(location = 0) out vec4 outCol;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+//permutation switches, see src/graphics/shader_permutation.h. the compiler folds them, every variant is branch free
+layout(constant_id = 0) const bool textured = true;
+layout(constant_id = 1) const bool vertex_colour = false;
+layout(constant_id = 2) const bool alpha_test = false;
+layout(constant_id = 3) const float alpha_cutoff = 0.5;
+
 void main() {
-    outCol = texture(texSampler, fragTexCoord);
+    vec4 col = vec4(1.0);
+    if(textured) {
+        col = texture(texSampler, fragTexCoord);
+    }
+    if(vertex_colour) {
+        col.rgb *= fragCol;
+    }
+    if(alpha_test && col.a < alpha_cutoff) {
+        discard;
+    }
+    outCol = col;
 }
\ No newline at end of file
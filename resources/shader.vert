@@ -24,8 +24,7 @@ void main() {
     //another is modifying the projection matrix
     gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPos.x, inPos.y, inPos.z, 1.0);
    	//gl_Position = vec4(inPos.x, inPos.y, 0.0, 1.0);
-   	vec4 temp = ubo.proj * ubo.view * ubo.model * vec4(inCol, 1.0);
-    fragCol = vec3(temp.x, temp.y, temp.z);
+    fragCol = inCol;                //only read by the vertex_colour permutation
     //NOTE: don't forget to change the texture coordinates too
     fragTexCoord = inTexCoord;
 }
@@ -0,0 +1,106 @@
+#include "binary_log.h"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cwg {
+
+namespace {
+	//locked when a call site registers its format, a thread logs its first message or a buffer fills up, never per message
+	std::mutex file_mu;
+	std::ofstream file;
+	std::vector<std::unique_ptr<binary_log::thread_buffer>> buffers;					//live until exit so close() can flush threads that are gone
+	uint32_t next_id = 1;
+	thread_local binary_log::thread_buffer *local = nullptr;
+
+	template<typename T>
+	void write_value(T value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void write_string(const char *s)
+	{
+		uint16_t length = static_cast<uint16_t>(std::min<size_t>(std::strlen(s), binary_log::max_string));
+		write_value(length);
+		file.write(s, length);
+	}
+}
+
+constexpr char binary_log::magic[8];
+std::atomic<bool> binary_log::s_open { false };
+
+bool binary_log::open(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(file_mu);
+	if(file.is_open()) {
+		return true;
+	}
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if(!file.is_open()) {
+		return false;
+	}
+	file.write(magic, sizeof(magic));
+	write_value<uint64_t>(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()));
+	write_value<uint64_t>(now());
+	s_open.store(true, std::memory_order_release);
+	return true;
+}
+
+void binary_log::close()
+{
+	s_open.store(false, std::memory_order_release);									//call sites fall back to text from here on
+	std::lock_guard<std::mutex> lock(file_mu);
+	if(!file.is_open()) {
+		return;
+	}
+	for(auto& b : buffers) {
+		file.write(reinterpret_cast<const char*>(b->data), b->used);
+		b->used = 0;
+	}
+	file.close();
+}
+
+uint32_t binary_log::register_format(site& s, uint8_t level, const std::string& src, const char *file_name, uint32_t line, const char *format)
+{
+	std::lock_guard<std::mutex> lock(file_mu);
+	uint32_t id = s.id.load(std::memory_order_relaxed);
+	if(id != 0) {
+		return id;																		//another thread got here first
+	}
+	id = next_id++;
+	//straight to the file, so the format is always ahead of any message using it
+	write_value<uint8_t>(format_record);
+	write_value<uint32_t>(id);
+	write_value<uint8_t>(level);
+	write_value<uint32_t>(line);
+	write_string(src.c_str());
+	write_string(file_name);
+	write_string(format);
+	s.id.store(id, std::memory_order_release);
+	return id;
+}
+
+binary_log::thread_buffer *binary_log::local_buffer()
+{
+	if(local == nullptr) {
+		std::unique_ptr<thread_buffer> b(new thread_buffer);
+		std::lock_guard<std::mutex> lock(file_mu);
+		buffers.push_back(std::move(b));
+		local = buffers.back().get();
+	}
+	return local;
+}
+
+void binary_log::flush(thread_buffer *b)
+{
+	std::lock_guard<std::mutex> lock(file_mu);
+	if(file.is_open()) {
+		file.write(reinterpret_cast<const char*>(b->data), b->used);
+	}
+	b->used = 0;
+}
+
+}
@@ -0,0 +1,164 @@
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+/*
+Usage: call binary_log::open() once at startup and close() at shutdown (after the threads that log have stopped), then log through
+CWG_BLOG (see logger.h). The first time a call site runs its format string, source, file and line are written to the file once and
+given an id, from then on a message is the id, a timestamp and the raw arguments copied into a per-thread buffer: no formatting,
+no locks. Arguments can be numbers, enums, bools, strings and pointers. tools/blog_decode turns the file back into text.
+The file is native endian, decode it on the same kind of machine.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace cwg {
+
+class binary_log {
+public:
+	static constexpr char magic[8] = { 'C', 'W', 'G', 'B', 'L', 'O', 'G', '1' };	//followed by u64 wall clock ns and u64 steady clock ns at open()
+	static constexpr uint32_t max_string = 1024;										//longer string arguments are cut
+
+	enum record_kind : uint8_t {
+		format_record = 1,																//u8 kind, u32 id, u8 level, u32 line, then src, file and format as u16 length + bytes
+		message_record = 2																//u8 kind, u32 id, u64 steady ns, u8 argument count, then the arguments
+	};
+
+	enum arg_type : uint8_t {															//each argument is a u8 type followed by its value
+		arg_int = 1,																	//i64
+		arg_uint = 2,																	//u64
+		arg_double = 3,																	//f64
+		arg_bool = 4,																	//u64
+		arg_pointer = 5,																//u64
+		arg_string = 6																	//u16 length + bytes
+	};
+
+	struct site {																		//one per call site, 0 until its format is registered
+		std::atomic<uint32_t> id { 0 };
+	};
+
+	struct thread_buffer {																//one per thread, flushed to the file when full
+		static constexpr uint32_t capacity = 64 * 1024;
+		uint8_t data[capacity];
+		uint32_t used = 0;
+	};
+
+	class scope {																		//open for as long as it lives, an empty path leaves it closed
+	public:
+		scope(const std::string& path) { if(!path.empty()) { open(path); } }
+		~scope() { close(); }
+		scope(const scope& obj) = delete;
+		void operator=(const scope& obj) = delete;
+	};
+
+	static bool open(const std::string& path);
+	static void close();
+	static inline bool is_open() { return s_open.load(std::memory_order_acquire); }
+	static uint32_t register_format(site& s, uint8_t level, const std::string& src, const char *file, uint32_t line, const char *format);
+
+	template<typename... Args>
+	static inline void write(uint32_t id, const Args&... args)
+	{
+		static_assert(sizeof...(Args) < 256, "too many arguments for one message");
+		thread_buffer *b = local_buffer();
+		size_t size = 1 + sizeof(uint32_t) + sizeof(uint64_t) + 1 + (size_t(0) + ... + encoded_size(args));
+		if(b->used + size > thread_buffer::capacity) {
+			flush(b);
+		}
+		uint8_t *p = b->data + b->used;
+		put<uint8_t>(p, message_record);
+		put<uint32_t>(p, id);
+		put<uint64_t>(p, now());
+		put<uint8_t>(p, static_cast<uint8_t>(sizeof...(Args)));
+		(encode(p, args), ...);
+		b->used = static_cast<uint32_t>(p - b->data);
+	}
+
+	static inline uint64_t now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+private:
+	static std::atomic<bool> s_open;
+
+	static thread_buffer *local_buffer();
+	static void flush(thread_buffer *b);
+
+	template<typename T>
+	static inline void put(uint8_t *&p, T value)
+	{
+		std::memcpy(p, &value, sizeof(T));
+		p += sizeof(T);
+	}
+
+	template<typename T>
+	static inline constexpr bool is_string()
+	{
+		return std::is_convertible<const T&, const char*>::value || std::is_same<T, std::string>::value;
+	}
+
+	static inline size_t string_size(const char *s) { return std::min<size_t>(std::strlen(s), max_string); }
+	static inline size_t string_size(const std::string& s) { return std::min<size_t>(s.size(), max_string); }
+	static inline const char *string_data(const char *s) { return s; }
+	static inline const char *string_data(const std::string& s) { return s.data(); }
+
+	template<typename T>
+	static inline size_t encoded_size(const T& a)
+	{
+		if constexpr(is_string<T>()) {
+			return 1 + sizeof(uint16_t) + string_size(a);
+		}
+		else {
+			return 1 + sizeof(uint64_t);
+		}
+	}
+
+	template<typename T>
+	static inline void encode(uint8_t *&p, const T& a)
+	{
+		if constexpr(is_string<T>()) {
+			uint16_t length = static_cast<uint16_t>(string_size(a));
+			put<uint8_t>(p, arg_string);
+			put<uint16_t>(p, length);
+			std::memcpy(p, string_data(a), length);
+			p += length;
+		}
+		else if constexpr(std::is_same<T, bool>::value) {
+			put<uint8_t>(p, arg_bool);
+			put<uint64_t>(p, a ? 1 : 0);
+		}
+		else if constexpr(std::is_enum<T>::value) {
+			put<uint8_t>(p, arg_int);
+			put<int64_t>(p, static_cast<int64_t>(a));
+		}
+		else if constexpr(std::is_integral<T>::value && std::is_signed<T>::value) {
+			put<uint8_t>(p, arg_int);
+			put<int64_t>(p, static_cast<int64_t>(a));
+		}
+		else if constexpr(std::is_integral<T>::value) {
+			put<uint8_t>(p, arg_uint);
+			put<uint64_t>(p, static_cast<uint64_t>(a));
+		}
+		else if constexpr(std::is_floating_point<T>::value) {
+			put<uint8_t>(p, arg_double);
+			put<double>(p, static_cast<double>(a));
+		}
+		else if constexpr(std::is_pointer<T>::value) {
+			put<uint8_t>(p, arg_pointer);
+			put<uint64_t>(p, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(a)));
+		}
+		else {
+			static_assert(std::is_pointer<T>::value, "binary logging takes numbers, enums, bools, strings and pointers");
+		}
+	}
+};
+
+}
+
+#endif
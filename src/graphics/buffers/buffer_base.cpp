@@ -22,40 +22,22 @@ void buffer_base::destroy()
     m_handle = vk::Buffer();
 }
 
-void buffer_base::allocate(vk::PhysicalDevice p_dev)
+void buffer_base::allocate(device_allocator *alloc)
 {
-    //get memory requirements
-    vk::MemoryRequirements mem_req = m_device.getBufferMemoryRequirements(m_handle);
-    vk::PhysicalDeviceMemoryProperties mem_props = p_dev.getMemoryProperties();
-    uint32_t mem_index = std::numeric_limits<uint32_t>::max();
-
-    for(uint32_t i = 0; i < mem_props.memoryTypeCount; i++) {
-        if(mem_req.memoryTypeBits & (1 << i) && mem_props.memoryTypes[i].propertyFlags & (m_allocation_flags)) {
-            mem_index = i;
-            break;
-        }
-    }
-
-    if(mem_index == std::numeric_limits<uint32_t>::max()) {
-        throw std::runtime_error("error: failed to find suitable memory for vertex buffer.");
-    }
-
-    vk::MemoryAllocateInfo alloc_info = {mem_req.size, mem_index };
+    p_allocator = alloc;
     try {
-        m_device_memory = m_device.allocateMemory(alloc_info);
+        m_allocation = p_allocator->allocate_buffer(m_handle, m_allocation_flags);
     }
     catch(...) {
-        throw std::runtime_error("error: failed to allocate vb memory.");
+        throw std::runtime_error("error: failed to allocate buffer memory.");
     }
-    m_device.bindBufferMemory(m_handle, m_device_memory, 0);
 }
 
 void buffer_base::deallocate()
 {
-    if(m_device != vk::Device() && m_device_memory != vk::DeviceMemory()) {
-        m_device.freeMemory(m_device_memory);
+    if(p_allocator != nullptr) {
+        p_allocator->free(m_allocation);
     }
-    m_device_memory = vk::DeviceMemory();
 }
 
 }
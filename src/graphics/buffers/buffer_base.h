@@ -2,6 +2,7 @@
 #define BUFFER_BASE_H
 
 #include <vulkan/vulkan.hpp>
+#include "../device_allocator.h"
 
 namespace cwg {
 namespace graphics {
@@ -13,12 +14,13 @@ protected:
     vk::MemoryPropertyFlags m_allocation_flags;
 
     vk::Buffer m_handle;
-    vk::DeviceMemory m_device_memory;
+    allocation m_allocation;                                        //sub-allocated from p_allocator, mapped when host visible
+    device_allocator *p_allocator = nullptr;
     vk::Device m_device;
 
     void create(vk::DeviceSize size_in_bytes);
     void destroy();
-    void allocate(vk::PhysicalDevice p_dev);
+    void allocate(device_allocator *alloc);
     void deallocate();
 
 public:
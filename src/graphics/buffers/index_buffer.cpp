@@ -3,15 +3,16 @@
 namespace cwg {
 namespace graphics {
 
-index_buffer::index_buffer(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size) :
+index_buffer::index_buffer(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size, vk::IndexType type) :
     buffer_base(vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal),
     log("index_buffer", "log/ib.log", {})
 {
     m_device = dev;
     m_total_size = total_size;
+    m_index_type = type;
 
     create(m_total_size);
-    allocate(p_dev);
+    allocate(alloc);
 }
 
 index_buffer::~index_buffer()
@@ -20,5 +21,11 @@ index_buffer::~index_buffer()
     destroy();
 }
 
+vk::IndexType index_buffer::pick_index_type(size_t vertex_count)
+{
+    //0xffff is kept free: it is the restart index should a pipeline ever enable primitive restart
+    return vertex_count < 0xffff ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+}
+
 }
 }
\ No newline at end of file
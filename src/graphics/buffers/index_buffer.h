@@ -17,28 +17,33 @@ namespace graphics {
 class index_buffer : public buffer_base {
     cwg::logger log;
     vk::DeviceSize m_total_size = 0;
+    vk::IndexType m_index_type = vk::IndexType::eUint32;
 
     struct attrib { unsigned char binding; unsigned char location; unsigned char stride; };
     std::vector<attrib> m_attributes;
 public:
     index_buffer() : buffer_base(vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal) , log("index_buffer", "log/ib.log", {}) {}
-    index_buffer(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size);
+    index_buffer(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size, vk::IndexType type = vk::IndexType::eUint32);
     //vertex_buffer(staging_buffer& import_from);
     ~index_buffer();
 
     inline void reset() { deallocate(); destroy(); m_total_size = 0; }
-    inline void reset(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size) {
+    inline void reset(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size, vk::IndexType type = vk::IndexType::eUint32) {
          deallocate();
          destroy();
          m_device = dev;
          m_total_size = total_size;
+         m_index_type = type;
          create(m_total_size);
-         allocate(p_dev);
+         allocate(alloc);
     }
 
-    inline uint32_t size() { return m_total_size / sizeof(uint32_t); }         //vulkan actually expects a vertex count in uint32_t
+    static vk::IndexType pick_index_type(size_t vertex_count);                  //16 bit whenever every index fits
+
+    inline uint32_t index_size() const { return m_index_type == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t); }
+    inline uint32_t size() { return static_cast<uint32_t>(m_total_size / index_size()); }          //index count, what drawIndexed expects
     inline void set_total_size(vk::DeviceSize s) { m_total_size = s; }
-    inline vk::IndexType get_index_type() { return vk::IndexType::eUint32; }
+    inline vk::IndexType get_index_type() { return m_index_type; }
 };
 
 }
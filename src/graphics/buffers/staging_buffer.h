@@ -2,64 +2,45 @@
 #define STAGING_BUFFER_H
 
 #include "buffer_base.h"
-#include "vertex_buffer.h"
-#include "index_buffer.h"
+
+#include <cstring>
 
 namespace cwg {
 namespace graphics {
 
+//persistently mapped ring of host memory. space is handed out with reserve() and handed back in the same order with release()
 class staging_buffer : public buffer_base {
     vk::DeviceSize m_total_size = 0;
-    vk::DeviceSize m_vertex_size = 0;
+    vk::DeviceSize m_head = 0;                                                  //next free byte
+    vk::DeviceSize m_tail = 0;                                                  //oldest byte still in use
+    vk::DeviceSize m_used = 0;                                                  //including padding + space skipped on wrap around
 
-    void map(std::vector<float>& data, vk::DeviceSize size);
-    void map(std::vector<uint32_t>& data, vk::DeviceSize size);
-    void map(unsigned char *data, vk::DeviceSize size);
 public:
-    staging_buffer() : buffer_base(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) {}
-    staging_buffer(vk::Device dev, vk::PhysicalDevice p_dev, std::vector<float>& data, vk::DeviceSize total_size, vk::DeviceSize vertex_size);
-    staging_buffer(vk::Device dev, vk::PhysicalDevice p_dev, std::vector<uint32_t>& data, vk::DeviceSize total_size);
-    staging_buffer(vk::Device dev, vk::PhysicalDevice p_dev, unsigned char *img, vk::DeviceSize total_size);
+    staging_buffer() : buffer_base(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) {}
+    staging_buffer(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size);
     ~staging_buffer();
 
-    void copy(vertex_buffer& dst, vk::CommandPool pool, vk::Queue queue, vk::DeviceSize src_offset = 0, vk::DeviceSize dst_offset = 0);
-    void copy(index_buffer& dst, vk::CommandPool pool, vk::Queue queue, vk::DeviceSize src_offset = 0, vk::DeviceSize dst_offset = 0);
-    void copy(vk::Image& dst, vk::CommandPool pool, vk::Queue queue, uint32_t width, uint32_t height, vk::DeviceSize src_offset = 0, vk::Offset3D dst_offset = vk::Offset3D());
-
-    inline void reset() { deallocate(); destroy(); }
-    inline void reset(vk::Device dev, vk::PhysicalDevice p_dev, std::vector<float>& data, vk::DeviceSize total_size, vk::DeviceSize vertex_size) {
-         deallocate();
-         destroy();
-         m_device = dev;
-         m_total_size = total_size;
-         m_vertex_size = vertex_size;
-         create(m_total_size);
-         allocate(p_dev);
-         map(data, m_total_size);
-    }
+    bool reserve(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize *offset, vk::DeviceSize *consumed);
+    void release(vk::DeviceSize new_tail, vk::DeviceSize consumed);             //new_tail is the head after the last reservation being released
 
-    inline void reset(vk::Device dev, vk::PhysicalDevice p_dev, std::vector<uint32_t>& data, vk::DeviceSize total_size) {
-        deallocate();
-        destroy(); 
-        m_device = dev;
-        m_total_size = total_size;
-        create(m_total_size);
-        allocate(p_dev);
-        map(data, m_total_size);
-    }
+    inline void write(vk::DeviceSize offset, const void *data, vk::DeviceSize size) { memcpy(static_cast<unsigned char*>(m_allocation.mapped) + offset, data, static_cast<size_t>(size)); }
+    inline void *data(vk::DeviceSize offset) { return static_cast<unsigned char*>(m_allocation.mapped) + offset; }
+    inline vk::DeviceSize head() { return m_head; }
+    inline vk::DeviceSize size() { return m_total_size; }
 
-    inline void reset(vk::Device dev, vk::PhysicalDevice p_dev, unsigned char *data, vk::DeviceSize total_size) {
+    inline void reset() { deallocate(); destroy(); m_total_size = 0; m_head = m_tail = m_used = 0; }
+    inline void reset(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size) {
         deallocate();
-        destroy(); 
+        destroy();
         m_device = dev;
         m_total_size = total_size;
+        m_head = m_tail = m_used = 0;
         create(m_total_size);
-        allocate(p_dev);
-        map(data, m_total_size);
+        allocate(alloc);
     }
 };
 
 }    
 }
 
-#endif
\ No newline at end of file
+#endif
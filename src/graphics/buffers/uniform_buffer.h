@@ -3,41 +3,65 @@
 
 #include "buffer_base.h"
 
+#include <cassert>
+#include <cstring>
+
 namespace cwg {
 namespace graphics {
 
+//ring of uniform slots (one per frame in flight) in a single buffer that stays mapped for its whole lifetime.
+//bind it as eUniformBufferDynamic with range size() and the dynamic offset offset(slot)
 class uniform_buffer : public buffer_base {
-    vk::DeviceSize m_total_size;
+    vk::DeviceSize m_total_size = 0;
+    vk::DeviceSize m_element_size = 0;                                   //size of one slot as seen by the shader
+    vk::DeviceSize m_stride = 0;                                         //element size rounded up to minUniformBufferOffsetAlignment
+    uint32_t m_slot_count = 0;
+    unsigned char *m_mapped = nullptr;
+
+    inline void create_ring(device_allocator *alloc, vk::DeviceSize element_size, uint32_t slot_count)
+    {
+        vk::DeviceSize alignment = alloc->get_limits().minUniformBufferOffsetAlignment;
+        m_element_size = element_size;
+        m_slot_count = slot_count;
+        m_stride = alignment > 0 ? (element_size + alignment - 1) / alignment * alignment : element_size;
+        m_total_size = m_stride * slot_count;
+
+        create(m_total_size);
+        allocate(alloc);
+        m_mapped = static_cast<unsigned char*>(m_allocation.mapped);                //host coherent and mapped by the allocator, never needs flushing
+    }
+
+    inline void destroy_ring()
+    {
+        m_mapped = nullptr;
+        deallocate();
+        destroy();
+    }
 
 public:
     uniform_buffer() : buffer_base(vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) {}
-    uniform_buffer(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size) :
+    uniform_buffer(vk::Device dev, device_allocator *alloc, vk::DeviceSize element_size, uint32_t slot_count) :
     buffer_base(vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent)
     {
         m_device = dev;
-        m_total_size = total_size;
-
-        create(m_total_size);
-        allocate(p_dev);
+        create_ring(alloc, element_size, slot_count);
     }
 
     ~uniform_buffer()
     {
-        deallocate();
-        destroy();
+        destroy_ring();
     }
     
-    inline void reset() { deallocate(); destroy(); }
-    inline void reset(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size) {
-        deallocate();
-        destroy();
+    inline void reset() { destroy_ring(); }
+    inline void reset(vk::Device dev, device_allocator *alloc, vk::DeviceSize element_size, uint32_t slot_count) {
+        destroy_ring();
         m_device = dev;
-        m_total_size = total_size;
-        create(m_total_size);
-        allocate(p_dev);
+        create_ring(alloc, element_size, slot_count);
     }
 
-    inline size_t size() { return m_total_size; }
+    inline size_t size() { return m_element_size; }
+    inline uint32_t slot_count() { return m_slot_count; }
+    inline uint32_t offset(uint32_t slot) { assert(slot < m_slot_count); return static_cast<uint32_t>(slot * m_stride); }
 
     #include "uniform_buffer.tpp"
 };
@@ -45,4 +69,4 @@ public:
 }
 }
 
-#endif
\ No newline at end of file
+#endif
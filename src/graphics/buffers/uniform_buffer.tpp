@@ -1,9 +1,8 @@
 
 
-void write(void *src, size_t size)
+void write(void *src, size_t size, uint32_t slot)
 {
-    assert(size <= m_total_size);
-    void *cpu_mem = m_device.mapMemory(m_device_memory, 0, m_total_size, {});
-    memcpy(cpu_mem, src, size);
-    m_device.unmapMemory(m_device_memory);
-}
\ No newline at end of file
+    //the caller must make sure the gpu is no longer reading this slot (i.e. its frame fence was waited on)
+    assert(size <= m_element_size && m_mapped != nullptr);
+    memcpy(m_mapped + offset(slot), src, size);
+}
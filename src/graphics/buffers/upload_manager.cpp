@@ -0,0 +1,381 @@
+#include "upload_manager.h"
+#include "../../profiler.h"
+
+#include <algorithm>
+
+namespace cwg {
+namespace graphics {
+
+upload_manager::~upload_manager()
+{
+    shutdown();
+}
+
+void upload_manager::init(vk::Device dev, device_allocator *alloc, vk::Queue graphics_queue, uint32_t graphics_family, vk::Queue transfer_queue, uint32_t transfer_family, vk::DeviceSize ring_size)
+{
+    m_device = dev;
+    p_allocator = alloc;
+    m_queue = transfer_queue;
+    m_queue_family = transfer_family;
+    m_graphics_queue = graphics_queue;
+    m_graphics_family = graphics_family;
+    m_alignment = std::max<vk::DeviceSize>(16, alloc->get_limits().optimalBufferCopyOffsetAlignment);       //16 covers every texel size we upload
+
+    vk::CommandPoolCreateFlags flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+    try {
+        m_pool = m_device.createCommandPool({ flags, m_queue_family });
+        if(split()) {
+            m_graphics_pool = m_device.createCommandPool({ flags, m_graphics_family });
+        }
+    }
+    catch(const std::exception& e) {
+        CWG_LOG_ERROR(log) << "failed to create upload command pool: " << e.what();
+        throw std::runtime_error("failed to create upload command pool.");
+    }
+    m_ring.reset(m_device, p_allocator, ring_size);
+    CWG_LOG_DEBUG(log) << "staging ring size: " << ring_size;
+    CWG_LOG_INFO(log) << (split() ? "uploading on transfer queue family: " : "uploading on graphics queue family: ") << m_queue_family;
+}
+
+void upload_manager::shutdown()
+{
+    if(m_device == vk::Device()) {
+        return;
+    }
+    flush();
+    while(!m_in_flight.empty()) {
+        retire(true);
+    }
+    if(m_current.cmd != vk::CommandBuffer()) {                                 //opened but never used
+        m_current.cmd.end();
+        if(split()) {
+            m_current.acquire_cmd.end();
+        }
+        m_spare.push_back(std::move(m_current));
+        m_current = batch();
+    }
+    for(auto& b : m_spare) {
+        m_device.destroyFence(b.fence);
+        if(split()) {
+            m_device.destroyFence(b.transfer_fence);
+            m_device.destroySemaphore(b.transferred);
+        }
+    }
+    m_spare.clear();
+    m_device.destroyCommandPool(m_pool);                                        //frees the command buffers
+    if(split()) {
+        m_device.destroyCommandPool(m_graphics_pool);
+    }
+    m_ring.reset();
+    m_device = vk::Device();
+}
+
+vk::CommandBuffer upload_manager::allocate_command_buffer(vk::CommandPool pool)
+{
+    vk::CommandBuffer out;
+    vk::CommandBufferAllocateInfo alloc_info = { pool, vk::CommandBufferLevel::ePrimary, 1 };
+    m_device.allocateCommandBuffers(&alloc_info, &out);
+    return out;
+}
+
+void upload_manager::begin_batch()
+{
+    if(!m_spare.empty()) {
+        m_current = std::move(m_spare.back());
+        m_spare.pop_back();
+    }
+    else {
+        try {
+            m_current.cmd = allocate_command_buffer(m_pool);
+            m_current.fence = m_device.createFence({});
+            if(split()) {
+                m_current.acquire_cmd = allocate_command_buffer(m_graphics_pool);
+                m_current.transfer_fence = m_device.createFence({});
+                m_current.transferred = m_device.createSemaphore({});
+            }
+            else {
+                m_current.acquire_cmd = m_current.cmd;
+            }
+        }
+        catch(const std::exception& e) {
+            CWG_LOG_ERROR(log) << "failed to create upload batch: " << e.what();
+            throw std::runtime_error("failed to create upload batch.");
+        }
+    }
+    m_current.token = m_next_token++;
+    m_current.state = batch_state::recording;
+    m_current.ring_end = m_ring.head();
+    m_current.ring_consumed = 0;
+    m_current.copies = false;
+    m_current.empty = true;
+
+    vk::CommandBufferBeginInfo begin_info = { vk::CommandBufferUsageFlagBits::eOneTimeSubmit, {} };
+    m_current.cmd.begin(begin_info);                                            //implicitly resets a reused buffer
+    if(split()) {
+        m_current.acquire_cmd.begin(begin_info);
+    }
+}
+
+void upload_manager::submit_acquire(batch& b)
+{
+    //the semaphore wait covers every stage, the acquire barriers at the top of acquire_cmd chain onto it
+    vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eAllCommands;
+    uint32_t wait_count = (split() && b.copies) ? 1 : 0;
+    vk::SubmitInfo submit_info = { wait_count, &b.transferred, &wait_stage, 1, &b.acquire_cmd, 0, nullptr };
+    try {
+        m_graphics_queue.submit({ submit_info }, b.fence);
+    }
+    catch(const std::exception& e) {
+        CWG_LOG_ERROR(log) << "failed to submit upload acquire: " << e.what();
+        throw std::runtime_error("failed to submit upload acquire.");
+    }
+    b.state = batch_state::acquiring;
+    m_ready = b.token;
+}
+
+void upload_manager::retire(bool block)
+{
+    //batches finish in submission order, so only the front has to be checked
+    if(block && !m_in_flight.empty()) {
+        batch& b = m_in_flight.front();
+        if(b.state == batch_state::transferring) {
+            if(b.copies) {
+                m_device.waitForFences({ b.transfer_fence }, true, std::numeric_limits<uint64_t>::max());
+            }
+            submit_acquire(b);
+        }
+        m_device.waitForFences({ b.fence }, true, std::numeric_limits<uint64_t>::max());
+    }
+
+    //hand finished copies over to the graphics queue, strictly in token order so m_ready never passes a pending batch
+    for(auto& b : m_in_flight) {
+        if(b.state != batch_state::transferring) {
+            continue;
+        }
+        if(b.copies && m_device.getFenceStatus(b.transfer_fence) != vk::Result::eSuccess) {
+            break;
+        }
+        submit_acquire(b);
+    }
+
+    while(!m_in_flight.empty()) {
+        batch& b = m_in_flight.front();
+        if(b.state != batch_state::acquiring || m_device.getFenceStatus(b.fence) != vk::Result::eSuccess) {
+            break;
+        }
+        if(b.ring_consumed > 0) {
+            m_ring.release(b.ring_end, b.ring_consumed);
+        }
+        b.oversized.clear();
+        m_device.resetFences({ b.fence });
+        if(split() && b.copies) {
+            m_device.resetFences({ b.transfer_fence });
+        }
+        m_completed = b.token;
+        m_spare.push_back(std::move(b));
+        m_in_flight.pop_front();
+    }
+}
+
+vk::Buffer upload_manager::stage(const void *data, vk::DeviceSize size, vk::DeviceSize *offset)
+{
+    vk::DeviceSize consumed;
+    while(size <= m_ring.size()) {
+        if(m_ring.reserve(size, m_alignment, offset, &consumed)) {
+            m_ring.write(*offset, data, size);
+            m_current.ring_end = m_ring.head();
+            m_current.ring_consumed += consumed;
+            return m_ring.get();
+        }
+        //ring is full: make room by waiting for the oldest batch, submitting this one first if it is the only user
+        if(m_in_flight.empty()) {
+            if(m_current.ring_consumed == 0) {
+                break;
+            }
+            flush();
+            begin_batch();
+        }
+        CWG_PROFILE_SCOPE("staging ring full");
+        retire(true);
+    }
+
+    //too big for the ring, give it a buffer of its own that lives as long as the batch
+    CWG_LOG_WARN(log) << "staging " << size << " bytes outside of the ring.";
+    std::unique_ptr<staging_buffer> buf(new staging_buffer(m_device, p_allocator, size));
+    buf->write(0, data, size);
+    *offset = 0;
+    vk::Buffer out = buf->get();
+    m_current.oversized.push_back(std::move(buf));
+    return out;
+}
+
+upload_token upload_manager::upload(const buffer_base& dst, const void *data, vk::DeviceSize size, vk::DeviceSize dst_offset)
+{
+    if(m_current.cmd == vk::CommandBuffer()) {
+        begin_batch();
+    }
+    vk::DeviceSize src_offset;
+    vk::Buffer src = stage(data, size, &src_offset);
+
+    vk::BufferCopy region_info = { src_offset, dst_offset, size };
+    m_current.cmd.copyBuffer(src, dst.get(), region_info);
+
+    if(split()) {
+        //release on the transfer queue, acquire on the graphics queue. both halves have to match
+        vk::BufferMemoryBarrier barrier = {
+            vk::AccessFlagBits::eTransferWrite,
+            {},
+            m_queue_family,
+            m_graphics_family,
+            dst.get(),
+            dst_offset,
+            size
+        };
+        m_current.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, { barrier }, {});
+        barrier.setSrcAccessMask({});
+        barrier.setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead);
+        m_current.acquire_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader, {}, {}, { barrier }, {});
+    }
+    m_current.copies = true;
+    m_current.empty = false;
+    return m_current.token;
+}
+
+upload_token upload_manager::upload(vk::Image dst, const void *data, vk::DeviceSize size, const std::vector<vk::BufferImageCopy>& regions, uint32_t mip_levels, vk::ImageLayout final_layout)
+{
+    if(m_current.cmd == vk::CommandBuffer()) {
+        begin_batch();
+    }
+    vk::DeviceSize src_offset;
+    vk::Buffer src = stage(data, size, &src_offset);
+    vk::CommandBuffer cmd = m_current.cmd;
+
+    vk::ImageMemoryBarrier barrier = {
+        {},
+        vk::AccessFlagBits::eTransferWrite,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eTransferDstOptimal,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        dst,
+        { vk::ImageAspectFlagBits::eColor, 0, mip_levels, 0, 1 }
+    };
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, { barrier });
+
+    std::vector<vk::BufferImageCopy> staged = regions;
+    for(auto& r : staged) {
+        r.bufferOffset += src_offset;
+    }
+    cmd.copyBufferToImage(src, dst, vk::ImageLayout::eTransferDstOptimal, staged);
+
+    bool sampled = final_layout == vk::ImageLayout::eShaderReadOnlyOptimal;
+    bool transfer = final_layout == vk::ImageLayout::eTransferDstOptimal;           //more transfer commands follow in commands()
+    vk::AccessFlags dst_access = sampled ? vk::AccessFlags(vk::AccessFlagBits::eShaderRead) : transfer ? vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite : vk::AccessFlags(vk::AccessFlagBits::eMemoryRead);
+    vk::PipelineStageFlags dst_stage = sampled ? vk::PipelineStageFlagBits::eFragmentShader : transfer ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eAllCommands;
+
+    barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+    barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+    barrier.setNewLayout(final_layout);
+    if(split()) {
+        //the layout change happens once, as part of the ownership transfer. release and acquire have to match
+        barrier.setSrcQueueFamilyIndex(m_queue_family);
+        barrier.setDstQueueFamilyIndex(m_graphics_family);
+        barrier.setDstAccessMask({});
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, { barrier });
+        barrier.setSrcAccessMask({});
+        barrier.setDstAccessMask(dst_access);
+        m_current.acquire_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, dst_stage, {}, {}, {}, { barrier });
+    }
+    else if(!transfer) {
+        barrier.setDstAccessMask(dst_access);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dst_stage, {}, {}, {}, { barrier });
+    }
+    m_current.copies = true;
+    m_current.empty = false;
+    return m_current.token;
+}
+
+vk::CommandBuffer upload_manager::commands()
+{
+    if(m_current.cmd == vk::CommandBuffer()) {
+        begin_batch();
+    }
+    m_current.empty = false;                                                    //assume the caller records something
+    return m_current.acquire_cmd;
+}
+
+upload_token upload_manager::flush()
+{
+    CWG_PROFILE_SCOPE("upload_manager::flush");
+    if(m_current.cmd == vk::CommandBuffer()) {
+        retire(false);
+        return m_next_token - 1;
+    }
+    if(m_current.empty) {
+        retire(false);
+        return m_current.token - 1;                                             //keep it open, nothing to submit
+    }
+
+    if(!split()) {
+        //make every buffer copy in the batch visible to whatever reads it next
+        vk::MemoryBarrier barrier = {
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead
+        };
+        m_current.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader, {}, { barrier }, {}, {});
+    }
+    m_current.cmd.end();
+
+    try {
+        if(split()) {
+            m_current.acquire_cmd.end();
+            if(m_current.copies) {
+                vk::SubmitInfo submit_info = { 0, nullptr, nullptr, 1, &m_current.cmd, 1, &m_current.transferred };
+                m_queue.submit({ submit_info }, m_current.transfer_fence);
+            }
+            //graphics side work only still queues behind older transfers, retire() acquires it once they have been
+            m_current.state = batch_state::transferring;
+        }
+        else {
+            submit_acquire(m_current);                                          //one queue: submission order does the rest
+        }
+    }
+    catch(const std::exception& e) {
+        CWG_LOG_ERROR(log) << "failed to submit uploads: " << e.what();
+        throw std::runtime_error("failed to submit uploads.");
+    }
+
+    upload_token out = m_current.token;
+    m_in_flight.push_back(std::move(m_current));
+    m_current = batch();
+    retire(false);
+    return out;
+}
+
+bool upload_manager::is_complete(upload_token token)
+{
+    retire(false);
+    return token <= m_ready;
+}
+
+void upload_manager::wait(upload_token token)
+{
+    if(m_current.cmd != vk::CommandBuffer() && token >= m_current.token) {
+        flush();
+    }
+    for(auto& b : m_in_flight) {
+        if(b.token > token) {
+            break;
+        }
+        if(b.state == batch_state::transferring) {
+            if(b.copies) {
+                m_device.waitForFences({ b.transfer_fence }, true, std::numeric_limits<uint64_t>::max());
+            }
+            submit_acquire(b);
+        }
+    }
+    retire(false);
+}
+
+}
+}
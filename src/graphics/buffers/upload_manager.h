@@ -0,0 +1,100 @@
+#ifndef UPLOAD_MANAGER_H
+#define UPLOAD_MANAGER_H
+
+#include <vulkan/vulkan.hpp>
+#include "../../logger.h"
+#include <vector>
+#include <deque>
+#include <memory>
+
+#include "buffer_base.h"
+#include "staging_buffer.h"
+
+/*
+Usage: call upload() as often as needed, the copies are recorded into one command buffer per batch.
+flush() submits the batch (once per frame is enough) and returns its token, is_complete() polls it without blocking.
+Work on the uploaded data that has to follow the copies (mip generation, layout changes) can be recorded into commands().
+
+With a separate transfer queue family the copies run on the transfer queue and ownership of every resource is released there.
+Once the copies are done the matching acquire barriers + commands() are submitted to the graphics queue, waiting on a semaphore.
+Until then the graphics queue never waits on the uploads, so only use a resource once is_complete() says so.
+*/
+
+namespace cwg {
+namespace graphics {
+
+typedef uint64_t upload_token;                                                  //increasing, a batch is done when every older one is
+
+class upload_manager {
+    cwg::logger log;
+
+    enum class batch_state {
+        recording,
+        transferring,                                                           //copies submitted to the transfer queue, or queued behind an older batch's
+        acquiring                                                               //graphics side submitted, the resources are usable
+    };
+
+    struct batch {
+        upload_token token = 0;
+        batch_state state = batch_state::recording;
+        vk::CommandBuffer cmd;                                                  //transfer family
+        vk::CommandBuffer acquire_cmd;                                          //graphics family, same as cmd when there is one family
+        vk::Fence fence;                                                        //signals when everything in the batch is done
+        vk::Fence transfer_fence;                                               //split families only
+        vk::Semaphore transferred;                                              //split families only
+        bool copies = false;
+        vk::DeviceSize ring_end = 0;                                            //staging head after the batch's last reservation
+        vk::DeviceSize ring_consumed = 0;
+        std::vector<std::unique_ptr<staging_buffer>> oversized;                 //uploads that didn't fit in the ring
+        bool empty = true;
+    };
+
+    vk::Device m_device;
+    device_allocator *p_allocator = nullptr;
+    vk::Queue m_queue;                                                          //transfer queue
+    vk::Queue m_graphics_queue;
+    uint32_t m_queue_family = 0;
+    uint32_t m_graphics_family = 0;
+    vk::CommandPool m_pool;
+    vk::CommandPool m_graphics_pool;                                            //split families only
+    staging_buffer m_ring;
+    vk::DeviceSize m_alignment = 16;
+
+    batch m_current;                                                            //being recorded
+    std::deque<batch> m_in_flight;                                              //submitted, oldest first
+    std::vector<batch> m_spare;                                                 //finished, command buffer + fence reused
+    upload_token m_next_token = 1;
+    upload_token m_ready = 0;                                                   //usable by graphics work submitted from now on
+    upload_token m_completed = 0;                                               //finished and recycled
+
+    inline bool split() const { return m_queue_family != m_graphics_family; }
+    vk::CommandBuffer allocate_command_buffer(vk::CommandPool pool);
+    void begin_batch();
+    void submit_acquire(batch& b);
+    void retire(bool block);
+    vk::Buffer stage(const void *data, vk::DeviceSize size, vk::DeviceSize *offset);
+
+public:
+    upload_manager() : log("upload_manager", "log/upload.log", {}) {}
+    ~upload_manager();
+    upload_manager(const upload_manager& obj) = delete;
+    void operator=(const upload_manager& obj) = delete;
+
+    //pass the graphics queue twice when there is no transfer only family
+    void init(vk::Device dev, device_allocator *alloc, vk::Queue graphics_queue, uint32_t graphics_family, vk::Queue transfer_queue, uint32_t transfer_family, vk::DeviceSize ring_size = 32 * 1024 * 1024);
+    void shutdown();                                                            //waits for everything in flight
+
+    upload_token upload(const buffer_base& dst, const void *data, vk::DeviceSize size, vk::DeviceSize dst_offset = 0);
+    //regions are relative to data. the image starts undefined and is left in final_layout, use eTransferDstOptimal to keep writing to it in commands()
+    upload_token upload(vk::Image dst, const void *data, vk::DeviceSize size, const std::vector<vk::BufferImageCopy>& regions, uint32_t mip_levels, vk::ImageLayout final_layout);
+
+    vk::CommandBuffer commands();                                               //graphics queue, runs after this batch's copies
+    upload_token flush();
+    bool is_complete(upload_token token);                                       //true once graphics work submitted after this call sees the upload
+    void wait(upload_token token);                                              //blocks until is_complete(token)
+};
+
+}
+}
+
+#endif
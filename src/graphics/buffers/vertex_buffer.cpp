@@ -6,7 +6,7 @@
 namespace cwg {
 namespace graphics {
 
-vertex_buffer::vertex_buffer(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size, vk::DeviceSize vertex_size) :
+vertex_buffer::vertex_buffer(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size, vk::DeviceSize vertex_size) :
     buffer_base(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal)
 {
     m_device = dev;
@@ -14,7 +14,7 @@ vertex_buffer::vertex_buffer(vk::Device dev, vk::PhysicalDevice p_dev, vk::Devic
     m_vertex_size = vertex_size;
 
     create(m_total_size);
-    allocate(p_dev);
+    allocate(alloc);
 }
 
 vertex_buffer::~vertex_buffer()
@@ -23,6 +23,33 @@ vertex_buffer::~vertex_buffer()
     destroy();
 }
 
+void vertex_buffer::set_attribute(unsigned char binding, unsigned char location, unsigned char stride)
+{
+    switch(stride) {
+        case 2: set_attribute(binding, location, vertex_format::float2); break;
+        case 3: set_attribute(binding, location, vertex_format::float3); break;
+        case 4: set_attribute(binding, location, vertex_format::float4); break;
+        default: throw std::runtime_error("error: unsupported vb attribute format.");
+    }
+}
+
+vk::Format vertex_buffer::to_vk_format(vertex_format format)
+{
+    switch(format) {
+        case vertex_format::float2: return vk::Format::eR32G32Sfloat;
+        case vertex_format::float3: return vk::Format::eR32G32B32Sfloat;
+        case vertex_format::float4: return vk::Format::eR32G32B32A32Sfloat;
+        case vertex_format::half2: return vk::Format::eR16G16Sfloat;
+        case vertex_format::half4: return vk::Format::eR16G16B16A16Sfloat;
+        case vertex_format::unorm16x2: return vk::Format::eR16G16Unorm;
+        case vertex_format::snorm16x2: return vk::Format::eR16G16Snorm;
+        case vertex_format::octahedral16: return vk::Format::eR16G16Snorm;       //decoded in the shader
+        case vertex_format::snorm10x3: return vk::Format::eA2B10G10R10SnormPack32;
+        case vertex_format::unorm8x4: return vk::Format::eR8G8B8A8Unorm;
+        default: throw std::runtime_error("error: unsupported vb attribute format.");
+    }
+}
+
 void vertex_buffer::get_binding_descriptions(std::vector<vk::VertexInputBindingDescription> *desc)
 {
     desc->clear();
@@ -31,13 +58,13 @@ void vertex_buffer::get_binding_descriptions(std::vector<vk::VertexInputBindingD
         if(history.find(m_attributes[i].binding) != history.end()) {
             continue;
         }
-        unsigned char element_count = 0;
+        uint32_t stride = 0;
         for(uint32_t j = 0; j <m_attributes.size(); j++) {
             if(m_attributes[j].binding == m_attributes[i].binding) {
-                element_count += m_attributes[j].stride;
+                stride += format_size(m_attributes[j].format);
             }
         }
-        desc->emplace_back(m_attributes[i].binding, element_count * sizeof(float), vk::VertexInputRate::eVertex);
+        desc->emplace_back(m_attributes[i].binding, stride, vk::VertexInputRate::eVertex);
         history.emplace(m_attributes[i].binding);       //append this binding to the record to avoid duplication
     }
 }
@@ -45,21 +72,15 @@ void vertex_buffer::get_binding_descriptions(std::vector<vk::VertexInputBindingD
 void vertex_buffer::get_attribute_descriptions(std::vector<vk::VertexInputAttributeDescription> *desc)
 {
     //1) get vec of unique bindings. 2) iterate through and create descs.
-    std::map<unsigned char, unsigned char> offsets;         //list of binding + offset
+    std::map<unsigned char, uint32_t> offsets;              //list of binding + offset in bytes
     for(uint32_t i = 0; i < m_attributes.size(); i++) {
         offsets[m_attributes[i].binding] = 0;   //insert or assign null
     }
     
     for(uint32_t i = 0; i < m_attributes.size(); i++) {
-        vk::Format stride_format;
-        switch(m_attributes[i].stride) {
-            case 2: stride_format = vk::Format::eR32G32Sfloat; break;
-            case 3: stride_format = vk::Format::eR32G32B32Sfloat; break;
-            case 4: stride_format = vk::Format::eR32G32B32A32Sfloat; break;
-            default: throw std::runtime_error("error: unsupported vb attribute format.");
-        }
-        desc->emplace_back(static_cast<uint32_t>(m_attributes[i].location), static_cast<uint32_t>(m_attributes[i].binding), stride_format, offsets.find(m_attributes[i].binding)->second * sizeof(float));
-        offsets[m_attributes[i].binding] += m_attributes[i].stride;
+        vk::Format format = to_vk_format(m_attributes[i].format);
+        desc->emplace_back(static_cast<uint32_t>(m_attributes[i].location), static_cast<uint32_t>(m_attributes[i].binding), format, offsets.find(m_attributes[i].binding)->second);
+        offsets[m_attributes[i].binding] += format_size(m_attributes[i].format);
     }
 }
 
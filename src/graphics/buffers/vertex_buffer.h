@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "buffer_base.h"
+#include "../misc/vertex_format.h"
 //#include "staging_buffer.h"
 
 namespace cwg {
@@ -18,29 +19,32 @@ class vertex_buffer : public buffer_base {
     vk::DeviceSize m_total_size = 0;
     vk::DeviceSize m_vertex_size = 0;
 
-    struct attrib { unsigned char binding; unsigned char location; unsigned char stride; };
+    struct attrib { unsigned char binding; unsigned char location; vertex_format format; };
     std::vector<attrib> m_attributes;
 public:
     vertex_buffer() : buffer_base(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal) {}
-    vertex_buffer(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size, vk::DeviceSize vertex_size);
+    vertex_buffer(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size, vk::DeviceSize vertex_size);
     //vertex_buffer(staging_buffer& import_from);
     ~vertex_buffer();
 
     inline void reset() { deallocate(); destroy(); }
-    inline void reset(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize total_size, vk::DeviceSize vertex_size) {
+    inline void reset(vk::Device dev, device_allocator *alloc, vk::DeviceSize total_size, vk::DeviceSize vertex_size) {
         deallocate(); 
         destroy(); m_device = dev;
         m_total_size = total_size;
         m_vertex_size = vertex_size;
         create(m_total_size);
-        allocate(p_dev); 
+        allocate(alloc); 
     }
 
-    inline void set_attribute(unsigned char binding, unsigned char location, unsigned char stride) { m_attributes.push_back( {binding, location, stride} ); }             //no need for more than 256 attributes
+    void set_attribute(unsigned char binding, unsigned char location, unsigned char stride);        //stride 32 bit floats. no need for more than 256 attributes
+    inline void set_attribute(unsigned char binding, unsigned char location, vertex_format format) { m_attributes.push_back( {binding, location, format} ); }
+    inline void clear_attributes() { m_attributes.clear(); }
     //no out of range or location duplication checking exists
 
     void get_binding_descriptions(std::vector<vk::VertexInputBindingDescription> *desc);
     void get_attribute_descriptions(std::vector<vk::VertexInputAttributeDescription> *desc);
+    static vk::Format to_vk_format(vertex_format format);
 
     inline size_t size() { return static_cast<size_t>(m_total_size / m_vertex_size); }
     inline void set_total_size(vk::DeviceSize s) { m_total_size = s; }
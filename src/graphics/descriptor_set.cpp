@@ -39,7 +39,7 @@ void descriptor_set::create_layout()
             m_layout = m_device.createDescriptorSetLayout(create_info);
         }
         catch(std::exception& e) {
-            log << "failed to create descriptor set layout: " << e.what();
+            CWG_LOG_ERROR(log) << "failed to create descriptor set layout: " << e.what();
             throw;
         }
         m_state = descriptor_set_state::layout_made;
@@ -62,7 +62,7 @@ void descriptor_set::allocate()
         m_handle = temp[0];
     }
     catch(std::exception& e) {
-        log << "Failed to allocate descriptor set";
+        CWG_LOG_ERROR(log) << "Failed to allocate descriptor set";
         throw;
     }
     m_state = descriptor_set_state::allocated;
@@ -85,7 +85,7 @@ void descriptor_set::configure()
         m_device.updateDescriptorSets( { write_info}, {});
     }
     catch(std::exception& e) {
-        log << "failed to configure descriptor set";
+        CWG_LOG_ERROR(log) << "failed to configure descriptor set";
         throw;
     }
 }
@@ -112,7 +112,7 @@ vk::DescriptorSetLayout descriptor_set::get_layout()
         return m_layout;
     }
     else if(m_state == descriptor_set_state::empty) {
-        log << "warning: attempting to access empty descriptor set layout.";
+        CWG_LOG_WARN(log) << "warning: attempting to access empty descriptor set layout.";
         return m_layout;
     }
     else {
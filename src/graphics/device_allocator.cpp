@@ -0,0 +1,287 @@
+#include "device_allocator.h"
+
+#include <algorithm>
+
+namespace cwg {
+namespace graphics {
+
+device_allocator::~device_allocator()
+{
+    shutdown();
+}
+
+void device_allocator::init(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize block_size)
+{
+    m_device = dev;
+    m_physical_device = p_dev;
+    m_memory_props = p_dev.getMemoryProperties();
+    m_limits = p_dev.getProperties().limits;
+
+    //the buddy scheme needs a power of two block
+    m_block_size = m_min_size;
+    while(m_block_size < block_size) { m_block_size <<= 1; }
+    m_order_count = 1;
+    while((m_min_size << (m_order_count - 1)) < m_block_size) { m_order_count++; }
+
+    CWG_LOG_INFO(log) << "block size: " << m_block_size << ", max allocations: " << m_limits.maxMemoryAllocationCount;
+}
+
+void device_allocator::shutdown()
+{
+    std::lock_guard<std::mutex> lock(m_mu);
+    if(m_device == vk::Device()) {
+        return;
+    }
+    for(auto& b : m_blocks) {
+        if(b) {
+            if(!b->used.empty()) {
+                CWG_LOG_WARN(log) << "warning: freeing block with live allocations: " << b->used.size();
+            }
+            m_device.freeMemory(b->memory);
+        }
+    }
+    m_blocks.clear();
+    if(m_dedicated_count > 0) {
+        CWG_LOG_WARN(log) << "warning: dedicated allocations leaked: " << m_dedicated_count;
+    }
+    m_device = vk::Device();
+}
+
+uint32_t device_allocator::find_memory_type(uint32_t type_bits, vk::MemoryPropertyFlags flags)
+{
+    for(uint32_t i = 0; i < m_memory_props.memoryTypeCount; i++) {
+        if(type_bits & (1 << i) && (m_memory_props.memoryTypes[i].propertyFlags & flags) == flags) {
+            return i;
+        }
+    }
+    throw std::runtime_error("error: failed to find suitable device memory.");
+}
+
+vk::DeviceMemory device_allocator::allocate_memory(vk::DeviceSize size, uint32_t memory_type, void **mapped)
+{
+    uint32_t live = m_dedicated_count;
+    for(const auto& b : m_blocks) { if(b) { live++; } }
+    if(live + 1 > m_limits.maxMemoryAllocationCount) {
+        CWG_LOG_WARN(log) << "warning: exceeding maxMemoryAllocationCount: " << m_limits.maxMemoryAllocationCount;
+    }
+
+    vk::MemoryAllocateInfo alloc_info = { size, memory_type };
+    vk::DeviceMemory memory;
+    try {
+        memory = m_device.allocateMemory(alloc_info);
+    }
+    catch(const std::exception& e) {
+        CWG_LOG_ERROR(log) << "failed to allocate device memory: " << e.what();
+        throw std::runtime_error("error: failed to allocate device memory.");
+    }
+
+    *mapped = nullptr;
+    if(m_memory_props.memoryTypes[memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        *mapped = m_device.mapMemory(memory, 0, VK_WHOLE_SIZE, {});                 //stays mapped until the memory is freed
+    }
+    return memory;
+}
+
+uint32_t device_allocator::create_block(uint32_t memory_type, resource_kind kind)
+{
+    std::unique_ptr<block> b(new block);
+    void *mapped;
+    b->memory = allocate_memory(m_block_size, memory_type, &mapped);
+    b->size = m_block_size;
+    b->memory_type = memory_type;
+    b->kind = kind;
+    b->mapped = static_cast<unsigned char*>(mapped);
+    b->free_lists.resize(m_order_count);
+    b->free_lists[m_order_count - 1].insert(0);
+
+    for(uint32_t i = 0; i < m_blocks.size(); i++) {
+        if(!m_blocks[i]) {
+            m_blocks[i] = std::move(b);
+            return i;
+        }
+    }
+    m_blocks.push_back(std::move(b));
+    CWG_LOG_DEBUG(log) << "created block " << m_blocks.size() - 1 << " for memory type " << memory_type;
+    return static_cast<uint32_t>(m_blocks.size() - 1);
+}
+
+uint32_t device_allocator::order_of(vk::DeviceSize size)
+{
+    uint32_t order = 0;
+    while((m_min_size << order) < size) { order++; }
+    return order;
+}
+
+bool device_allocator::allocate_from(uint32_t block_index, uint32_t order, allocation *out)
+{
+    block& b = *m_blocks[block_index];
+    uint32_t j = order;
+    while(j < m_order_count && b.free_lists[j].empty()) { j++; }
+    if(j == m_order_count) {
+        return false;
+    }
+
+    vk::DeviceSize offset = *b.free_lists[j].begin();
+    b.free_lists[j].erase(b.free_lists[j].begin());
+    while(j > order) {                                                              //split, keeping the lower half
+        j--;
+        b.free_lists[j].insert(offset + (m_min_size << j));
+    }
+    b.used[offset] = order;
+
+    out->memory = b.memory;
+    out->offset = offset;                                                           //nodes are aligned to their own size
+    out->size = m_min_size << order;
+    out->memory_type = b.memory_type;
+    out->block = block_index;
+    out->mapped = b.mapped ? b.mapped + offset : nullptr;
+    return true;
+}
+
+allocation device_allocator::allocate(const vk::MemoryRequirements& req, vk::MemoryPropertyFlags flags, resource_kind kind, bool dedicated)
+{
+    std::lock_guard<std::mutex> lock(m_mu);
+    allocation out;
+    out.requested = req.size;
+    uint32_t memory_type = find_memory_type(req.memoryTypeBits, flags);
+    vk::DeviceSize needed = std::max({ req.size, req.alignment, m_min_size });
+
+    if(dedicated || needed > m_block_size / 2) {
+        void *mapped;
+        out.memory = allocate_memory(req.size, memory_type, &mapped);
+        out.size = req.size;
+        out.memory_type = memory_type;
+        out.mapped = mapped;
+        m_dedicated_count++;
+        m_dedicated_bytes += req.size;
+        m_requested_bytes += req.size;
+        return out;
+    }
+
+    uint32_t order = order_of(needed);
+    for(uint32_t i = 0; i < m_blocks.size(); i++) {
+        if(m_blocks[i] && m_blocks[i]->memory_type == memory_type && m_blocks[i]->kind == kind && allocate_from(i, order, &out)) {
+            m_requested_bytes += req.size;
+            return out;
+        }
+    }
+    uint32_t i = create_block(memory_type, kind);
+    if(!allocate_from(i, order, &out)) {
+        throw std::runtime_error("error: allocation does not fit in a new block.");
+    }
+    m_requested_bytes += req.size;
+    return out;
+}
+
+allocation device_allocator::allocate_buffer(vk::Buffer buffer, vk::MemoryPropertyFlags flags)
+{
+    vk::MemoryRequirements req = m_device.getBufferMemoryRequirements(buffer);
+    allocation out = allocate(req, flags, resource_kind::linear);
+    m_device.bindBufferMemory(buffer, out.memory, out.offset);
+    CWG_BLOG(log, debug, "buffer {}: {} bytes, block {}, offset {}", static_cast<VkBuffer>(buffer), req.size, out.block, out.offset);
+    return out;
+}
+
+allocation device_allocator::allocate_image(vk::Image image, vk::MemoryPropertyFlags flags, vk::ImageTiling tiling)
+{
+    vk::MemoryRequirements req = m_device.getImageMemoryRequirements(image);
+    bool large = req.size >= m_block_size / 4;                                      //large images get their own memory rather than eating a block
+    allocation out = allocate(req, flags, tiling == vk::ImageTiling::eOptimal ? resource_kind::optimal : resource_kind::linear, large);
+    m_device.bindImageMemory(image, out.memory, out.offset);
+    CWG_BLOG(log, debug, "image {}: {} bytes, block {}, offset {}", static_cast<VkImage>(image), req.size, out.block, out.offset);
+    return out;
+}
+
+void device_allocator::release(allocation& a)
+{
+    m_requested_bytes -= a.requested;
+    if(a.block == allocation::dedicated_block) {
+        m_device.freeMemory(a.memory);                                              //implicitly unmaps
+        m_dedicated_count--;
+        m_dedicated_bytes -= a.size;
+        return;
+    }
+
+    block& b = *m_blocks[a.block];
+    auto it = b.used.find(a.offset);
+    if(it == b.used.end()) {
+        throw std::runtime_error("error: freeing unknown allocation.");
+    }
+    uint32_t order = it->second;
+    vk::DeviceSize offset = a.offset;
+    b.used.erase(it);
+
+    while(order + 1 < m_order_count) {                                             //merge with free buddies
+        vk::DeviceSize buddy = offset ^ (m_min_size << order);
+        auto free_it = b.free_lists[order].find(buddy);
+        if(free_it == b.free_lists[order].end()) {
+            break;
+        }
+        b.free_lists[order].erase(free_it);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    b.free_lists[order].insert(offset);
+
+    if(b.used.empty()) {                                                            //keep one empty block per type around to avoid churn
+        for(uint32_t i = 0; i < m_blocks.size(); i++) {
+            if(i != a.block && m_blocks[i] && m_blocks[i]->memory_type == b.memory_type && m_blocks[i]->kind == b.kind) {
+                m_device.freeMemory(b.memory);
+                m_blocks[a.block].reset();
+                break;
+            }
+        }
+    }
+}
+
+void device_allocator::free(allocation& a)
+{
+    if(!a.valid()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mu);
+        release(a);
+    }
+    a = allocation();
+}
+
+allocator_stats device_allocator::get_stats()
+{
+    std::lock_guard<std::mutex> lock(m_mu);
+    allocator_stats out;
+    for(const auto& b : m_blocks) {
+        if(!b) {
+            continue;
+        }
+        out.block_count++;
+        out.reserved_bytes += b->size;
+        out.allocation_count += static_cast<uint32_t>(b->used.size());
+        for(const auto& u : b->used) {
+            out.allocated_bytes += m_min_size << u.second;
+        }
+        for(uint32_t order = 0; order < m_order_count; order++) {
+            if(!b->free_lists[order].empty()) {
+                out.free_bytes += (m_min_size << order) * b->free_lists[order].size();
+                out.largest_free_range = std::max(out.largest_free_range, m_min_size << order);
+            }
+        }
+    }
+    out.dedicated_count = m_dedicated_count;
+    out.allocation_count += m_dedicated_count;
+    out.reserved_bytes += m_dedicated_bytes;
+    out.allocated_bytes += m_dedicated_bytes;
+    out.requested_bytes = m_requested_bytes;
+    return out;
+}
+
+void device_allocator::log_stats()
+{
+    allocator_stats s = get_stats();
+    CWG_LOG_INFO(log) << "blocks: " << s.block_count << ", dedicated: " << s.dedicated_count << ", allocations: " << s.allocation_count;
+    CWG_LOG_INFO(log) << "reserved bytes: " << s.reserved_bytes << ", allocated bytes: " << s.allocated_bytes << ", free bytes: " << s.free_bytes;
+    CWG_LOG_INFO(log) << "utilisation: " << s.utilisation() << ", fragmentation: " << s.fragmentation();
+}
+
+}
+}
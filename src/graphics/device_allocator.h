@@ -0,0 +1,112 @@
+#ifndef DEVICE_ALLOCATOR_H
+#define DEVICE_ALLOCATOR_H
+
+#include <vulkan/vulkan.hpp>
+#include "../logger.h"
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <memory>
+
+/*
+Usage: init() once the device exists, then allocate_buffer()/allocate_image() instead of vkAllocateMemory + bind.
+Resources are sub-allocated from large blocks (one list per memory type) with a buddy scheme, big resources get their own vk::DeviceMemory.
+*/
+
+namespace cwg {
+namespace graphics {
+
+enum class resource_kind {                                      //linear and optimal resources never share a block, so bufferImageGranularity can't be violated
+    linear,                                                     //buffers and linear images
+    optimal                                                     //optimal tiling images
+};
+
+struct allocation {
+    static constexpr uint32_t dedicated_block = ~0u;
+
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;                                    //size reserved in the block (power of two for sub-allocations)
+    vk::DeviceSize requested = 0;                               //size asked for by the resource
+    uint32_t memory_type = 0;
+    uint32_t block = dedicated_block;
+    void *mapped = nullptr;                                     //points at offset for host visible memory, null otherwise
+
+    inline bool valid() const { return memory != vk::DeviceMemory(); }
+};
+
+struct allocator_stats {
+    uint32_t block_count = 0;
+    uint32_t dedicated_count = 0;
+    uint32_t allocation_count = 0;
+    vk::DeviceSize reserved_bytes = 0;                          //total obtained from vkAllocateMemory
+    vk::DeviceSize requested_bytes = 0;                         //total asked for by resources
+    vk::DeviceSize allocated_bytes = 0;                         //total handed out, including buddy rounding
+    vk::DeviceSize free_bytes = 0;                              //free space inside blocks
+    vk::DeviceSize largest_free_range = 0;
+
+    inline double utilisation() const { return reserved_bytes ? double(requested_bytes) / double(reserved_bytes) : 0.0; }
+    inline double fragmentation() const { return free_bytes ? 1.0 - double(largest_free_range) / double(free_bytes) : 0.0; }     //0 = all free space is one range
+};
+
+class device_allocator {
+    cwg::logger log;
+
+    struct block {
+        vk::DeviceMemory memory;
+        vk::DeviceSize size;
+        uint32_t memory_type;
+        resource_kind kind;
+        unsigned char *mapped;
+        std::vector<std::set<vk::DeviceSize>> free_lists;       //free offsets per order, order 0 = m_min_size
+        std::map<vk::DeviceSize, uint32_t> used;                //offset -> order of live allocations
+    };
+
+    vk::Device m_device;
+    vk::PhysicalDevice m_physical_device;
+    vk::PhysicalDeviceMemoryProperties m_memory_props;
+    vk::PhysicalDeviceLimits m_limits;
+    vk::DeviceSize m_block_size = 64 * 1024 * 1024;
+    vk::DeviceSize m_min_size = 256;                            //smallest buddy, also the smallest alignment handed out
+    uint32_t m_order_count = 0;
+
+    std::vector<std::unique_ptr<block>> m_blocks;               //null entries are reused
+    uint32_t m_dedicated_count = 0;
+    vk::DeviceSize m_dedicated_bytes = 0;
+    vk::DeviceSize m_requested_bytes = 0;
+    std::mutex m_mu;
+
+    uint32_t find_memory_type(uint32_t type_bits, vk::MemoryPropertyFlags flags);
+    vk::DeviceMemory allocate_memory(vk::DeviceSize size, uint32_t memory_type, void **mapped);
+    uint32_t create_block(uint32_t memory_type, resource_kind kind);
+    bool allocate_from(uint32_t block_index, uint32_t order, allocation *out);
+    uint32_t order_of(vk::DeviceSize size);
+    void release(allocation& a);
+
+public:
+    device_allocator() : log("device_allocator", "log/allocator.log", {}) {}
+    ~device_allocator();
+    device_allocator(const device_allocator& obj) = delete;
+    void operator=(const device_allocator& obj) = delete;
+
+    void init(vk::Device dev, vk::PhysicalDevice p_dev, vk::DeviceSize block_size = 64 * 1024 * 1024);
+    void shutdown();                                            //frees every block, all resources must be gone by now
+
+    allocation allocate(const vk::MemoryRequirements& req, vk::MemoryPropertyFlags flags, resource_kind kind, bool dedicated = false);
+    allocation allocate_buffer(vk::Buffer buffer, vk::MemoryPropertyFlags flags);
+    allocation allocate_image(vk::Image image, vk::MemoryPropertyFlags flags, vk::ImageTiling tiling = vk::ImageTiling::eOptimal);
+    void free(allocation& a);                                   //resets a, freeing an invalid allocation does nothing
+
+    allocator_stats get_stats();
+    void log_stats();
+
+    inline vk::Device get_device() { return m_device; }
+    inline vk::PhysicalDevice get_physical_device() { return m_physical_device; }
+    inline const vk::PhysicalDeviceLimits& get_limits() { return m_limits; }
+};
+
+}
+}
+
+#endif
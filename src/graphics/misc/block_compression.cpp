@@ -0,0 +1,582 @@
+#include "block_compression.h"
+#include "thread_pool.h"
+#include "../../profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <future>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CWG_BC_SSE2
+#endif
+
+namespace cwg {
+namespace graphics {
+
+namespace {
+    struct texel_block {
+        alignas(16) float c[4][16];                                 //channel major so four texels load at once
+    };
+
+    void load_block(const uint8_t *rgba, texel_block *b)
+    {
+        for(uint32_t i = 0; i < 16; i++) {
+            for(uint32_t ch = 0; ch < 4; ch++) {
+                b->c[ch][i] = rgba[4 * i + ch];
+            }
+        }
+    }
+
+    //index of the nearest palette entry per texel over channels [first, first + count), returns the summed squared error
+    float nearest_indices(const texel_block& b, const float (*palette)[4], uint32_t entries, uint32_t first, uint32_t count, uint8_t *indices)
+    {
+        float total = 0.0f;
+#if defined(CWG_BC_SSE2)
+        for(uint32_t k = 0; k < 16; k += 4) {
+            __m128 best = _mm_set1_ps(FLT_MAX);
+            __m128i best_index = _mm_setzero_si128();
+            for(uint32_t j = 0; j < entries; j++) {
+                __m128 d = _mm_setzero_ps();
+                for(uint32_t ch = first; ch < first + count; ch++) {
+                    __m128 diff = _mm_sub_ps(_mm_load_ps(&b.c[ch][k]), _mm_set1_ps(palette[j][ch]));
+                    d = _mm_add_ps(d, _mm_mul_ps(diff, diff));
+                }
+                __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+                best = _mm_min_ps(d, best);
+                best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(static_cast<int>(j))), _mm_andnot_si128(closer, best_index));
+            }
+            alignas(16) int32_t index[4];
+            alignas(16) float error[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), best_index);
+            _mm_store_ps(error, best);
+            for(uint32_t i = 0; i < 4; i++) {
+                indices[k + i] = static_cast<uint8_t>(index[i]);
+                total += error[i];
+            }
+        }
+#else
+        for(uint32_t k = 0; k < 16; k++) {
+            float best = FLT_MAX;
+            for(uint32_t j = 0; j < entries; j++) {
+                float d = 0.0f;
+                for(uint32_t ch = first; ch < first + count; ch++) {
+                    float diff = b.c[ch][k] - palette[j][ch];
+                    d += diff * diff;
+                }
+                if(d < best) {
+                    best = d;
+                    indices[k] = static_cast<uint8_t>(j);
+                }
+            }
+            total += best;
+        }
+#endif
+        return total;
+    }
+
+    //mean and principal axis (power iteration on the covariance), then the extremes of the projection onto it
+    void fit_endpoints(const texel_block& b, uint32_t channels, float *e0, float *e1)
+    {
+        float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float lo[4], hi[4];
+        for(uint32_t ch = 0; ch < channels; ch++) {
+            lo[ch] = hi[ch] = b.c[ch][0];
+            for(uint32_t i = 0; i < 16; i++) {
+                mean[ch] += b.c[ch][i];
+                lo[ch] = std::min(lo[ch], b.c[ch][i]);
+                hi[ch] = std::max(hi[ch], b.c[ch][i]);
+            }
+            mean[ch] /= 16.0f;
+        }
+        float cov[4][4] = {};
+        for(uint32_t i = 0; i < 16; i++) {
+            for(uint32_t x = 0; x < channels; x++) {
+                for(uint32_t y = 0; y < channels; y++) {
+                    cov[x][y] += (b.c[x][i] - mean[x]) * (b.c[y][i] - mean[y]);
+                }
+            }
+        }
+        float axis[4];
+        for(uint32_t ch = 0; ch < channels; ch++) {
+            axis[ch] = hi[ch] - lo[ch];
+        }
+        for(uint32_t iteration = 0; iteration < 8; iteration++) {
+            float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            float length = 0.0f;
+            for(uint32_t x = 0; x < channels; x++) {
+                for(uint32_t y = 0; y < channels; y++) {
+                    next[x] += cov[x][y] * axis[y];
+                }
+                length = std::max(length, std::fabs(next[x]));
+            }
+            if(length < 1e-6f) {
+                break;                                              //flat block, keep the bounding box diagonal
+            }
+            for(uint32_t ch = 0; ch < channels; ch++) {
+                axis[ch] = next[ch] / length;
+            }
+        }
+        float t_lo = FLT_MAX, t_hi = -FLT_MAX, axis_length = 0.0f;
+        for(uint32_t ch = 0; ch < channels; ch++) {
+            axis_length += axis[ch] * axis[ch];
+        }
+        if(axis_length < 1e-12f) {
+            for(uint32_t ch = 0; ch < channels; ch++) {
+                e0[ch] = e1[ch] = mean[ch];
+            }
+            return;
+        }
+        for(uint32_t i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for(uint32_t ch = 0; ch < channels; ch++) {
+                t += (b.c[ch][i] - mean[ch]) * axis[ch];
+            }
+            t_lo = std::min(t_lo, t);
+            t_hi = std::max(t_hi, t);
+        }
+        for(uint32_t ch = 0; ch < channels; ch++) {
+            e0[ch] = std::min(std::max(mean[ch] + axis[ch] * t_lo / axis_length, 0.0f), 255.0f);
+            e1[ch] = std::min(std::max(mean[ch] + axis[ch] * t_hi / axis_length, 0.0f), 255.0f);
+        }
+    }
+
+    //endpoints minimising the squared error for fixed indices, false when the weights don't pin them down
+    bool refine_endpoints(const texel_block& b, const uint8_t *indices, const float *weights, uint32_t channels, float *e0, float *e1)
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float x0[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, x1[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for(uint32_t i = 0; i < 16; i++) {
+            float w = weights[indices[i]];
+            aa += (1.0f - w) * (1.0f - w);
+            ab += (1.0f - w) * w;
+            bb += w * w;
+            for(uint32_t ch = 0; ch < channels; ch++) {
+                x0[ch] += (1.0f - w) * b.c[ch][i];
+                x1[ch] += w * b.c[ch][i];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if(std::fabs(det) < 1e-6f) {
+            return false;
+        }
+        for(uint32_t ch = 0; ch < channels; ch++) {
+            e0[ch] = std::min(std::max((bb * x0[ch] - ab * x1[ch]) / det, 0.0f), 255.0f);
+            e1[ch] = std::min(std::max((aa * x1[ch] - ab * x0[ch]) / det, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    class bit_writer {
+        uint8_t *p_out;
+        uint32_t m_position = 0;
+    public:
+        bit_writer(uint8_t *out, uint32_t bytes) : p_out(out) { std::memset(out, 0, bytes); }
+
+        inline void write(uint32_t value, uint32_t bits)
+        {
+            for(uint32_t i = 0; i < bits; i++, m_position++) {
+                p_out[m_position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (m_position & 7));
+            }
+        }
+    };
+
+    class bit_reader {
+        const uint8_t *p_in;
+        uint32_t m_position = 0;
+    public:
+        bit_reader(const uint8_t *in) : p_in(in) {}
+
+        inline uint32_t read(uint32_t bits)
+        {
+            uint32_t value = 0;
+            for(uint32_t i = 0; i < bits; i++, m_position++) {
+                value |= static_cast<uint32_t>((p_in[m_position >> 3] >> (m_position & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    //bc1 endpoints are 565
+    inline uint16_t pack565(const float *c)
+    {
+        uint32_t r = static_cast<uint32_t>(std::lround(c[0] * 31.0f / 255.0f));
+        uint32_t g = static_cast<uint32_t>(std::lround(c[1] * 63.0f / 255.0f));
+        uint32_t b = static_cast<uint32_t>(std::lround(c[2] * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpack565(uint16_t v, float *c)
+    {
+        uint32_t r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+        c[0] = static_cast<float>((r << 3) | (r >> 2));
+        c[1] = static_cast<float>((g << 2) | (g >> 4));
+        c[2] = static_cast<float>((b << 3) | (b >> 2));
+        c[3] = 255.0f;
+    }
+
+    void bc1_palette(uint16_t c0, uint16_t c1, bool four_colour, float (*palette)[4])
+    {
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for(uint32_t ch = 0; ch < 4; ch++) {
+            float a = palette[0][ch], b = palette[1][ch];
+            if(four_colour) {
+                palette[2][ch] = std::floor((2.0f * a + b) / 3.0f);
+                palette[3][ch] = std::floor((a + 2.0f * b) / 3.0f);
+            }
+            else {
+                palette[2][ch] = std::floor((a + b) / 2.0f);
+                palette[3][ch] = 0.0f;                              //transparent black
+            }
+        }
+    }
+
+    //colour half of bc1/bc3, always in four colour mode (bc3 can't do anything else)
+    void encode_colour(const texel_block& b, uint8_t *out)
+    {
+        static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        float e0[4], e1[4];
+        fit_endpoints(b, 3, e0, e1);
+
+        uint16_t best_c0 = 0, best_c1 = 0;
+        uint8_t best_indices[16] = {};
+        float best_error = FLT_MAX;
+        for(uint32_t pass = 0; pass < 2; pass++) {
+            uint16_t c0 = pack565(e1), c1 = pack565(e0);
+            if(c0 < c1) {
+                std::swap(c0, c1);
+            }
+            float palette[4][4];
+            bc1_palette(c0, c1, true, palette);
+            uint8_t indices[16];
+            float error = nearest_indices(b, palette, 4, 0, 3, indices);
+            if(error < best_error) {
+                best_error = error;
+                best_c0 = c0;
+                best_c1 = c1;
+                std::memcpy(best_indices, indices, sizeof(indices));
+            }
+            if(pass == 0) {
+                float p0[4], p1[4];
+                unpack565(best_c0, p0);
+                unpack565(best_c1, p1);
+                if(!refine_endpoints(b, best_indices, weights, 3, p0, p1)) {
+                    break;
+                }
+                std::copy(p0, p0 + 3, e1);                          //c0 comes from e1 above
+                std::copy(p1, p1 + 3, e0);
+            }
+        }
+        if(best_c0 == best_c1) {
+            std::memset(best_indices, 0, sizeof(best_indices));     //equal endpoints read as three colour mode in bc1, index 0 is the same in both
+        }
+        uint32_t bits = 0;
+        for(uint32_t i = 0; i < 16; i++) {
+            bits |= static_cast<uint32_t>(best_indices[i]) << (2 * i);
+        }
+        std::memcpy(out, &best_c0, 2);
+        std::memcpy(out + 2, &best_c1, 2);
+        std::memcpy(out + 4, &bits, 4);
+    }
+
+    void alpha_palette(uint32_t a0, uint32_t a1, float (*palette)[4])
+    {
+        palette[0][3] = static_cast<float>(a0);
+        palette[1][3] = static_cast<float>(a1);
+        if(a0 > a1) {
+            for(uint32_t i = 1; i < 7; i++) {
+                palette[i + 1][3] = static_cast<float>(((7 - i) * a0 + i * a1) / 7);
+            }
+        }
+        else {
+            for(uint32_t i = 1; i < 5; i++) {
+                palette[i + 1][3] = static_cast<float>(((5 - i) * a0 + i * a1) / 5);
+            }
+            palette[6][3] = 0.0f;
+            palette[7][3] = 255.0f;
+        }
+    }
+
+    void encode_alpha(const texel_block& b, uint8_t *out)
+    {
+        float lo = 255.0f, hi = 0.0f;
+        for(uint32_t i = 0; i < 16; i++) {
+            lo = std::min(lo, b.c[3][i]);
+            hi = std::max(hi, b.c[3][i]);
+        }
+        uint32_t a0 = static_cast<uint32_t>(hi), a1 = static_cast<uint32_t>(lo);
+        uint8_t indices[16] = {};
+        if(a0 > a1) {
+            float palette[8][4];
+            alpha_palette(a0, a1, palette);
+            nearest_indices(b, palette, 8, 3, 1, indices);
+        }
+        out[0] = static_cast<uint8_t>(a0);
+        out[1] = static_cast<uint8_t>(a1);
+        bit_writer bits(out + 2, 6);
+        for(uint32_t i = 0; i < 16; i++) {
+            bits.write(indices[i], 3);
+        }
+    }
+
+    const uint32_t bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    inline uint32_t bc7_interpolate(uint32_t a, uint32_t b, uint32_t w) { return ((64 - w) * a + w * b + 32) >> 6; }
+
+    //mode 6: 7 bit rgba endpoints, each with its own p bit as the lsb
+    float bc7_mode6_try(const texel_block& b, const float *e0, const float *e1, uint32_t q[2][4], uint32_t p[2], uint8_t *indices)
+    {
+        float best_error = FLT_MAX;
+        for(uint32_t pbits = 0; pbits < 4; pbits++) {
+            uint32_t try_p[2] = { pbits & 1, pbits >> 1 };
+            uint32_t try_q[2][4];
+            float palette[16][4];
+            for(uint32_t ch = 0; ch < 4; ch++) {
+                const float *e[2] = { e0, e1 };
+                uint32_t v[2];
+                for(uint32_t k = 0; k < 2; k++) {
+                    int32_t quantised = static_cast<int32_t>(std::lround((e[k][ch] - static_cast<float>(try_p[k])) / 2.0f));
+                    try_q[k][ch] = static_cast<uint32_t>(std::min(std::max(quantised, 0), 127));
+                    v[k] = (try_q[k][ch] << 1) | try_p[k];
+                }
+                for(uint32_t j = 0; j < 16; j++) {
+                    palette[j][ch] = static_cast<float>(bc7_interpolate(v[0], v[1], bc7_weights4[j]));
+                }
+            }
+            uint8_t try_indices[16];
+            float error = nearest_indices(b, palette, 16, 0, 4, try_indices);
+            if(error < best_error) {
+                best_error = error;
+                std::memcpy(q, try_q, sizeof(try_q));
+                p[0] = try_p[0];
+                p[1] = try_p[1];
+                std::memcpy(indices, try_indices, 16);
+            }
+        }
+        return best_error;
+    }
+}
+
+bool is_block_compressed(texture_format f)
+{
+    return f != texture_format::rgba8;
+}
+
+uint32_t block_bytes(texture_format f)
+{
+    switch(f) {
+        case texture_format::bc1: return 8;
+        case texture_format::bc3: case texture_format::bc7: return 16;
+        default: return 4;
+    }
+}
+
+size_t level_size(texture_format f, uint32_t width, uint32_t height)
+{
+    if(!is_block_compressed(f)) {
+        return static_cast<size_t>(width) * height * 4;
+    }
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * block_bytes(f);
+}
+
+const char *format_name(texture_format f)
+{
+    switch(f) {
+        case texture_format::rgba8: return "rgba8";
+        case texture_format::bc1: return "bc1";
+        case texture_format::bc3: return "bc3";
+        case texture_format::bc7: return "bc7";
+        default: return "unknown";
+    }
+}
+
+void encode_bc1_block(const uint8_t *rgba, uint8_t *out)
+{
+    texel_block b;
+    load_block(rgba, &b);
+    encode_colour(b, out);
+}
+
+void encode_bc3_block(const uint8_t *rgba, uint8_t *out)
+{
+    texel_block b;
+    load_block(rgba, &b);
+    encode_alpha(b, out);
+    encode_colour(b, out + 8);
+}
+
+void encode_bc7_block(const uint8_t *rgba, uint8_t *out)
+{
+    texel_block b;
+    load_block(rgba, &b);
+    float e0[4], e1[4];
+    fit_endpoints(b, 4, e0, e1);
+
+    uint32_t q[2][4], p[2];
+    uint8_t indices[16];
+    float error = bc7_mode6_try(b, e0, e1, q, p, indices);
+
+    float weights[16];
+    for(uint32_t j = 0; j < 16; j++) {
+        weights[j] = bc7_weights4[j] / 64.0f;
+    }
+    if(refine_endpoints(b, indices, weights, 4, e0, e1)) {
+        uint32_t refined_q[2][4], refined_p[2];
+        uint8_t refined_indices[16];
+        if(bc7_mode6_try(b, e0, e1, refined_q, refined_p, refined_indices) < error) {
+            std::memcpy(q, refined_q, sizeof(q));
+            std::memcpy(p, refined_p, sizeof(p));
+            std::memcpy(indices, refined_indices, sizeof(indices));
+        }
+    }
+
+    if(indices[0] >= 8) {                                           //the anchor index is stored without its top bit, so it has to be below 8
+        std::swap(q[0], q[1]);
+        std::swap(p[0], p[1]);
+        for(uint32_t i = 0; i < 16; i++) {
+            indices[i] = static_cast<uint8_t>(15 - indices[i]);
+        }
+    }
+
+    bit_writer bits(out, 16);
+    bits.write(1 << 6, 7);                                          //mode 6
+    for(uint32_t ch = 0; ch < 4; ch++) {
+        bits.write(q[0][ch], 7);
+        bits.write(q[1][ch], 7);
+    }
+    bits.write(p[0], 1);
+    bits.write(p[1], 1);
+    bits.write(indices[0], 3);
+    for(uint32_t i = 1; i < 16; i++) {
+        bits.write(indices[i], 4);
+    }
+}
+
+bool decode_block(texture_format f, const uint8_t *in, uint8_t *rgba)
+{
+    switch(f) {
+        case texture_format::bc1: case texture_format::bc3: {
+            const uint8_t *colour = f == texture_format::bc3 ? in + 8 : in;
+            uint16_t c0, c1;
+            uint32_t bits;
+            std::memcpy(&c0, colour, 2);
+            std::memcpy(&c1, colour + 2, 2);
+            std::memcpy(&bits, colour + 4, 4);
+            float palette[8][4];
+            bc1_palette(c0, c1, c0 > c1 || f == texture_format::bc3, palette);
+            for(uint32_t i = 0; i < 16; i++) {
+                uint32_t index = (bits >> (2 * i)) & 3;
+                for(uint32_t ch = 0; ch < 4; ch++) {
+                    rgba[4 * i + ch] = static_cast<uint8_t>(palette[index][ch]);
+                }
+                if(f == texture_format::bc1 && c0 <= c1 && index == 3) {
+                    rgba[4 * i + 3] = 0;
+                }
+            }
+            if(f == texture_format::bc3) {
+                alpha_palette(in[0], in[1], palette);
+                bit_reader alpha(in + 2);
+                for(uint32_t i = 0; i < 16; i++) {
+                    rgba[4 * i + 3] = static_cast<uint8_t>(palette[alpha.read(3)][3]);
+                }
+            }
+            return true;
+        }
+        case texture_format::bc7: {
+            bit_reader bits(in);
+            if(bits.read(7) != (1 << 6)) {
+                return false;
+            }
+            uint32_t q[2][4];
+            for(uint32_t ch = 0; ch < 4; ch++) {
+                q[0][ch] = bits.read(7);
+                q[1][ch] = bits.read(7);
+            }
+            uint32_t p0 = bits.read(1), p1 = bits.read(1);
+            for(uint32_t i = 0; i < 16; i++) {
+                uint32_t index = bits.read(i == 0 ? 3 : 4);
+                for(uint32_t ch = 0; ch < 4; ch++) {
+                    rgba[4 * i + ch] = static_cast<uint8_t>(bc7_interpolate((q[0][ch] << 1) | p0, (q[1][ch] << 1) | p1, bc7_weights4[index]));
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+std::vector<uint8_t> encode_image(texture_format f, const uint8_t *rgba, uint32_t width, uint32_t height, thread_pool *pool)
+{
+    CWG_PROFILE_SCOPE("encode_image");
+    std::vector<uint8_t> out(level_size(f, width, height));
+    if(!is_block_compressed(f)) {
+        std::memcpy(out.data(), rgba, out.size());
+        return out;
+    }
+    uint32_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    uint32_t bytes = block_bytes(f);
+    auto encode_row = [&](uint32_t by) {
+        uint8_t texels[64];
+        for(uint32_t bx = 0; bx < blocks_x; bx++) {
+            for(uint32_t y = 0; y < 4; y++) {
+                for(uint32_t x = 0; x < 4; x++) {
+                    uint32_t sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);     //edge blocks repeat the border
+                    std::memcpy(texels + 4 * (4 * y + x), rgba + 4 * (static_cast<size_t>(sy) * width + sx), 4);
+                }
+            }
+            uint8_t *dst = out.data() + (static_cast<size_t>(by) * blocks_x + bx) * bytes;
+            switch(f) {
+                case texture_format::bc1: encode_bc1_block(texels, dst); break;
+                case texture_format::bc3: encode_bc3_block(texels, dst); break;
+                default: encode_bc7_block(texels, dst); break;
+            }
+        }
+    };
+    if(pool != nullptr && blocks_y > 1) {
+        std::vector<std::future<void>> jobs;
+        for(uint32_t by = 0; by < blocks_y; by++) {
+            jobs.push_back(pool->submit([&encode_row, by]() { encode_row(by); }));
+        }
+        for(auto& j : jobs) {
+            j.get();
+        }
+    }
+    else {
+        for(uint32_t by = 0; by < blocks_y; by++) {
+            encode_row(by);
+        }
+    }
+    return out;
+}
+
+bool decode_image(texture_format f, const uint8_t *data, uint32_t width, uint32_t height, std::vector<uint8_t> *rgba)
+{
+    CWG_PROFILE_SCOPE("decode_image");
+    rgba->resize(static_cast<size_t>(width) * height * 4);
+    if(!is_block_compressed(f)) {
+        std::memcpy(rgba->data(), data, rgba->size());
+        return true;
+    }
+    uint32_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    uint8_t texels[64];
+    for(uint32_t by = 0; by < blocks_y; by++) {
+        for(uint32_t bx = 0; bx < blocks_x; bx++) {
+            if(!decode_block(f, data + (static_cast<size_t>(by) * blocks_x + bx) * block_bytes(f), texels)) {
+                return false;
+            }
+            for(uint32_t y = 0; y < 4 && by * 4 + y < height; y++) {
+                for(uint32_t x = 0; x < 4 && bx * 4 + x < width; x++) {
+                    std::memcpy(rgba->data() + 4 * ((static_cast<size_t>(by) * 4 + y) * width + bx * 4 + x), texels + 4 * (4 * y + x), 4);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+}
+}
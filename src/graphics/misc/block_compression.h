@@ -0,0 +1,45 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+Usage: encode_image() compresses rgba8 texels into 4x4 blocks, split into rows of blocks over the pool when one is given.
+decode_image() goes back to rgba8, for devices without textureCompressionBC.
+The encoders fit the endpoints along the principal axis, refine them once by least squares and search the exact palette
+with sse2 where available. bc7 only uses mode 6 (one subset, rgba, 4 bit indices), and the decoder only reads mode 6,
+which is enough for everything tex_cook writes.
+*/
+
+namespace cwg {
+namespace graphics {
+
+class thread_pool;
+
+enum class texture_format : uint32_t {                              //values are the matching VkFormat
+    rgba8 = 37,
+    bc1 = 131,                                                      //rgb, 4 bits per texel
+    bc3 = 137,                                                      //rgba, 8 bits per texel
+    bc7 = 145                                                       //rgba, 8 bits per texel, better quality than bc3
+};
+
+bool is_block_compressed(texture_format f);
+uint32_t block_bytes(texture_format f);                             //per 4x4 block, or per texel for rgba8
+size_t level_size(texture_format f, uint32_t width, uint32_t height);
+const char *format_name(texture_format f);
+
+//rgba is 16 texels, row major
+void encode_bc1_block(const uint8_t *rgba, uint8_t *out);
+void encode_bc3_block(const uint8_t *rgba, uint8_t *out);
+void encode_bc7_block(const uint8_t *rgba, uint8_t *out);
+bool decode_block(texture_format f, const uint8_t *in, uint8_t *rgba);     //false for bc7 modes other than 6
+
+std::vector<uint8_t> encode_image(texture_format f, const uint8_t *rgba, uint32_t width, uint32_t height, thread_pool *pool);
+bool decode_image(texture_format f, const uint8_t *data, uint32_t width, uint32_t height, std::vector<uint8_t> *rgba);
+
+}
+}
+
+#endif
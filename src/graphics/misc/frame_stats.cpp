@@ -0,0 +1,69 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+
+namespace cwg {
+namespace graphics {
+
+frame_stats::frame_stats(float hitch_factor) : m_hitch_factor(hitch_factor)
+{
+    for(auto& metric : m_samples) {
+        for(auto& sample : metric) {
+            sample.store(0.0f, std::memory_order_relaxed);
+        }
+    }
+}
+
+void frame_stats::record(float cpu_ms, float gpu_ms, float present_interval_ms)
+{
+    uint64_t index = m_written.load(std::memory_order_relaxed);
+    uint32_t slot = static_cast<uint32_t>(index % capacity);
+    m_samples[static_cast<uint32_t>(frame_metric::cpu_time)][slot].store(cpu_ms, std::memory_order_relaxed);
+    m_samples[static_cast<uint32_t>(frame_metric::gpu_time)][slot].store(gpu_ms, std::memory_order_relaxed);
+    m_samples[static_cast<uint32_t>(frame_metric::present_interval)][slot].store(present_interval_ms, std::memory_order_relaxed);
+    m_written.store(index + 1, std::memory_order_release);
+}
+
+frame_summary frame_stats::summarise(frame_metric metric, uint32_t window) const
+{
+    frame_summary out;
+    std::array<float, capacity> copy;                               //on the stack, summaries don't allocate either
+    const auto& samples = m_samples[static_cast<uint32_t>(metric)];
+
+    uint64_t end = m_written.load(std::memory_order_acquire);
+    uint64_t begin = end - std::min<uint64_t>(end, std::min(window, capacity));
+    for(uint64_t i = begin; i < end; i++) {
+        copy[i - begin] = samples[i % capacity].load(std::memory_order_relaxed);
+    }
+    //anything the writer may have started overwriting while we copied is dropped
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t now = m_written.load(std::memory_order_relaxed);
+    uint64_t first_valid = now >= capacity ? now - capacity + 1 : 0;
+    uint32_t skip = static_cast<uint32_t>(first_valid > begin ? std::min(first_valid - begin, end - begin) : 0);
+
+    float *first = copy.data() + skip;
+    float *last = copy.data() + (end - begin);
+    out.count = static_cast<uint32_t>(last - first);
+    if(out.count == 0) {
+        return out;
+    }
+
+    double sum = 0.0;
+    for(float *p = first; p != last; p++) {
+        sum += *p;
+    }
+    std::sort(first, last);
+    auto percentile = [first, &out](float p) { return first[std::min(out.count - 1, static_cast<uint32_t>(p * out.count))]; };
+    out.min = *first;
+    out.max = *(last - 1);
+    out.avg = static_cast<float>(sum / out.count);
+    out.p50 = percentile(0.50f);
+    out.p95 = percentile(0.95f);
+    out.p99 = percentile(0.99f);
+    float hitch = out.p50 * m_hitch_factor;
+    out.hitches = static_cast<uint32_t>(last - std::upper_bound(first, last, hitch));
+    return out;
+}
+
+}
+}
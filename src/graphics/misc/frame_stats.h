@@ -0,0 +1,59 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+/*
+Usage: the render thread calls record() once per frame, any thread may call summarise() at any time.
+Samples live in a fixed ring, recording never allocates or locks. readers copy the window they want and
+drop whatever the writer overwrote meanwhile, so a summary may hold a few samples less than asked for.
+*/
+
+namespace cwg {
+namespace graphics {
+
+enum class frame_metric {
+    cpu_time,                                                       //ms the cpu spent on the frame, waits excluded
+    gpu_time,                                                       //ms between the frame's first and last timestamp, lags a few frames
+    present_interval                                                //ms since the previous present, what the user sees
+};
+
+struct frame_summary {
+    uint32_t count = 0;                                             //samples the summary is based on
+    float min = 0.0f;
+    float avg = 0.0f;
+    float p50 = 0.0f;
+    float p95 = 0.0f;
+    float p99 = 0.0f;
+    float max = 0.0f;
+    uint32_t hitches = 0;                                           //samples over hitch_factor * p50
+};
+
+class frame_stats {
+public:
+    static constexpr uint32_t capacity = 1024;                      //longest window that can be summarised
+    static constexpr uint32_t metric_count = 3;
+
+private:
+    std::array<std::array<std::atomic<float>, capacity>, metric_count> m_samples;
+    std::atomic<uint64_t> m_written { 0 };                          //samples published so far, sample i lives in slot i % capacity
+    float m_hitch_factor;
+
+public:
+    frame_stats(float hitch_factor = 2.0f);
+    frame_stats(const frame_stats& obj) = delete;
+    void operator=(const frame_stats& obj) = delete;
+
+    void record(float cpu_ms, float gpu_ms, float present_interval_ms);     //single writer
+    frame_summary summarise(frame_metric metric, uint32_t window = capacity) const;
+
+    inline uint64_t frame_count() const { return m_written.load(std::memory_order_acquire); }
+    inline float fps(uint32_t window = capacity) const { frame_summary s = summarise(frame_metric::present_interval, window); return s.avg > 0.0f ? 1000.0f / s.avg : 0.0f; }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include "gpu_profiler.h"
+#include "../../profiler.h"
+
+#include <algorithm>
+
+namespace cwg {
+namespace graphics {
+
+gpu_profiler::~gpu_profiler()
+{
+    shutdown();
+}
+
+void gpu_profiler::init(vk::Device dev, vk::PhysicalDevice p_dev, uint32_t queue_family, uint32_t slot_count, bool statistics, uint32_t max_regions)
+{
+    m_device = dev;
+    m_max_regions = max_regions;
+    vk::PhysicalDeviceLimits limits = p_dev.getProperties().limits;
+    uint32_t valid_bits = p_dev.getQueueFamilyProperties()[queue_family].timestampValidBits;
+    if(valid_bits == 0) {
+        CWG_LOG_WARN(log) << "timestamps not supported on queue family " << queue_family << ", gpu profiling disabled.";
+        m_enabled = false;
+        return;
+    }
+    m_enabled = true;
+    m_statistics = statistics;
+    m_period = limits.timestampPeriod;
+    m_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    m_slots.resize(slot_count);
+    for(auto& s : m_slots) {
+        try {
+            s.timestamps = m_device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 * max_regions, {} });
+            if(m_statistics) {
+                s.statistics = m_device.createQueryPool({ {}, vk::QueryType::ePipelineStatistics, max_regions, statistic_flags() });
+            }
+        }
+        catch(const std::exception& e) {
+            CWG_LOG_ERROR(log) << "failed to create query pool: " << e.what();
+            throw std::runtime_error("failed to create query pool.");
+        }
+    }
+    m_track = profiler::create_track("gpu");
+    CWG_LOG_INFO(log) << "timestamp period (ns): " << m_period << ", valid bits: " << valid_bits << ", pipeline statistics: " << m_statistics;
+}
+
+void gpu_profiler::shutdown()
+{
+    if(m_device == vk::Device()) {
+        return;
+    }
+    for(auto& s : m_slots) {
+        m_device.destroyQueryPool(s.timestamps);
+        if(s.statistics != vk::QueryPool()) {
+            m_device.destroyQueryPool(s.statistics);
+        }
+    }
+    m_slots.clear();
+    m_device = vk::Device();
+}
+
+void gpu_profiler::collect(slot& s)
+{
+    if(!s.pending || s.names.empty()) {
+        return;
+    }
+    s.pending = false;
+    uint32_t count = static_cast<uint32_t>(s.names.size());
+    std::vector<uint64_t> ticks(2 * count);
+    //no wait flag: the slot's fence has signalled, so anything not ready was never written
+    vk::Result res = m_device.getQueryPoolResults<uint64_t>(s.timestamps, 0, 2 * count, ticks, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if(res != vk::Result::eSuccess) {
+        return;
+    }
+
+    m_results.resize(count);
+    uint64_t first = ~0ull, last = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        uint64_t begin = ticks[2 * i] & m_mask;
+        uint64_t end = ticks[2 * i + 1] & m_mask;
+        first = std::min(first, begin);
+        last = std::max(last, end);
+        m_results[i] = { s.names[i], double(end - begin) * m_period / 1e6 };
+    }
+    m_frame_time = double(last - first) * m_period / 1e6;
+
+    for(uint32_t i = 0; i < count; i++) {
+        if(s.has_statistics[i]) {
+            uint64_t stats[2];                                                  //in bit order: vertex then fragment invocations
+            if(m_device.getQueryPoolResults<uint64_t>(s.statistics, i, 1, { 2, stats }, 2 * sizeof(uint64_t), vk::QueryResultFlagBits::e64) == vk::Result::eSuccess) {
+                m_results[i].vertex_invocations = stats[0];
+                m_results[i].fragment_invocations = stats[1];
+            }
+        }
+        //the gpu clock isn't the cpu one: place the frame at its submit time, which is when it could start at the earliest
+        uint64_t begin = s.submit_time + static_cast<uint64_t>(double((ticks[2 * i] & m_mask) - first) * m_period);
+        profiler::record_track(m_track, s.names[i], begin, begin + static_cast<uint64_t>(m_results[i].ms * 1e6));
+    }
+}
+
+void gpu_profiler::begin_frame(vk::CommandBuffer cmd, uint32_t slot)
+{
+    if(!m_enabled) {
+        return;
+    }
+    m_current = slot;
+    gpu_profiler::slot& s = m_slots[slot];
+    collect(s);
+    s.names.clear();
+    s.has_statistics.clear();
+    cmd.resetQueryPool(s.timestamps, 0, 2 * m_max_regions);
+    if(m_statistics) {
+        cmd.resetQueryPool(s.statistics, 0, m_max_regions);
+    }
+}
+
+uint32_t gpu_profiler::begin_region(vk::CommandBuffer cmd, const char *name, bool statistics)
+{
+    if(!m_enabled) {
+        return no_region;
+    }
+    slot& s = m_slots[m_current];
+    if(s.names.size() == m_max_regions) {
+        return no_region;
+    }
+    uint32_t region = static_cast<uint32_t>(s.names.size());
+    s.names.push_back(name);
+    s.has_statistics.push_back(statistics && m_statistics);
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, s.timestamps, 2 * region);
+    if(s.has_statistics[region]) {
+        cmd.beginQuery(s.statistics, region, {});
+    }
+    return region;
+}
+
+void gpu_profiler::end_region(vk::CommandBuffer cmd, uint32_t region)
+{
+    if(region == no_region) {
+        return;
+    }
+    slot& s = m_slots[m_current];
+    if(s.has_statistics[region]) {
+        cmd.endQuery(s.statistics, region);
+    }
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, s.timestamps, 2 * region + 1);
+}
+
+void gpu_profiler::end_frame()
+{
+    if(!m_enabled) {
+        return;
+    }
+    m_slots[m_current].submit_time = profiler::now();
+    m_slots[m_current].pending = true;
+}
+
+}
+}
@@ -0,0 +1,78 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <vulkan/vulkan.hpp>
+#include "../../logger.h"
+#include <vector>
+
+/*
+Usage: per frame slot, begin_frame() before the render pass (it reads back what the slot measured last time, so nothing waits),
+then begin_region()/end_region() pairs around the work to time and end_frame() just before the submit.
+Results lag frames_in_flight frames behind. Regions also go to the cpu profiler's trace, on a "gpu" track lined up with the submit.
+*/
+
+namespace cwg {
+namespace graphics {
+
+struct gpu_region {
+    const char *name;
+    double ms;
+    uint64_t vertex_invocations = 0;                                            //only with statistics on for the region
+    uint64_t fragment_invocations = 0;
+};
+
+class gpu_profiler {
+    cwg::logger log;
+
+    struct slot {
+        vk::QueryPool timestamps;                                               //2 per region
+        vk::QueryPool statistics;                                               //1 per region, only used by regions asking for it
+        std::vector<const char*> names;
+        std::vector<bool> has_statistics;
+        uint64_t submit_time = 0;                                               //cpu profiler clock
+        bool pending = false;                                                   //submitted, results not read yet
+    };
+
+    vk::Device m_device;
+    bool m_enabled = false;
+    bool m_statistics = false;
+    double m_period = 1.0;                                                      //ns per tick
+    uint64_t m_mask = ~0ull;                                                    //timestampValidBits
+    uint32_t m_max_regions = 0;
+    std::vector<slot> m_slots;
+    uint32_t m_current = 0;
+    uint32_t m_track = 0;
+
+    std::vector<gpu_region> m_results;                                          //latest finished frame
+    double m_frame_time = 0.0;                                                  //ms, first to last timestamp of that frame
+
+    void collect(slot& s);
+
+public:
+    static constexpr uint32_t no_region = ~0u;
+    static inline vk::QueryPipelineStatisticFlags statistic_flags() { return vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations; }
+
+    gpu_profiler() : log("gpu_profiler", "log/gpu_profiler.log", {}) {}
+    ~gpu_profiler();
+    gpu_profiler(const gpu_profiler& obj) = delete;
+    void operator=(const gpu_profiler& obj) = delete;
+
+    //statistics needs the pipelineStatisticsQuery feature enabled on the device
+    void init(vk::Device dev, vk::PhysicalDevice p_dev, uint32_t queue_family, uint32_t slot_count, bool statistics, uint32_t max_regions = 32);
+    void shutdown();
+
+    void begin_frame(vk::CommandBuffer cmd, uint32_t slot);                     //outside a render pass, the slot's last use must have finished
+    uint32_t begin_region(vk::CommandBuffer cmd, const char *name, bool statistics = false);    //name must outlive the results. one statistics region at a time
+    void end_region(vk::CommandBuffer cmd, uint32_t region);
+    void end_frame();
+
+    inline bool enabled() { return m_enabled; }
+    inline bool statistics() { return m_statistics; }
+    inline const std::vector<gpu_region>& get_results() { return m_results; }
+    inline double get_frame_time() { return m_frame_time; }
+};
+
+}
+}
+
+#endif
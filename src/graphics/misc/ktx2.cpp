@@ -0,0 +1,240 @@
+#include "ktx2.h"
+#include "block_compression.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace cwg {
+namespace graphics {
+
+namespace {
+    struct file_header {
+        uint8_t identifier[12];
+        uint32_t vk_format;
+        uint32_t type_size;
+        uint32_t pixel_width;
+        uint32_t pixel_height;
+        uint32_t pixel_depth;
+        uint32_t layer_count;
+        uint32_t face_count;
+        uint32_t level_count;
+        uint32_t supercompression;
+        uint32_t dfd_offset;
+        uint32_t dfd_length;
+        uint32_t kvd_offset;
+        uint32_t kvd_length;
+        uint64_t sgd_offset;
+        uint64_t sgd_length;
+    };
+    static_assert(sizeof(file_header) == 80, "ktx2 header is 80 bytes");
+
+    bool known_format(uint32_t f)
+    {
+        texture_format t = static_cast<texture_format>(f);
+        return t == texture_format::rgba8 || t == texture_format::bc1 || t == texture_format::bc3 || t == texture_format::bc7;
+    }
+
+    //khr data format descriptor with one basic block, see the khronos data format specification
+    std::vector<uint32_t> basic_dfd(texture_format f)
+    {
+        struct sample { uint32_t bit_offset, bit_length, channel, upper; };
+        std::vector<sample> samples;
+        uint32_t model, block_dimensions = 0, bytes_plane0;
+        switch(f) {
+            case texture_format::bc1:
+                model = 128;                                        //bc1a
+                block_dimensions = 3 | (3 << 8);
+                bytes_plane0 = 8;
+                samples = { { 0, 64, 0, 0xffffffff } };
+                break;
+            case texture_format::bc3:
+                model = 130;
+                block_dimensions = 3 | (3 << 8);
+                bytes_plane0 = 16;
+                samples = { { 0, 64, 15, 0xffffffff }, { 64, 64, 0, 0xffffffff } };       //alpha block, then colour
+                break;
+            case texture_format::bc7:
+                model = 134;
+                block_dimensions = 3 | (3 << 8);
+                bytes_plane0 = 16;
+                samples = { { 0, 128, 0, 0xffffffff } };
+                break;
+            default:
+                model = 1;                                          //rgbsda
+                bytes_plane0 = 4;
+                samples = { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 }, { 24, 8, 15, 255 } };
+                break;
+        }
+        uint32_t block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+        std::vector<uint32_t> out = {
+            4 + block_size,
+            0,                                                      //vendor khronos, descriptor type basic
+            2 | (block_size << 16),                                 //version 1.3
+            model | (1 << 8) | (1 << 16),                           //bt709 primaries, linear transfer (the textures are sampled as unorm)
+            block_dimensions,
+            bytes_plane0,
+            0
+        };
+        for(const sample& s : samples) {
+            out.push_back(s.bit_offset | ((s.bit_length - 1) << 16) | (s.channel << 24));
+            out.push_back(0);
+            out.push_back(0);
+            out.push_back(s.upper);
+        }
+        return out;
+    }
+
+    inline uint64_t align_to(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+
+    bool modified_time(const std::string& path, int64_t *mtime)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        *mtime = static_cast<int64_t>(st.st_mtime);
+        return true;
+    }
+}
+
+constexpr uint8_t ktx2::identifier[12];
+
+bool ktx2::open(const std::string& path, std::string *error, const std::string& source_path)
+{
+    close();
+    int64_t cooked_mtime, source_mtime;
+    if(!source_path.empty() && modified_time(path, &cooked_mtime) && modified_time(source_path, &source_mtime) && source_mtime > cooked_mtime) {
+        *error = path + " is older than " + source_path + ", cook it again";
+        return false;
+    }
+    if(!m_file.open(path)) {
+        *error = "could not open " + path;
+        return false;
+    }
+    file_header h;
+    if(m_file.size() < sizeof(h)) {
+        *error = path + " is too short";
+        close();
+        return false;
+    }
+    std::memcpy(&h, m_file.data(), sizeof(h));
+    if(std::memcmp(h.identifier, identifier, sizeof(identifier)) != 0) {
+        *error = path + " is not a ktx2 file";
+        close();
+        return false;
+    }
+    if(h.pixel_width == 0 || h.pixel_height == 0 || h.pixel_depth != 0 || h.layer_count != 0 || h.face_count != 1 || h.level_count == 0 || h.supercompression != 0) {
+        *error = path + ": only plain 2d images with their mips stored are supported";
+        close();
+        return false;
+    }
+    if(!known_format(h.vk_format)) {
+        *error = path + ": unsupported format " + std::to_string(h.vk_format);
+        close();
+        return false;
+    }
+    if(sizeof(h) + static_cast<uint64_t>(h.level_count) * sizeof(level) > m_file.size()) {
+        *error = path + ": level index past the end of the file";
+        close();
+        return false;
+    }
+
+    texture_format f = static_cast<texture_format>(h.vk_format);
+    m_levels.resize(h.level_count);
+    std::memcpy(m_levels.data(), m_file.data() + sizeof(h), m_levels.size() * sizeof(level));
+    m_data_begin = m_file.size();
+    m_data_end = 0;
+    for(uint32_t i = 0; i < h.level_count; i++) {
+        const level& l = m_levels[i];
+        uint32_t w = std::max(1u, h.pixel_width >> i), hh = std::max(1u, h.pixel_height >> i);
+        if(l.offset > m_file.size() || l.size > m_file.size() - l.offset || l.size != graphics::level_size(f, w, hh)) {     //no offset + size, it can wrap
+            *error = path + ": level " + std::to_string(i) + " is broken";
+            close();
+            return false;
+        }
+        m_data_begin = std::min(m_data_begin, l.offset);
+        m_data_end = std::max(m_data_end, l.offset + l.size);
+    }
+    //level_offset() goes straight into bufferOffset, which has to be a multiple of the texel block size (and of 4)
+    uint64_t alignment = std::max<uint64_t>(4, block_bytes(f));
+    for(uint32_t i = 0; i < h.level_count; i++) {
+        if((m_levels[i].offset - m_data_begin) % alignment != 0) {
+            *error = path + ": level " + std::to_string(i) + " is not aligned to " + std::to_string(alignment) + " bytes";
+            close();
+            return false;
+        }
+    }
+    m_format = h.vk_format;
+    m_width = h.pixel_width;
+    m_height = h.pixel_height;
+    return true;
+}
+
+void ktx2::close()
+{
+    m_file.close();
+    m_levels.clear();
+    m_format = m_width = m_height = 0;
+    m_data_begin = m_data_end = 0;
+}
+
+bool ktx2::write(const std::string& path, uint32_t format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels, std::string *error)
+{
+    if(!known_format(format) || levels.empty()) {
+        *error = "nothing to write, or an unsupported format";
+        return false;
+    }
+    texture_format f = static_cast<texture_format>(format);
+    std::vector<uint32_t> dfd = basic_dfd(f);
+
+    file_header h = {};
+    std::memcpy(h.identifier, identifier, sizeof(identifier));
+    h.vk_format = format;
+    h.type_size = 1;
+    h.pixel_width = width;
+    h.pixel_height = height;
+    h.face_count = 1;
+    h.level_count = static_cast<uint32_t>(levels.size());
+    h.dfd_offset = static_cast<uint32_t>(sizeof(h) + levels.size() * sizeof(level));
+    h.dfd_length = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+    //levels go smallest first, each aligned to the block size (and 4)
+    uint64_t alignment = std::max<uint64_t>(4, is_block_compressed(f) ? block_bytes(f) : 4);
+    std::vector<level> index(levels.size());
+    uint64_t offset = h.dfd_offset + h.dfd_length;
+    for(size_t i = levels.size(); i-- > 0;) {
+        offset = align_to(offset, alignment);
+        index[i] = { offset, levels[i].size(), levels[i].size() };
+        offset += levels[i].size();
+    }
+
+    std::vector<uint8_t> out(offset, 0);
+    std::memcpy(out.data(), &h, sizeof(h));
+    std::memcpy(out.data() + sizeof(h), index.data(), index.size() * sizeof(level));
+    std::memcpy(out.data() + h.dfd_offset, dfd.data(), h.dfd_length);
+    for(size_t i = 0; i < levels.size(); i++) {
+        std::memcpy(out.data() + index[i].offset, levels[i].data(), levels[i].size());
+    }
+
+    std::string tmp = path + ".tmp";                                //same dance as mesh_file::save, never half written
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+        if(!file) {
+            *error = "could not write " + tmp;
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    if(std::rename(tmp.c_str(), path.c_str()) != 0) {
+        *error = "could not rename " + tmp + " to " + path;
+        return false;
+    }
+    return true;
+}
+
+}
+}
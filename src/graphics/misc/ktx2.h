@@ -0,0 +1,67 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+/*
+Usage: open() maps a .ktx2 and checks the header and level index, then level_data(0..levels()-1) point into the mapping.
+The levels are stored smallest first and back to back, so data()/data_size() cover all of them in one range and
+level_offset() is the level's place in that range, ready for one staging copy with a region per level. open() rejects
+files whose levels aren't block aligned within that range, vkCmdCopyBufferToImage couldn't take their offsets.
+Only single 2d images without supercompression are read, which is what ktx2::write produces. Given the source image,
+open() also refuses a file older than it, so an edited texture is decoded again until it is cooked again.
+*/
+
+namespace cwg {
+namespace graphics {
+
+class ktx2 {
+public:
+    struct level {
+        uint64_t offset;                                            //from the start of the file
+        uint64_t size;
+        uint64_t uncompressed_size;
+    };
+
+private:
+    mapped_file m_file;
+    uint32_t m_format = 0;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::vector<level> m_levels;
+    uint64_t m_data_begin = 0;
+    uint64_t m_data_end = 0;
+
+public:
+    static constexpr uint8_t identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+    ktx2() {}
+    ~ktx2() {}
+    ktx2(const ktx2& obj) = delete;
+    void operator=(const ktx2& obj) = delete;
+
+    bool open(const std::string& path, std::string *error, const std::string& source_path = std::string());     //false if missing, older than source_path or not something we can upload
+    void close();
+
+    //levels[0] is the full size image. format is a VkFormat, only the ones in block_compression.h get a data format descriptor
+    static bool write(const std::string& path, uint32_t format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels, std::string *error);
+
+    inline uint32_t format() const { return m_format; }
+    inline uint32_t width() const { return m_width; }
+    inline uint32_t height() const { return m_height; }
+    inline uint32_t levels() const { return static_cast<uint32_t>(m_levels.size()); }
+    inline const uint8_t *level_data(uint32_t i) const { return m_file.data() + m_levels[i].offset; }
+    inline uint64_t level_size(uint32_t i) const { return m_levels[i].size; }
+    inline uint64_t level_offset(uint32_t i) const { return m_levels[i].offset - m_data_begin; }
+    inline const uint8_t *data() const { return m_file.data() + m_data_begin; }
+    inline uint64_t data_size() const { return m_data_end - m_data_begin; }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cwg {
+namespace graphics {
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool mapped_file::open(const std::string& path, bool sequential)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    p_file = file;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+    p_map_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    p_mapping = p_map_handle != nullptr ? MapViewOfFile(p_map_handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if(m_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if(fstat(m_fd, &st) != 0 || st.st_size == 0) {
+        close();
+        return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    p_mapping = mapping == MAP_FAILED ? nullptr : mapping;
+    if(p_mapping != nullptr && sequential) {
+        madvise(p_mapping, m_size, MADV_SEQUENTIAL);
+    }
+#endif
+    if(p_mapping == nullptr) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+    if(p_mapping != nullptr) {
+        UnmapViewOfFile(p_mapping);
+    }
+    if(p_map_handle != nullptr) {
+        CloseHandle(p_map_handle);
+    }
+    if(p_file != nullptr) {
+        CloseHandle(p_file);
+    }
+    p_file = nullptr;
+    p_map_handle = nullptr;
+#else
+    if(p_mapping != nullptr) {
+        munmap(p_mapping, m_size);
+    }
+    if(m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+#endif
+    p_mapping = nullptr;
+    m_size = 0;
+}
+
+}
+}
@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cwg {
+namespace graphics {
+
+//read only view of a whole file, mapped rather than read so pages come straight from the page cache
+class mapped_file {
+    void *p_mapping = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void *p_file = nullptr;
+    void *p_map_handle = nullptr;
+#else
+    int m_fd = -1;
+#endif
+
+public:
+    mapped_file() {}
+    ~mapped_file();
+    mapped_file(const mapped_file& obj) = delete;
+    void operator=(const mapped_file& obj) = delete;
+
+    bool open(const std::string& path, bool sequential = true);    //sequential: hint that it is read front to back once. false if missing or empty
+    void close();
+
+    inline bool is_open() const { return p_mapping != nullptr; }
+    inline const uint8_t *data() const { return static_cast<const uint8_t*>(p_mapping); }
+    inline size_t size() const { return m_size; }
+};
+
+}
+}
+
+#endif
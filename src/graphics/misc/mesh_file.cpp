@@ -0,0 +1,222 @@
+#include "mesh_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace cwg {
+namespace graphics {
+
+namespace {
+    inline uint64_t align16(uint64_t v) { return (v + 15) & ~uint64_t(15); }
+
+    bool source_stat(const std::string& path, uint64_t *size, int64_t *mtime)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        *size = static_cast<uint64_t>(st.st_size);
+        *mtime = static_cast<int64_t>(st.st_mtime);
+        return true;
+    }
+
+    uint64_t source_hash(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> chunk(1 << 20);
+        uint64_t h = 14695981039346656037ull;                       //fnv-1a
+        while(in) {
+            in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            std::streamsize n = in.gcount();
+            for(std::streamsize i = 0; i < n; i++) {
+                h = (h ^ static_cast<uint8_t>(chunk[i])) * 1099511628211ull;
+            }
+        }
+        return h;
+    }
+}
+
+constexpr char mesh_file::magic[4];
+
+bool mesh_file::open(const std::string& path, const std::string& source_path, uint32_t cook_flags, uint64_t cook_key)
+{
+    close();
+    if(!m_file.open(path)) {
+        return false;
+    }
+    m_size = m_file.size();
+    p_data = m_file.data();
+    if(!validate(source_path, true, cook_flags, cook_key)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void mesh_file::open_memory(std::vector<uint8_t>&& blob)
+{
+    close();
+    m_memory = std::move(blob);
+    m_size = m_memory.size();
+    p_data = m_memory.data();
+}
+
+void mesh_file::close()
+{
+    m_file.close();
+    m_memory.clear();
+    p_data = nullptr;
+    m_size = 0;
+}
+
+bool mesh_file::validate(const std::string& source_path, bool check_source, uint32_t cook_flags, uint64_t cook_key) const
+{
+    if(m_size < sizeof(mesh_header)) {
+        return false;
+    }
+    const mesh_header& h = header();
+    if(std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version || h.attribute_count > mesh_header::max_attributes) {
+        return false;
+    }
+    if((h.index_size != 2 && h.index_size != 4) || h.vertex_stride == 0) {
+        return false;
+    }
+    uint32_t stride = 0;
+    for(uint32_t i = 0; i < h.attribute_count; i++) {
+        if(h.attributes[i].format >= vertex_format::count) {
+            return false;
+        }
+        stride += format_size(h.attributes[i].format);
+    }
+    if(stride != h.vertex_stride) {                                 //the vertex buffer is bound with this stride
+        return false;
+    }
+    if(h.vertex_offset > m_size || vertex_bytes() > m_size - h.vertex_offset || h.index_offset > m_size || index_bytes() > m_size - h.index_offset) {
+        return false;
+    }
+    if(h.cook_flags != cook_flags || h.cook_key != cook_key) {
+        return false;
+    }
+    //an index past the vertices would be an out of bounds fetch on the gpu
+    const uint8_t *indices = p_data + h.index_offset;
+    if(h.index_size == 2) {
+        for(uint32_t i = 0; i < h.index_count; i++) {
+            uint16_t index;
+            std::memcpy(&index, indices + static_cast<size_t>(i) * 2, sizeof(index));
+            if(index >= h.vertex_count) {
+                return false;
+            }
+        }
+    }
+    else {
+        for(uint32_t i = 0; i < h.index_count; i++) {
+            uint32_t index;
+            std::memcpy(&index, indices + static_cast<size_t>(i) * 4, sizeof(index));
+            if(index >= h.vertex_count) {
+                return false;
+            }
+        }
+    }
+    if(!check_source) {
+        return true;
+    }
+
+    uint64_t size;
+    int64_t mtime;
+    if(!source_stat(source_path, &size, &mtime)) {
+        return true;                                                //shipped without its source, nothing to be stale against
+    }
+    if(size != h.source_size) {
+        return false;
+    }
+    //same size and time: trust it. same size, new time (checkout, copy): only the content can tell
+    return mtime == h.source_mtime || source_hash(source_path) == h.source_hash;
+}
+
+std::vector<uint8_t> mesh_file::build(const std::string& source_path, const std::vector<mesh_attribute>& layout, const void *vertices, uint32_t vertex_count, const std::vector<uint32_t>& indices, uint32_t index_size, uint32_t cook_flags, uint64_t cook_key)
+{
+    if(layout.size() > mesh_header::max_attributes) {
+        throw std::runtime_error("too many mesh attributes.");
+    }
+    mesh_header h = {};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    source_stat(source_path, &h.source_size, &h.source_mtime);
+    h.source_hash = source_hash(source_path);
+
+    uint32_t stride = 0;
+    uint32_t position_offset = 0;
+    vertex_format position_format = vertex_format::float3;
+    for(uint32_t i = 0; i < layout.size(); i++) {
+        h.attributes[i] = layout[i];
+        if(layout[i].location == 0) {
+            position_offset = stride;
+            position_format = layout[i].format;
+        }
+        stride += format_size(layout[i].format);
+    }
+    h.attribute_count = static_cast<uint32_t>(layout.size());
+    h.vertex_count = vertex_count;
+    h.vertex_stride = stride;
+    h.index_count = static_cast<uint32_t>(indices.size());
+    h.index_size = index_size;
+    h.cook_flags = cook_flags;
+    h.cook_key = cook_key;
+    h.vertex_offset = align16(sizeof(mesh_header));
+    h.index_offset = align16(h.vertex_offset + static_cast<uint64_t>(vertex_count) * h.vertex_stride);
+
+    for(uint32_t c = 0; c < 3; c++) {
+        h.bounds_min[c] = vertex_count > 0 ? std::numeric_limits<float>::max() : 0.0f;
+        h.bounds_max[c] = vertex_count > 0 ? std::numeric_limits<float>::lowest() : 0.0f;
+    }
+    const uint8_t *packed = static_cast<const uint8_t*>(vertices);
+    for(uint32_t v = 0; v < vertex_count; v++) {
+        float p[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        decode_attribute(position_format, packed + static_cast<size_t>(v) * stride + position_offset, p);
+        for(uint32_t c = 0; c < 3; c++) {
+            h.bounds_min[c] = std::min(h.bounds_min[c], p[c]);
+            h.bounds_max[c] = std::max(h.bounds_max[c], p[c]);
+        }
+    }
+
+    std::vector<uint8_t> out(h.index_offset + static_cast<uint64_t>(h.index_count) * index_size, 0);
+    std::memcpy(out.data(), &h, sizeof(h));
+    std::memcpy(out.data() + h.vertex_offset, vertices, static_cast<size_t>(vertex_count) * h.vertex_stride);
+    uint8_t *dst = out.data() + h.index_offset;
+    if(index_size == 2) {
+        for(uint32_t i : indices) {
+            uint16_t narrow = static_cast<uint16_t>(i);
+            std::memcpy(dst, &narrow, sizeof(narrow));
+            dst += sizeof(narrow);
+        }
+    }
+    else {
+        std::memcpy(dst, indices.data(), indices.size() * sizeof(uint32_t));
+    }
+    return out;
+}
+
+bool mesh_file::save(const std::string& path, const std::vector<uint8_t>& blob)
+{
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(blob.data()), static_cast<std::streamsize>(blob.size()));
+        if(!out) {
+            return false;
+        }
+    }
+    std::remove(path.c_str());                                      //rename doesn't replace on windows
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+}
+}
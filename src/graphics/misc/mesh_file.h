@@ -0,0 +1,86 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "vertex_format.h"
+
+/*
+Usage: open() maps a cooked mesh and checks it against its source (size + mtime, falling back to a content hash when only the
+mtime changed) and the cook settings, then vertex_data()/index_data() point straight into the mapping, ready to be staged.
+The layout and every index are checked too, a corrupt file is a miss and never reaches the gpu.
+When it fails, load the source, build() the blob, save() it for next time and open_memory() the blob.
+Layout: mesh_header, then the vertex blob and the index blob, each 16 byte aligned. native endian.
+*/
+
+namespace cwg {
+namespace graphics {
+
+struct mesh_attribute {
+    uint32_t location;
+    vertex_format format;                                           //attributes are packed in order, each format_size() bytes
+};
+
+struct mesh_header {
+    static constexpr uint32_t max_attributes = 8;
+
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t source_hash;                                           //fnv-1a of the source file
+    uint32_t vertex_count;
+    uint32_t vertex_stride;                                         //bytes
+    uint32_t index_count;
+    uint32_t index_size;                                            //2 or 4
+    uint32_t cook_flags;                                            //mesh_file::flag_*, a cache cooked with other flags is stale
+    uint64_t cook_key;                                              //hash of the settings the cook depends on, same rule
+    uint32_t attribute_count;
+    mesh_attribute attributes[max_attributes];
+    float bounds_min[3];                                            //of the attribute at location 0, as decoded
+    float bounds_max[3];
+    uint64_t vertex_offset;                                         //from the start of the file
+    uint64_t index_offset;
+};
+
+class mesh_file {
+    mapped_file m_file;
+    size_t m_size = 0;
+    std::vector<uint8_t> m_memory;                                  //open_memory() keeps the blob here instead
+    const uint8_t *p_data = nullptr;
+
+    bool validate(const std::string& source_path, bool check_source, uint32_t cook_flags, uint64_t cook_key) const;
+
+public:
+    static constexpr char magic[4] = { 'C', 'W', 'M', 'F' };
+    static constexpr uint32_t version = 4;
+    static constexpr uint32_t flag_optimised = 1;                   //triangles and vertices reordered by mesh_optimiser
+    static constexpr uint32_t flag_quantised = 2;                   //formats picked by quantise_vertices, not all floats
+
+    mesh_file() {}
+    ~mesh_file() {}
+    mesh_file(const mesh_file& obj) = delete;
+    void operator=(const mesh_file& obj) = delete;
+
+    bool open(const std::string& path, const std::string& source_path, uint32_t cook_flags = 0, uint64_t cook_key = 0);     //false if missing, stale or broken
+    void open_memory(std::vector<uint8_t>&& blob);
+    void close();
+
+    //vertices are vertex_count packed vertices in the layout's formats, indices are narrowed to index_size bytes
+    static std::vector<uint8_t> build(const std::string& source_path, const std::vector<mesh_attribute>& layout, const void *vertices, uint32_t vertex_count, const std::vector<uint32_t>& indices, uint32_t index_size, uint32_t cook_flags = 0, uint64_t cook_key = 0);
+    static bool save(const std::string& path, const std::vector<uint8_t>& blob);   //written next to it and renamed, never half written
+
+    inline const mesh_header& header() const { return *reinterpret_cast<const mesh_header*>(p_data); }
+    inline const void *vertex_data() const { return p_data + header().vertex_offset; }
+    inline size_t vertex_bytes() const { return static_cast<size_t>(header().vertex_count) * header().vertex_stride; }
+    inline const void *index_data() const { return p_data + header().index_offset; }
+    inline size_t index_bytes() const { return static_cast<size_t>(header().index_count) * header().index_size; }
+};
+
+}
+}
+
+#endif
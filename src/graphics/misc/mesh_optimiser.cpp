@@ -0,0 +1,286 @@
+#include "mesh_optimiser.h"
+#include "../../profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace cwg {
+namespace graphics {
+
+namespace {
+    //fifo post-transform cache, a vertex is in it while fewer than cache_size misses happened since it was loaded
+    class cache_model {
+        std::vector<uint32_t> m_time;
+        uint32_t m_now;
+        uint32_t m_size;
+    public:
+        cache_model(uint32_t vertex_count, uint32_t cache_size) : m_time(vertex_count, 0), m_now(cache_size + 1), m_size(cache_size) {}
+
+        inline bool access(uint32_t v)                              //true on a miss
+        {
+            if(m_now - m_time[v] > m_size) {
+                m_time[v] = m_now++;
+                return true;
+            }
+            return false;
+        }
+
+        inline void flush()
+        {
+            m_now += m_size + 1;
+        }
+    };
+
+    struct adjacency {                                              //triangles using each vertex, compressed rows
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+        std::vector<uint32_t> counts;
+
+        adjacency(const std::vector<uint32_t>& indices, uint32_t vertex_count) : offsets(vertex_count + 1, 0), triangles(indices.size()), counts(vertex_count, 0)
+        {
+            for(uint32_t i : indices) {
+                counts[i]++;
+            }
+            for(uint32_t v = 0; v < vertex_count; v++) {
+                offsets[v + 1] = offsets[v] + counts[v];
+            }
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for(uint32_t i = 0; i < indices.size(); i++) {
+                triangles[fill[indices[i]]++] = i / 3;
+            }
+        }
+    };
+}
+
+vertex_cache_stats analyse_vertex_cache(const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size)
+{
+    vertex_cache_stats out;
+    if(indices.empty()) {
+        return out;
+    }
+    cache_model cache(vertex_count, cache_size);
+    std::vector<char> used(vertex_count, 0);
+    uint32_t misses = 0, referenced = 0;
+    for(uint32_t i : indices) {
+        misses += cache.access(i) ? 1 : 0;
+        referenced += used[i] ? 0 : 1;
+        used[i] = 1;
+    }
+    out.acmr = float(misses) / float(indices.size() / 3);
+    out.atvr = float(misses) / float(referenced);
+    return out;
+}
+
+void optimise_vertex_cache(std::vector<uint32_t> *indices, uint32_t vertex_count, uint32_t cache_size)
+{
+    CWG_PROFILE_SCOPE("optimise_vertex_cache");
+    const std::vector<uint32_t>& in = *indices;
+    uint32_t triangle_count = static_cast<uint32_t>(in.size() / 3);
+    if(triangle_count == 0) {
+        return;
+    }
+    adjacency adj(in, vertex_count);
+    std::vector<uint32_t> live = adj.counts;                        //triangles not emitted yet per vertex
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<char> emitted(triangle_count, 0);
+    std::vector<uint32_t> dead_end;                                 //recently used vertices, where to go when the fan runs dry
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> out;
+    out.reserve(in.size());
+    uint32_t time = cache_size + 1;
+    uint32_t cursor = 0;
+    int64_t fan = in[0];
+
+    while(fan >= 0) {
+        candidates.clear();
+        uint32_t f = static_cast<uint32_t>(fan);
+        for(uint32_t k = adj.offsets[f]; k < adj.offsets[f + 1]; k++) {
+            uint32_t t = adj.triangles[k];
+            if(emitted[t]) {
+                continue;
+            }
+            for(uint32_t c = 0; c < 3; c++) {
+                uint32_t v = in[3 * t + c];
+                out.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if(time - cache_time[v] > cache_size) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[t] = 1;
+        }
+
+        //next fan: the candidate that will still be in the cache after its own triangles went through, the oldest one of those
+        fan = -1;
+        int64_t best_priority = -1;
+        for(uint32_t v : candidates) {
+            if(live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if(time - cache_time[v] + 2 * live[v] <= cache_size) {
+                priority = time - cache_time[v];
+            }
+            if(priority > best_priority) {
+                best_priority = priority;
+                fan = v;
+            }
+        }
+        if(fan >= 0) {
+            continue;
+        }
+        while(!dead_end.empty()) {
+            uint32_t v = dead_end.back();
+            dead_end.pop_back();
+            if(live[v] > 0) {
+                fan = v;
+                break;
+            }
+        }
+        while(fan < 0 && cursor < vertex_count) {
+            if(live[cursor] > 0) {
+                fan = cursor;
+            }
+            cursor++;
+        }
+    }
+    indices->swap(out);
+}
+
+void optimise_overdraw(std::vector<uint32_t> *indices, const float *vertices, uint32_t stride, uint32_t position_offset, uint32_t vertex_count, uint32_t cache_size, float threshold)
+{
+    CWG_PROFILE_SCOPE("optimise_overdraw");
+    const std::vector<uint32_t>& in = *indices;
+    uint32_t triangle_count = static_cast<uint32_t>(in.size() / 3);
+    if(triangle_count == 0) {
+        return;
+    }
+
+    //hard boundaries: triangles missing on all three vertices, where tipsify had to jump. can be reordered for free
+    std::vector<uint32_t> hard;
+    {
+        cache_model cache(vertex_count, cache_size);
+        for(uint32_t t = 0; t < triangle_count; t++) {
+            uint32_t misses = 0;
+            for(uint32_t c = 0; c < 3; c++) {
+                misses += cache.access(in[3 * t + c]) ? 1 : 0;
+            }
+            if(t == 0 || misses == 3) {
+                hard.push_back(t);
+            }
+        }
+        hard.push_back(triangle_count);
+    }
+
+    //soft boundaries: split a hard cluster wherever the part so far is already within threshold of the whole cluster's acmr
+    //one pair of models for every cluster, flushed instead of rebuilt, or the pass goes quadratic on meshes of many small clusters
+    std::vector<uint32_t> clusters;
+    cache_model cache(vertex_count, cache_size);
+    cache_model split(vertex_count, cache_size);
+    for(size_t h = 0; h + 1 < hard.size(); h++) {
+        uint32_t begin = hard[h], end = hard[h + 1];
+        cache.flush();
+        uint32_t misses = 0;
+        for(uint32_t t = begin; t < end; t++) {
+            for(uint32_t c = 0; c < 3; c++) {
+                misses += cache.access(in[3 * t + c]) ? 1 : 0;
+            }
+        }
+        float limit = threshold * float(misses) / float(end - begin);
+
+        split.flush();
+        clusters.push_back(begin);
+        uint32_t part_misses = 0, part_start = begin;
+        for(uint32_t t = begin; t < end; t++) {
+            for(uint32_t c = 0; c < 3; c++) {
+                part_misses += split.access(in[3 * t + c]) ? 1 : 0;
+            }
+            if(t + 1 < end && float(part_misses) / float(t + 1 - part_start) <= limit) {
+                clusters.push_back(t + 1);
+                split.flush();                                      //the part may be drawn anywhere, so it can't count on what came before it
+                part_misses = 0;
+                part_start = t + 1;
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    //sort key: how far the cluster faces away from the mesh centre. outward facing clusters occlude more, so they go first
+    auto position = [&](uint32_t v) { return vertices + static_cast<size_t>(v) * stride + position_offset; };
+    size_t cluster_count = clusters.size() - 1;
+    std::vector<float> centroids(cluster_count * 3, 0.0f), normals(cluster_count * 3, 0.0f), areas(cluster_count, 0.0f);
+    double mesh_centre[3] = { 0.0, 0.0, 0.0 };
+    double mesh_area = 0.0;
+    for(size_t k = 0; k < cluster_count; k++) {
+        for(uint32_t t = clusters[k]; t < clusters[k + 1]; t++) {
+            const float *a = position(in[3 * t]), *b = position(in[3 * t + 1]), *c = position(in[3 * t + 2]);
+            float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+            float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for(uint32_t i = 0; i < 3; i++) {
+                float centre = (a[i] + b[i] + c[i]) / 3.0f;
+                centroids[3 * k + i] += centre * area;
+                normals[3 * k + i] += n[i];
+                mesh_centre[i] += centre * area;
+            }
+            areas[k] += area;
+            mesh_area += area;
+        }
+    }
+    for(uint32_t i = 0; i < 3; i++) {
+        mesh_centre[i] = mesh_area > 0.0 ? mesh_centre[i] / mesh_area : 0.0;
+    }
+    std::vector<float> keys(cluster_count, 0.0f);
+    for(size_t k = 0; k < cluster_count; k++) {
+        if(areas[k] <= 0.0f) {
+            continue;
+        }
+        const float *n = &normals[3 * k];
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if(length <= 0.0f) {
+            continue;
+        }
+        for(uint32_t i = 0; i < 3; i++) {
+            keys[k] += (centroids[3 * k + i] / areas[k] - static_cast<float>(mesh_centre[i])) * n[i] / length;
+        }
+    }
+
+    std::vector<uint32_t> order(cluster_count);
+    for(uint32_t k = 0; k < cluster_count; k++) {
+        order[k] = k;
+    }
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> out;
+    out.reserve(in.size());
+    for(uint32_t k : order) {
+        out.insert(out.end(), in.begin() + 3 * clusters[k], in.begin() + 3 * clusters[k + 1]);
+    }
+    indices->swap(out);
+}
+
+uint32_t optimise_vertex_fetch(std::vector<float> *vertices, uint32_t stride, std::vector<uint32_t> *indices)
+{
+    CWG_PROFILE_SCOPE("optimise_vertex_fetch");
+    uint32_t vertex_count = static_cast<uint32_t>(vertices->size() / stride);
+    std::vector<uint32_t> remap(vertex_count, ~0u);
+    std::vector<float> out;
+    out.reserve(vertices->size());
+    uint32_t next = 0;
+    for(uint32_t& i : *indices) {
+        if(remap[i] == ~0u) {
+            remap[i] = next++;
+            out.insert(out.end(), vertices->begin() + static_cast<size_t>(i) * stride, vertices->begin() + static_cast<size_t>(i + 1) * stride);
+        }
+        i = remap[i];
+    }
+    vertices->swap(out);
+    return next;
+}
+
+}
+}
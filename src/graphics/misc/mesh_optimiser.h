@@ -0,0 +1,36 @@
+#ifndef MESH_OPTIMISER_H
+#define MESH_OPTIMISER_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+Usage, on an indexed triangle list: optimise_vertex_cache(), then optimise_overdraw() (it keeps the cache friendly clusters intact),
+then optimise_vertex_fetch() last since it renumbers the vertices. analyse_vertex_cache() before and after shows what it bought.
+cache_size models the post-transform cache as a fifo of that many vertices, 16 is a fair guess for current hardware.
+*/
+
+namespace cwg {
+namespace graphics {
+
+struct vertex_cache_stats {
+    float acmr = 0.0f;                                              //vertices transformed per triangle, 0.5 at best, 3 at worst
+    float atvr = 0.0f;                                              //vertices transformed per vertex referenced, 1 is ideal
+};
+
+vertex_cache_stats analyse_vertex_cache(const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size = 16);
+
+//tipsify (sander, nehab, barczak 2007): linear time, walks fans around vertices still in the cache
+void optimise_vertex_cache(std::vector<uint32_t> *indices, uint32_t vertex_count, uint32_t cache_size = 16);
+
+//sorts the clusters tipsify left behind so the outward facing ones draw first. threshold: how much acmr a cluster may lose
+//to a split, 1.05 allows 5%. positions are read at position_offset floats into each stride floats vertex
+void optimise_overdraw(std::vector<uint32_t> *indices, const float *vertices, uint32_t stride, uint32_t position_offset, uint32_t vertex_count, uint32_t cache_size = 16, float threshold = 1.05f);
+
+//vertices in order of first use, unreferenced ones dropped. returns the new vertex count
+uint32_t optimise_vertex_fetch(std::vector<float> *vertices, uint32_t stride, std::vector<uint32_t> *indices);
+
+}
+}
+
+#endif
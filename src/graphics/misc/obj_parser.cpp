@@ -0,0 +1,321 @@
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "../../profiler.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+
+namespace cwg {
+namespace graphics {
+
+namespace {
+    constexpr size_t min_chunk_size = 1 << 20;                      //smaller chunks cost more in scheduling than they save
+
+    struct chunk {
+        const char *begin;
+        const char *end;
+        obj_mesh mesh;
+        std::vector<uint32_t> relative;                             //corner * 3 + component of negative (relative) indices, fixed up in the merge
+        std::string error;
+    };
+
+    inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    inline const char *skip_space(const char *p, const char *end)
+    {
+        while(p != end && is_space(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    inline bool parse_float(const char *&p, const char *end, float *out)
+    {
+        p = skip_space(p, end);
+        if(p != end && *p == '+') {
+            p++;                                                    //from_chars doesn't take a leading plus
+        }
+#if defined(__cpp_lib_to_chars)
+        std::from_chars_result res = std::from_chars(p, end, *out);
+        if(res.ec != std::errc()) {
+            return false;
+        }
+        p = res.ptr;
+        return true;
+#else
+        //no floating point from_chars in this library: strtof on a terminated copy of the token
+        char token[64];
+        size_t n = 0;
+        while(p + n != end && n + 1 < sizeof(token) && !is_space(p[n])) {
+            token[n] = p[n];
+            n++;
+        }
+        token[n] = '\0';
+        char *stop;
+        *out = std::strtof(token, &stop);
+        if(stop == token) {
+            return false;
+        }
+        p += stop - token;
+        return true;
+#endif
+    }
+
+    inline bool parse_int(const char *&p, const char *end, int32_t *out)
+    {
+        std::from_chars_result res = std::from_chars(p, end, *out);
+        if(res.ec != std::errc()) {
+            return false;
+        }
+        p = res.ptr;
+        return true;
+    }
+
+    //obj indices are 1 based, negative ones count back from the newest element. 0 is invalid
+    inline bool resolve(int32_t index, size_t count, int32_t *out, bool *relative)
+    {
+        if(index > 0) {
+            *out = index - 1;
+            return true;
+        }
+        if(index < 0) {
+            *out = static_cast<int32_t>(count) + index;             //relative to the chunk's start for now
+            *relative = true;
+            return true;
+        }
+        return false;
+    }
+
+    struct face_corner {
+        obj_corner corner;
+        bool relative[3];
+    };
+
+    bool parse_corner(const char *&p, const char *end, const obj_mesh& m, face_corner *out)
+    {
+        int32_t v;
+        out->relative[0] = out->relative[1] = out->relative[2] = false;
+        out->corner.texcoord = -1;
+        out->corner.normal = -1;
+        if(!parse_int(p, end, &v) || !resolve(v, m.positions.size() / 3, &out->corner.position, &out->relative[0])) {
+            return false;
+        }
+        if(p == end || *p != '/') {
+            return true;
+        }
+        p++;
+        if(p != end && *p != '/') {
+            if(!parse_int(p, end, &v) || !resolve(v, m.texcoords.size() / 2, &out->corner.texcoord, &out->relative[1])) {
+                return false;
+            }
+        }
+        if(p == end || *p != '/') {
+            return true;
+        }
+        p++;
+        return parse_int(p, end, &v) && resolve(v, m.normals.size() / 3, &out->corner.normal, &out->relative[2]);
+    }
+
+    inline void emit(chunk& c, const face_corner& f)
+    {
+        uint32_t slot = static_cast<uint32_t>(c.mesh.corners.size());
+        for(uint32_t k = 0; k < 3; k++) {
+            if(f.relative[k]) {
+                c.relative.push_back(slot * 3 + k);
+            }
+        }
+        c.mesh.corners.push_back(f.corner);
+    }
+
+    bool parse_line(const char *p, const char *end, chunk& c)
+    {
+        p = skip_space(p, end);
+        if(end - p < 2 || p[0] == '#') {
+            return true;
+        }
+        float f[3];
+        if(p[0] == 'v' && is_space(p[1])) {
+            p += 2;
+            if(!parse_float(p, end, &f[0]) || !parse_float(p, end, &f[1]) || !parse_float(p, end, &f[2])) {
+                return false;
+            }
+            c.mesh.positions.insert(c.mesh.positions.end(), f, f + 3);        //a w or vertex colour after xyz is ignored
+        }
+        else if(p[0] == 'v' && p[1] == 't' && end - p > 2 && is_space(p[2])) {
+            p += 3;
+            if(!parse_float(p, end, &f[0])) {
+                return false;
+            }
+            const char *q = p;
+            f[1] = parse_float(q, end, &f[1]) ? f[1] : 0.0f;                   //v is optional
+            c.mesh.texcoords.insert(c.mesh.texcoords.end(), f, f + 2);
+        }
+        else if(p[0] == 'v' && p[1] == 'n' && end - p > 2 && is_space(p[2])) {
+            p += 3;
+            if(!parse_float(p, end, &f[0]) || !parse_float(p, end, &f[1]) || !parse_float(p, end, &f[2])) {
+                return false;
+            }
+            c.mesh.normals.insert(c.mesh.normals.end(), f, f + 3);
+        }
+        else if(p[0] == 'f' && is_space(p[1])) {
+            p += 2;
+            thread_local std::vector<face_corner> face;
+            face.clear();
+            for(p = skip_space(p, end); p != end; p = skip_space(p, end)) {
+                face.emplace_back();
+                if(!parse_corner(p, end, c.mesh, &face.back())) {
+                    return false;
+                }
+            }
+            if(face.size() < 3) {
+                return false;
+            }
+            for(size_t i = 2; i < face.size(); i++) {               //fan around the first corner
+                emit(c, face[0]);
+                emit(c, face[i - 1]);
+                emit(c, face[i]);
+            }
+        }
+        return true;                                                //anything else (o, g, s, usemtl, mtllib...) is skipped
+    }
+
+    void parse_chunk(chunk& c)
+    {
+        CWG_PROFILE_SCOPE("parse_obj chunk");
+        //reserve on a guess of ~30 bytes per line, it only has to be in the right ballpark
+        size_t lines = static_cast<size_t>(c.end - c.begin) / 30;
+        c.mesh.positions.reserve(lines * 3 / 2);
+        c.mesh.corners.reserve(lines * 3 / 2);
+        const char *p = c.begin;
+        while(p < c.end) {
+            //memchr is vectorised by the c library, most of the time goes into the number parsing anyway
+            const char *eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(c.end - p)));
+            if(eol == nullptr) {
+                eol = c.end;
+            }
+            if(!parse_line(p, eol, c)) {
+                c.error = "could not parse: " + std::string(p, std::min<size_t>(static_cast<size_t>(eol - p), 80));
+                return;
+            }
+            p = eol + 1;
+        }
+    }
+}
+
+bool parse_obj(const std::string& path, obj_mesh *out, thread_pool *pool, std::string *error)
+{
+    mapped_file file;
+    if(!file.open(path)) {
+        *error = "could not open " + path;
+        return false;
+    }
+    return parse_obj(reinterpret_cast<const char*>(file.data()), file.size(), out, pool, error);
+}
+
+bool parse_obj(const char *data, size_t size, obj_mesh *out, thread_pool *pool, std::string *error)
+{
+    CWG_PROFILE_SCOPE("parse_obj");
+    size_t workers = pool != nullptr ? pool->size() : 0;
+    size_t chunk_count = std::max<size_t>(1, std::min(workers * 4, size / min_chunk_size));
+    std::vector<chunk> chunks(chunk_count);
+
+    //split on line boundaries
+    const char *end = data + size;
+    const char *begin = data;
+    for(size_t i = 0; i < chunk_count; i++) {
+        const char *split = i + 1 == chunk_count ? end : data + size * (i + 1) / chunk_count;
+        if(split < begin) {
+            split = begin;
+        }
+        if(split != end) {
+            const char *eol = static_cast<const char*>(std::memchr(split, '\n', static_cast<size_t>(end - split)));
+            split = eol == nullptr ? end : eol + 1;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        begin = split;
+    }
+
+    if(pool != nullptr && chunk_count > 1) {
+        std::vector<std::future<void>> jobs;
+        for(auto& c : chunks) {
+            jobs.push_back(pool->submit([&c]() { parse_chunk(c); }));
+        }
+        for(auto& j : jobs) {
+            j.get();
+        }
+    }
+    else {
+        for(auto& c : chunks) {
+            parse_chunk(c);
+        }
+    }
+
+    //merge in file order: offsets are prefix sums of what came before
+    struct offsets { size_t positions, texcoords, normals, corners; };
+    std::vector<offsets> base(chunk_count + 1, { 0, 0, 0, 0 });
+    for(size_t i = 0; i < chunk_count; i++) {
+        if(!chunks[i].error.empty()) {
+            *error = chunks[i].error;                               //the first one in the file, not the first one to fail
+            return false;
+        }
+        const obj_mesh& m = chunks[i].mesh;
+        base[i + 1] = { base[i].positions + m.positions.size(), base[i].texcoords + m.texcoords.size(), base[i].normals + m.normals.size(), base[i].corners + m.corners.size() };
+    }
+    const offsets& total = base[chunk_count];
+    out->positions.resize(total.positions);
+    out->texcoords.resize(total.texcoords);
+    out->normals.resize(total.normals);
+    out->corners.resize(total.corners);
+
+    std::vector<char> bad(chunk_count, 0);
+    auto merge = [&](size_t i) {
+        chunk& c = chunks[i];
+        const offsets& b = base[i];
+        std::copy(c.mesh.positions.begin(), c.mesh.positions.end(), out->positions.begin() + b.positions);
+        std::copy(c.mesh.texcoords.begin(), c.mesh.texcoords.end(), out->texcoords.begin() + b.texcoords);
+        std::copy(c.mesh.normals.begin(), c.mesh.normals.end(), out->normals.begin() + b.normals);
+        obj_corner *corners = out->corners.data() + b.corners;
+        std::copy(c.mesh.corners.begin(), c.mesh.corners.end(), corners);
+        int32_t shift[3] = { static_cast<int32_t>(b.positions / 3), static_cast<int32_t>(b.texcoords / 2), static_cast<int32_t>(b.normals / 3) };
+        for(uint32_t r : c.relative) {
+            int32_t *field = &corners[r / 3].position + (r % 3);
+            *field += shift[r % 3];
+        }
+        int32_t limit[3] = { static_cast<int32_t>(total.positions / 3), static_cast<int32_t>(total.texcoords / 2), static_cast<int32_t>(total.normals / 3) };
+        for(size_t k = 0; k < c.mesh.corners.size(); k++) {
+            const obj_corner& o = corners[k];
+            if(o.position < 0 || o.position >= limit[0] || o.texcoord >= limit[1] || o.normal >= limit[2] || o.texcoord < -1 || o.normal < -1) {
+                bad[i] = 1;
+                break;
+            }
+        }
+        c.mesh = obj_mesh();                                        //free as we go, the input can be gigabytes
+    };
+    if(pool != nullptr && chunk_count > 1) {
+        std::vector<std::future<void>> jobs;
+        for(size_t i = 0; i < chunk_count; i++) {
+            jobs.push_back(pool->submit([&merge, i]() { merge(i); }));
+        }
+        for(auto& j : jobs) {
+            j.get();
+        }
+    }
+    else {
+        for(size_t i = 0; i < chunk_count; i++) {
+            merge(i);
+        }
+    }
+    if(std::find(bad.begin(), bad.end(), 1) != bad.end()) {
+        *error = "face index out of range";
+        return false;
+    }
+    return true;
+}
+
+}
+}
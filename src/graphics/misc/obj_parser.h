@@ -0,0 +1,41 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Usage: parse_obj(path, &mesh, &pool) maps the file, splits it into line aligned chunks and parses them on the pool,
+then merges the chunks in file order, so the result is the same whatever the thread count.
+Only geometry is read: v, vt, vn and f (polygons are fanned around their first corner, where tiny_obj_loader ear clips,
+so concave polygons triangulate differently; triangles and convex polygons cover the same area). groups, objects,
+smoothing groups and materials are skipped, so faces come out as one list in the order of the file.
+*/
+
+namespace cwg {
+namespace graphics {
+
+class thread_pool;
+
+struct obj_corner {
+    int32_t position;                                               //0 based, -1 when the face doesn't give one
+    int32_t texcoord;
+    int32_t normal;
+};
+
+struct obj_mesh {
+    std::vector<float> positions;                                   //xyz
+    std::vector<float> texcoords;                                   //uv
+    std::vector<float> normals;                                     //xyz
+    std::vector<obj_corner> corners;                                //3 per triangle
+};
+
+//pool may be null to parse on the calling thread. on failure error says where
+bool parse_obj(const std::string& path, obj_mesh *out, thread_pool *pool, std::string *error);
+bool parse_obj(const char *data, size_t size, obj_mesh *out, thread_pool *pool, std::string *error);
+
+}
+}
+
+#endif
@@ -0,0 +1,46 @@
+#include "thread_pool.h"
+#include "../../profiler.h"
+
+namespace cwg {
+namespace graphics {
+
+thread_pool::thread_pool(uint32_t thread_count)
+{
+    m_workers.reserve(thread_count);
+    for(uint32_t i = 0; i < thread_count; i++) {
+        m_workers.emplace_back(&thread_pool::worker_loop, this);
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobs_mu);
+        m_stop = true;
+    }
+    m_jobs_cv.notify_all();
+    for(auto& w : m_workers) {
+        w.join();                                                   //queued jobs are still finished before the workers exit
+    }
+}
+
+void thread_pool::worker_loop()
+{
+    CWG_PROFILE_THREAD("thread_pool worker");
+    for(;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_jobs_mu);
+            m_jobs_cv.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+            if(m_jobs.empty()) {
+                return;                                             //only reached when stopping
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop();
+        }
+        job();
+    }
+}
+
+}
+}
@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <vector>
+
+namespace cwg {
+namespace graphics {
+
+//fixed set of worker threads consuming a shared job queue. jobs are run in submission order, results come back through futures
+class thread_pool {
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_jobs;
+    std::mutex m_jobs_mu;
+    std::condition_variable m_jobs_cv;
+    bool m_stop = false;
+
+    void worker_loop();
+public:
+    thread_pool(uint32_t thread_count);
+    ~thread_pool();
+    thread_pool(const thread_pool& obj) = delete;
+    void operator=(const thread_pool& obj) = delete;
+
+    template<typename F>
+    auto submit(F job) -> std::future<decltype(job())>
+    {
+        using result_t = decltype(job());
+        auto task = std::make_shared<std::packaged_task<result_t()>>(std::move(job));         //std::function needs a copyable target
+        std::future<result_t> out = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mu);
+            m_jobs.emplace([task]() { (*task)(); });
+        }
+        m_jobs_cv.notify_one();
+        return out;
+    }
+
+    inline uint32_t size() { return static_cast<uint32_t>(m_workers.size()); }
+};
+
+}
+}
+#endif
@@ -0,0 +1,362 @@
+#include "vertex_format.h"
+#include "../../profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace cwg {
+namespace graphics {
+
+namespace {
+    inline float clampf(float v, float lo, float hi) { return std::min(std::max(v, lo), hi); }
+
+    inline uint32_t to_unorm(float v, float scale) { return static_cast<uint32_t>(std::lround(clampf(v, 0.0f, 1.0f) * scale)); }
+    inline int32_t to_snorm(float v, float scale) { return static_cast<int32_t>(std::lround(clampf(v, -1.0f, 1.0f) * scale)); }
+    inline float from_snorm(int32_t v, float scale) { return std::max(static_cast<float>(v) / scale, -1.0f); }
+
+    inline float sign_not_zero(float v) { return v < 0.0f ? -1.0f : 1.0f; }
+
+    void oct_encode(const float *n, float *out)
+    {
+        float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+        if(l1 == 0.0f) {
+            out[0] = out[1] = 0.0f;
+            return;
+        }
+        float x = n[0] / l1, y = n[1] / l1;
+        if(n[2] < 0.0f) {                                           //fold the lower hemisphere over the diagonals
+            float fx = (1.0f - std::fabs(y)) * sign_not_zero(x);
+            float fy = (1.0f - std::fabs(x)) * sign_not_zero(y);
+            x = fx;
+            y = fy;
+        }
+        out[0] = x;
+        out[1] = y;
+    }
+
+    void oct_decode(const float *e, float *n)
+    {
+        n[0] = e[0];
+        n[1] = e[1];
+        n[2] = 1.0f - std::fabs(e[0]) - std::fabs(e[1]);
+        if(n[2] < 0.0f) {
+            float x = n[0];
+            n[0] = (1.0f - std::fabs(n[1])) * sign_not_zero(x);
+            n[1] = (1.0f - std::fabs(x)) * sign_not_zero(n[1]);
+        }
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for(uint32_t i = 0; i < 3; i++) {
+            n[i] /= length;
+        }
+    }
+
+    inline void put16(uint8_t *out, uint32_t i, uint16_t v) { std::memcpy(out + 2 * i, &v, sizeof(v)); }
+    inline uint16_t get16(const uint8_t *in, uint32_t i) { uint16_t v; std::memcpy(&v, in + 2 * i, sizeof(v)); return v; }
+
+    vertex_format float_format(uint32_t components)
+    {
+        switch(components) {
+            case 2: return vertex_format::float2;
+            case 3: return vertex_format::float3;
+            case 4: return vertex_format::float4;
+            default: throw std::runtime_error("error: unsupported vertex attribute component count.");
+        }
+    }
+
+    //smallest first, the float fallback is appended by the caller
+    std::vector<vertex_format> candidates(const vertex_source& s, const quantise_settings& settings)
+    {
+        switch(s.kind) {
+            case attribute_kind::position:
+                return s.components == 3 ? std::vector<vertex_format>{ vertex_format::half4 } : std::vector<vertex_format>{};
+            case attribute_kind::colour:
+                return s.components >= 3 ? std::vector<vertex_format>{ vertex_format::unorm8x4 } : std::vector<vertex_format>{};
+            case attribute_kind::texcoord:
+                return s.components == 2 ? std::vector<vertex_format>{ vertex_format::unorm16x2, vertex_format::half2 } : std::vector<vertex_format>{};
+            case attribute_kind::normal:
+                if(s.components != 3) {
+                    return {};
+                }
+                if(settings.octahedral_normals) {
+                    return { vertex_format::octahedral16, vertex_format::snorm10x3 };
+                }
+                return { vertex_format::snorm10x3 };
+            default:
+                return {};
+        }
+    }
+
+    float bound(attribute_kind kind, const quantise_settings& settings)
+    {
+        switch(kind) {
+            case attribute_kind::position: return settings.position_error;
+            case attribute_kind::colour: return settings.colour_error;
+            case attribute_kind::texcoord: return settings.texcoord_error;
+            case attribute_kind::normal: return settings.normal_error;
+            default: return 0.0f;
+        }
+    }
+
+    //worst round trip error over all vertices, relative to the diagonal for positions and as an angle for normals
+    float measure(vertex_format f, const float *vertices, uint32_t vertex_count, uint32_t stride, uint32_t offset, const vertex_source& s)
+    {
+        float scale = 1.0f;
+        if(s.kind == attribute_kind::position) {
+            float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+            float hi[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+            for(uint32_t v = 0; v < vertex_count; v++) {
+                const float *p = vertices + static_cast<size_t>(v) * stride + offset;
+                for(uint32_t c = 0; c < 3; c++) {
+                    lo[c] = std::min(lo[c], p[c]);
+                    hi[c] = std::max(hi[c], p[c]);
+                }
+            }
+            float diagonal = std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+            scale = diagonal > 0.0f ? 1.0f / diagonal : 1.0f;
+        }
+
+        float worst = 0.0f;
+        uint8_t packed[16];
+        float decoded[4];
+        for(uint32_t v = 0; v < vertex_count; v++) {
+            const float *in = vertices + static_cast<size_t>(v) * stride + offset;
+            encode_attribute(f, in, s.components, packed);
+            decode_attribute(f, packed, decoded);
+            float error = 0.0f;
+            if(s.kind == attribute_kind::normal) {
+                float length = std::sqrt(in[0] * in[0] + in[1] * in[1] + in[2] * in[2]);
+                float decoded_length = std::sqrt(decoded[0] * decoded[0] + decoded[1] * decoded[1] + decoded[2] * decoded[2]);
+                if(length == 0.0f) {
+                    continue;                                       //no normal in the source, nothing to lose
+                }
+                float cosine = decoded_length > 0.0f ? (in[0] * decoded[0] + in[1] * decoded[1] + in[2] * decoded[2]) / (length * decoded_length) : -1.0f;
+                error = std::acos(clampf(cosine, -1.0f, 1.0f));
+            }
+            else {
+                for(uint32_t c = 0; c < s.components; c++) {
+                    error = std::max(error, std::fabs(decoded[c] - in[c]) * scale);
+                }
+            }
+            if(!(error <= worst)) {                                 //also catches nan from values out of half range
+                worst = std::isnan(error) ? std::numeric_limits<float>::infinity() : error;
+            }
+        }
+        return worst;
+    }
+}
+
+uint32_t format_size(vertex_format f)
+{
+    switch(f) {
+        case vertex_format::float2: return 8;
+        case vertex_format::float3: return 12;
+        case vertex_format::float4: return 16;
+        case vertex_format::half4: return 8;
+        default: return 4;
+    }
+}
+
+uint32_t format_components(vertex_format f)
+{
+    switch(f) {
+        case vertex_format::float3: case vertex_format::octahedral16: case vertex_format::snorm10x3: return 3;
+        case vertex_format::float4: case vertex_format::half4: case vertex_format::unorm8x4: return 4;
+        default: return 2;
+    }
+}
+
+const char *format_name(vertex_format f)
+{
+    static const char *names[] = { "float2", "float3", "float4", "half2", "half4", "unorm16x2", "snorm16x2", "octahedral16", "snorm10x3", "unorm8x4" };
+    return f < vertex_format::count ? names[static_cast<uint32_t>(f)] : "unknown";
+}
+
+uint16_t float_to_half(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+    uint32_t magnitude = x & 0x7fffffff;
+    if(magnitude > 0x7f800000) {
+        return sign | 0x7e00;                                       //nan
+    }
+    if(magnitude >= 0x477ff000) {
+        return sign | 0x7c00;                                       //rounds past 65504, infinity
+    }
+    if(magnitude < 0x38800000) {                                    //below the smallest normal half: denormal, in steps of 2^-24
+        float m;
+        std::memcpy(&m, &magnitude, sizeof(m));
+        return sign | static_cast<uint16_t>(std::nearbyint(m * 16777216.0f));
+    }
+    uint32_t h = (magnitude - 0x38000000) >> 13;                    //rebias the exponent from 127 to 15
+    uint32_t rest = magnitude & 0x1fff;
+    if(rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+        h++;                                                        //round to nearest even, a carry moves into the exponent
+    }
+    return sign | static_cast<uint16_t>(h);
+}
+
+float half_to_float(uint16_t h)
+{
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t x;
+    if(exponent == 0) {
+        float m = std::ldexp(static_cast<float>(mantissa), -24);
+        std::memcpy(&x, &m, sizeof(x));
+        x |= sign;
+    }
+    else if(exponent == 31) {
+        x = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+void encode_attribute(vertex_format f, const float *in, uint32_t components, uint8_t *out)
+{
+    auto at = [&](uint32_t c, float fallback) { return c < components ? in[c] : fallback; };
+    switch(f) {
+        case vertex_format::float2: case vertex_format::float3: case vertex_format::float4: {
+            float v[4] = { at(0, 0.0f), at(1, 0.0f), at(2, 0.0f), at(3, 1.0f) };
+            std::memcpy(out, v, format_size(f));
+            break;
+        }
+        case vertex_format::half2:
+            put16(out, 0, float_to_half(at(0, 0.0f)));
+            put16(out, 1, float_to_half(at(1, 0.0f)));
+            break;
+        case vertex_format::half4:
+            for(uint32_t c = 0; c < 4; c++) {
+                put16(out, c, float_to_half(at(c, c == 3 ? 1.0f : 0.0f)));
+            }
+            break;
+        case vertex_format::unorm16x2:
+            put16(out, 0, static_cast<uint16_t>(to_unorm(at(0, 0.0f), 65535.0f)));
+            put16(out, 1, static_cast<uint16_t>(to_unorm(at(1, 0.0f), 65535.0f)));
+            break;
+        case vertex_format::snorm16x2:
+            put16(out, 0, static_cast<uint16_t>(static_cast<int16_t>(to_snorm(at(0, 0.0f), 32767.0f))));
+            put16(out, 1, static_cast<uint16_t>(static_cast<int16_t>(to_snorm(at(1, 0.0f), 32767.0f))));
+            break;
+        case vertex_format::octahedral16: {
+            float n[3] = { at(0, 0.0f), at(1, 0.0f), at(2, 0.0f) };
+            float e[2];
+            oct_encode(n, e);
+            encode_attribute(vertex_format::snorm16x2, e, 2, out);
+            break;
+        }
+        case vertex_format::snorm10x3: {
+            uint32_t packed = 0;                                    //r in the low bits, a (0) in the top two
+            for(uint32_t c = 0; c < 3; c++) {
+                packed |= (static_cast<uint32_t>(to_snorm(at(c, 0.0f), 511.0f)) & 0x3ff) << (10 * c);
+            }
+            std::memcpy(out, &packed, sizeof(packed));
+            break;
+        }
+        case vertex_format::unorm8x4:
+            for(uint32_t c = 0; c < 4; c++) {
+                out[c] = static_cast<uint8_t>(to_unorm(at(c, 1.0f), 255.0f));
+            }
+            break;
+        default:
+            throw std::runtime_error("error: unsupported vertex format.");
+    }
+}
+
+void decode_attribute(vertex_format f, const uint8_t *in, float *out)
+{
+    switch(f) {
+        case vertex_format::float2: case vertex_format::float3: case vertex_format::float4:
+            std::memcpy(out, in, format_size(f));
+            break;
+        case vertex_format::half2: case vertex_format::half4:
+            for(uint32_t c = 0; c < format_components(f); c++) {
+                out[c] = half_to_float(get16(in, c));
+            }
+            break;
+        case vertex_format::unorm16x2:
+            out[0] = get16(in, 0) / 65535.0f;
+            out[1] = get16(in, 1) / 65535.0f;
+            break;
+        case vertex_format::snorm16x2:
+            out[0] = from_snorm(static_cast<int16_t>(get16(in, 0)), 32767.0f);
+            out[1] = from_snorm(static_cast<int16_t>(get16(in, 1)), 32767.0f);
+            break;
+        case vertex_format::octahedral16: {
+            float e[2];
+            decode_attribute(vertex_format::snorm16x2, in, e);
+            oct_decode(e, out);
+            break;
+        }
+        case vertex_format::snorm10x3: {
+            uint32_t packed;
+            std::memcpy(&packed, in, sizeof(packed));
+            for(uint32_t c = 0; c < 3; c++) {
+                int32_t v = static_cast<int32_t>((packed >> (10 * c)) & 0x3ff);
+                out[c] = from_snorm(v >= 512 ? v - 1024 : v, 511.0f);      //sign extend the 10 bits
+            }
+            break;
+        }
+        case vertex_format::unorm8x4:
+            for(uint32_t c = 0; c < 4; c++) {
+                out[c] = in[c] / 255.0f;
+            }
+            break;
+        default:
+            throw std::runtime_error("error: unsupported vertex format.");
+    }
+}
+
+std::vector<uint8_t> quantise_vertices(const float *vertices, uint32_t vertex_count, const std::vector<vertex_source>& sources, const quantise_settings& settings, std::vector<quantised_attribute> *layout)
+{
+    CWG_PROFILE_SCOPE("quantise_vertices");
+    uint32_t stride = 0;
+    for(const vertex_source& s : sources) {
+        stride += s.components;
+    }
+
+    layout->clear();
+    std::vector<uint32_t> source_offsets;
+    uint32_t offset = 0, packed_stride = 0;
+    for(const vertex_source& s : sources) {
+        quantised_attribute chosen = { s.location, float_format(s.components), 0.0f };
+        for(vertex_format f : candidates(s, settings)) {
+            if((settings.allowed & format_bit(f)) == 0) {
+                continue;
+            }
+            float error = measure(f, vertices, vertex_count, stride, offset, s);
+            if(error <= bound(s.kind, settings)) {
+                chosen.format = f;
+                chosen.error = error;
+                break;
+            }
+        }
+        layout->push_back(chosen);
+        source_offsets.push_back(offset);
+        offset += s.components;
+        packed_stride += format_size(chosen.format);
+    }
+
+    std::vector<uint8_t> out(static_cast<size_t>(vertex_count) * packed_stride);
+    for(uint32_t v = 0; v < vertex_count; v++) {
+        const float *in = vertices + static_cast<size_t>(v) * stride;
+        uint8_t *dst = out.data() + static_cast<size_t>(v) * packed_stride;
+        for(size_t a = 0; a < sources.size(); a++) {
+            encode_attribute((*layout)[a].format, in + source_offsets[a], sources[a].components, dst);
+            dst += format_size((*layout)[a].format);
+        }
+    }
+    return out;
+}
+
+}
+}
@@ -0,0 +1,81 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+Usage: describe the interleaved float vertices with vertex_source entries, then quantise_vertices() picks the smallest
+format per attribute that stays within the error bounds in quantise_settings and packs the vertices into them.
+The fetch unit expands every format here back to floats, except octahedral16: that one needs oct_decode in the shader,
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y)); if(n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * sign(n.xy); n = normalize(n);
+so it is only picked when quantise_settings::octahedral_normals says the shader does it.
+Every format is a multiple of 4 bytes, so attributes stay aligned however they're packed.
+*/
+
+namespace cwg {
+namespace graphics {
+
+enum class vertex_format : uint32_t {
+    float2,
+    float3,
+    float4,
+    half2,                                                          //r16g16 sfloat
+    half4,                                                          //r16g16b16a16 sfloat, three component halves aren't widely fetchable
+    unorm16x2,                                                      //[0, 1]
+    snorm16x2,                                                      //[-1, 1]
+    octahedral16,                                                   //unit vector folded onto two snorm16
+    snorm10x3,                                                      //a2b10g10r10 snorm pack32, w is 0
+    unorm8x4,                                                       //[0, 1]
+    count
+};
+
+enum class attribute_kind {
+    position,
+    colour,
+    texcoord,
+    normal,
+    other                                                           //kept as floats
+};
+
+struct vertex_source {
+    uint32_t location;
+    attribute_kind kind;
+    uint32_t components;                                            //floats in the source vertex
+};
+
+struct quantise_settings {
+    float position_error = 1.0f / 4096.0f;                          //fraction of the bounds' diagonal
+    float texcoord_error = 1.0f / 8192.0f;                          //in uv units, half a texel of an 4k texture
+    float colour_error = 1.0f / 255.0f;
+    float normal_error = 0.005f;                                    //radians
+    bool octahedral_normals = false;                                //the vertex shader decodes octahedral16
+    uint32_t allowed = ~0u;                                         //bit per vertex_format, what the device can fetch
+};
+
+constexpr uint32_t format_bit(vertex_format f) { return 1u << static_cast<uint32_t>(f); }
+constexpr uint32_t float_formats = format_bit(vertex_format::float2) | format_bit(vertex_format::float3) | format_bit(vertex_format::float4);
+
+uint32_t format_size(vertex_format f);                              //bytes
+uint32_t format_components(vertex_format f);                        //floats it decodes to
+const char *format_name(vertex_format f);
+
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+
+void encode_attribute(vertex_format f, const float *in, uint32_t components, uint8_t *out);
+void decode_attribute(vertex_format f, const uint8_t *in, float *out);     //writes format_components() floats
+
+struct quantised_attribute {
+    uint32_t location;
+    vertex_format format;
+    float error;                                                    //worst case, in the unit of its bound
+};
+
+//vertices are vertex_count * (sum of components) floats. returns the packed vertices, layout gets one entry per source in order
+std::vector<uint8_t> quantise_vertices(const float *vertices, uint32_t vertex_count, const std::vector<vertex_source>& sources, const quantise_settings& settings, std::vector<quantised_attribute> *layout);
+
+}
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include "offscreen_target.h"
+
+#include <array>
+
+namespace cwg {
+namespace graphics {
+
+offscreen_target::~offscreen_target()
+{
+	destroy();
+}
+
+void offscreen_target::create(vk::Device dev, device_allocator *alloc, vk::Extent2D extent, vk::Format format, uint32_t image_count)
+{
+	m_device = dev;
+	p_allocator = alloc;
+	m_image_format = format;
+	m_image_extent = extent;
+
+	m_images.resize(image_count);
+	m_image_mem.resize(image_count);
+	m_image_views.resize(image_count);
+	vk::ComponentMapping components = { vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity , vk::ComponentSwizzle::eIdentity , vk::ComponentSwizzle::eIdentity };
+	vk::ImageSubresourceRange subrange = { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+
+	for (uint32_t i = 0; i < image_count; i++) {
+		vk::ImageCreateInfo ci = {
+			{},
+			vk::ImageType::e2D,
+			format,
+			{ extent.width, extent.height, 1 },
+			1,
+			1,
+			vk::SampleCountFlagBits::e1,
+			vk::ImageTiling::eOptimal,
+			vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+			vk::SharingMode::eExclusive,
+			{},
+			{},
+			vk::ImageLayout::eUndefined
+		};
+		try {
+			m_images[i] = m_device.createImage(ci);
+			m_image_mem[i] = p_allocator->allocate_image(m_images[i], vk::MemoryPropertyFlagBits::eDeviceLocal);
+			vk::ImageViewCreateInfo view_info = { {}, m_images[i], vk::ImageViewType::e2D, format, components, subrange };
+			m_image_views[i] = m_device.createImageView(view_info);
+		}
+		catch (const std::exception& e) {
+			CWG_LOG_ERROR(log) << "failed to create offscreen image " << i << ": " << e.what();
+			throw std::runtime_error("failed to create offscreen image.");
+		}
+	}
+
+	vk::BufferCreateInfo buffer_info = { {}, get_readback_size(), vk::BufferUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive };
+	try {
+		m_readback = m_device.createBuffer(buffer_info);
+		m_readback_mem = p_allocator->allocate_buffer(m_readback, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	}
+	catch (const std::exception& e) {
+		CWG_LOG_ERROR(log) << "failed to create readback buffer: " << e.what();
+		throw std::runtime_error("failed to create readback buffer.");
+	}
+	CWG_LOG_INFO(log) << "created offscreen images: " << image_count << ", extent: " << extent.width << "x" << extent.height;
+}
+
+void offscreen_target::destroy()
+{
+	if (m_device == vk::Device()) {
+		return;
+	}
+	destroy_framebuffers();
+	for (size_t i = 0; i < m_images.size(); i++) {
+		m_device.destroyImageView(m_image_views[i]);
+		m_device.destroyImage(m_images[i]);
+		p_allocator->free(m_image_mem[i]);
+	}
+	m_images.clear();
+	m_image_mem.clear();
+	m_image_views.clear();
+	m_device.destroyBuffer(m_readback);
+	p_allocator->free(m_readback_mem);
+	m_readback = vk::Buffer();
+	m_device = vk::Device();
+}
+
+void offscreen_target::create_framebuffers(vk::RenderPass render_pass, vk::ImageView depth_view)
+{
+	m_framebuffers.resize(m_image_views.size());
+	for (size_t i = 0; i < m_image_views.size(); i++) {
+		std::array<vk::ImageView, 2> attachments = { m_image_views[i], depth_view };
+		vk::FramebufferCreateInfo info = { {}, render_pass, static_cast<uint32_t>(attachments.size()), attachments.data(), m_image_extent.width, m_image_extent.height, 1 };
+		try {
+			m_framebuffers[i] = m_device.createFramebuffer(info);
+		}
+		catch (const std::exception &e) {
+			CWG_LOG_ERROR(log) << "failed to create framebuffer:" << e.what();
+			throw std::runtime_error("failed to create framebuffer.");
+		}
+	}
+}
+
+void offscreen_target::destroy_framebuffers()
+{
+	for (auto fb : m_framebuffers) {
+		m_device.destroyFramebuffer(fb);
+	}
+	m_framebuffers.clear();
+}
+
+}
+}
@@ -0,0 +1,61 @@
+#ifndef OFFSCREEN_TARGET_H
+#define OFFSCREEN_TARGET_H
+
+#include <vulkan/vulkan.hpp>
+#include "../logger.h"
+#include <vector>
+
+#include "device_allocator.h"
+
+/*
+Stands in for the window + swapchain when rendering headless: a set of colour images that the render pass leaves in eTransferSrcOptimal.
+The readback buffer holds one image, tightly packed.
+*/
+
+namespace cwg {
+namespace graphics {
+
+class offscreen_target {
+private:
+	//logger
+	cwg::logger log;
+
+	vk::Device m_device;
+	device_allocator *p_allocator = nullptr;
+
+	std::vector<vk::Image> m_images;
+	std::vector<allocation> m_image_mem;
+	std::vector<vk::ImageView> m_image_views;
+	vk::Format m_image_format;
+	vk::Extent2D m_image_extent;
+
+	vk::Buffer m_readback;
+	allocation m_readback_mem;
+
+public:
+	std::vector<vk::Framebuffer> m_framebuffers;
+
+	offscreen_target() : log("offscreen_target", "log/offscreen.log", {}) {}
+	~offscreen_target();
+	offscreen_target(const offscreen_target& obj) = delete;
+	void operator=(const offscreen_target& obj) = delete;
+
+	inline vk::Format get_image_format() { return m_image_format; }
+	inline vk::Extent2D get_image_extent() { return m_image_extent; }
+	inline std::vector<vk::ImageView>& get_image_views() { return m_image_views; }
+	inline vk::Image get_image(uint32_t index) { return m_images[index]; }
+	inline vk::Buffer get_readback_buffer() { return m_readback; }
+	inline const void *get_readback_data() { return m_readback_mem.mapped; }
+	inline vk::DeviceSize get_readback_size() { return vk::DeviceSize(m_image_extent.width) * m_image_extent.height * 4; }
+
+	void create(vk::Device dev, device_allocator *alloc, vk::Extent2D extent, vk::Format format, uint32_t image_count);		//format has to be 4 bytes per texel
+	void destroy();
+
+	void create_framebuffers(vk::RenderPass render_pass, vk::ImageView depth_view);
+	void destroy_framebuffers();
+};
+
+}
+}
+
+#endif
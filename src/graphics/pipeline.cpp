@@ -5,136 +5,328 @@
 namespace cwg {
 namespace graphics {
 
-pipeline::pipeline(vk::Device dev, vk::RenderPass rp, vk::PipelineLayout lay, vk::Extent2D extent, graphics::vertex_buffer *vb) : m_device(dev)
+namespace {
+    template<typename T>
+    void hash_bytes(uint64_t *h, const T& value)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+        for(size_t i = 0; i < sizeof(T); i++) {
+            *h = (*h ^ bytes[i]) * 1099511628211ull;                            //fnv-1a
+        }
+    }
+
+    void hash_string(uint64_t *h, const std::string& s)
+    {
+        for(char c : s) {
+            hash_bytes(h, c);
+        }
+        hash_bytes(h, s.size());
+    }
+}
+
+void pipeline_desc::set_vertex_layout(graphics::vertex_buffer *vb)
 {
-    create(rp, lay, extent, vb);
+    bindings.clear();
+    attributes.clear();
+    vb->get_binding_descriptions(&bindings);
+    vb->get_attribute_descriptions(&attributes);
 }
 
-pipeline::~pipeline()
+uint64_t pipeline_desc::hash() const
 {
-    destroy();
+    //field by field, padding inside the vulkan structs never reaches the hash
+    uint64_t h = 14695981039346656037ull;
+    hash_string(&h, vertex_shader);
+    hash_string(&h, fragment_shader);
+    for(uint32_t word : specialization) {
+        hash_bytes(&h, word);
+    }
+    hash_bytes(&h, specialization.size());
+    for(const auto& b : bindings) {
+        hash_bytes(&h, b.binding);
+        hash_bytes(&h, b.stride);
+        hash_bytes(&h, b.inputRate);
+    }
+    for(const auto& a : attributes) {
+        hash_bytes(&h, a.location);
+        hash_bytes(&h, a.binding);
+        hash_bytes(&h, a.format);
+        hash_bytes(&h, a.offset);
+    }
+    hash_bytes(&h, static_cast<VkPipelineLayout>(layout));
+    hash_bytes(&h, colour_format);
+    hash_bytes(&h, depth_format);
+    hash_bytes(&h, samples);
+    hash_bytes(&h, topology);
+    hash_bytes(&h, polygon_mode);
+    hash_bytes(&h, static_cast<VkCullModeFlags>(cull_mode));
+    hash_bytes(&h, front_face);
+    hash_bytes(&h, depth_test);
+    hash_bytes(&h, depth_write);
+    hash_bytes(&h, depth_compare);
+    hash_bytes(&h, blend);
+    hash_bytes(&h, extended_dynamic_state);
+    return h;
 }
 
-void pipeline::create(vk::RenderPass rp, vk::PipelineLayout lay, vk::Extent2D extent, graphics::vertex_buffer *vb)
+bool pipeline_desc::operator==(const pipeline_desc& o) const
 {
-    if(m_device == vk::Device()) { throw std::runtime_error("cannot create rendere pass if there is no device."); }
-    //shader stages
-	vk::ShaderModule vertex_module = create_shader(R"(./resources/vert.spv)");
-	vk::ShaderModule frag_module = create_shader(R"(./resources/frag.spv)");
-    //for temporary cleanup
-    m_shaders.push_back(vertex_module);
-    m_shaders.push_back(frag_module);
-	
-	vk::PipelineShaderStageCreateInfo vertex_stage_info = { {}, vk::ShaderStageFlagBits::eVertex, vertex_module, "main", {} };
-	vk::PipelineShaderStageCreateInfo frag_stage_info = { {}, vk::ShaderStageFlagBits::eFragment, frag_module, "main", {} };
+    return vertex_shader == o.vertex_shader && fragment_shader == o.fragment_shader && specialization == o.specialization && bindings == o.bindings && attributes == o.attributes
+        && layout == o.layout && colour_format == o.colour_format && depth_format == o.depth_format && samples == o.samples
+        && topology == o.topology && polygon_mode == o.polygon_mode && cull_mode == o.cull_mode && front_face == o.front_face
+        && depth_test == o.depth_test && depth_write == o.depth_write && depth_compare == o.depth_compare && blend == o.blend
+        && extended_dynamic_state == o.extended_dynamic_state;
+}
 
-	vk::PipelineShaderStageCreateInfo shaders[] = { vertex_stage_info, frag_stage_info };
+namespace {
+    //the create infos a desc turns into, shared by the monolithic and the library paths. points into itself, so never copied
+    struct fixed_function_state {
+        vk::PipelineVertexInputStateCreateInfo vertex_input;
+        vk::PipelineInputAssemblyStateCreateInfo input_assembly;
+        vk::PipelineViewportStateCreateInfo viewport;
+        vk::PipelineRasterizationStateCreateInfo rasterisation;
+        vk::PipelineMultisampleStateCreateInfo multisample;
+        vk::PipelineDepthStencilStateCreateInfo depth_stencil;
+        vk::PipelineColorBlendAttachmentState colour_blend_attachment;
+        vk::PipelineColorBlendStateCreateInfo colour_blend;
+        std::vector<vk::DynamicState> dynamic_states;
+        vk::PipelineDynamicStateCreateInfo dynamic;
+        std::vector<vk::SpecializationMapEntry> constants;
+        vk::SpecializationInfo specialization;
 
-	//input TODO: add binding desc + attribute desc
-	std::vector<vk::VertexInputBindingDescription> bindings;
-	vb->get_binding_descriptions(&bindings);
-	std::vector<vk::VertexInputAttributeDescription> attribs;
-	vb->get_attribute_descriptions(&attribs);
+        inline const vk::SpecializationInfo *specialization_info() const { return constants.empty() ? nullptr : &specialization; }
 
-	vk::PipelineVertexInputStateCreateInfo vertex_input_state = { {}, static_cast<uint32_t>(bindings.size()), bindings.data(), static_cast<uint32_t>(attribs.size()), attribs.data() };
+        fixed_function_state(const pipeline_desc& desc);
+        fixed_function_state(const fixed_function_state& obj) = delete;
+        void operator=(const fixed_function_state& obj) = delete;
+    };
 
-	//input assembly TODO: set flast one to true for index buffers
-	vk::PipelineInputAssemblyStateCreateInfo input_assembly_state = { {}, vk::PrimitiveTopology::eTriangleList, false };
+    fixed_function_state::fixed_function_state(const pipeline_desc& desc)
+    {
+        //specialization constants, ids the shader doesn't declare are ignored
+        for(uint32_t i = 0; i < desc.specialization.size(); i++) {
+            constants.push_back({ i, i * static_cast<uint32_t>(sizeof(uint32_t)), sizeof(uint32_t) });
+        }
+        specialization = { static_cast<uint32_t>(constants.size()), constants.data(), desc.specialization.size() * sizeof(uint32_t), desc.specialization.data() };
 
-	//viewport
-	vk::Viewport viewport = { 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
-	vk::Rect2D scissor = { {0, 0}, extent };
-	vk::PipelineViewportStateCreateInfo viewport_state = { {}, 1, &viewport, 1, &scissor };
+        //input
+        vertex_input = { {}, static_cast<uint32_t>(desc.bindings.size()), desc.bindings.data(), static_cast<uint32_t>(desc.attributes.size()), desc.attributes.data() };
 
-	//rasteriser
-	vk::PipelineRasterizationStateCreateInfo rasterisation_state = {
-		{},
-		false,																			//clamp enable
-		false,																			//rasteriser discard
-		vk::PolygonMode::eFill,
-		vk::CullModeFlagBits::eBack,
-		vk::FrontFace::eCounterClockwise,
-		false,																			//depth bias
-		0.0f,
-		0.0f,
-		0.0f,
-		1.0f																			//line width
-	};
+        //input assembly TODO: set flast one to true for index buffers
+        input_assembly = { {}, desc.topology, false };
 
-	//multisampling
-	vk::PipelineMultisampleStateCreateInfo multisample_state = { {}, vk::SampleCountFlagBits::e1 }; //TODO: actually look into this
+        //viewport, both dynamic so a resize doesn't need a new pipeline
+        viewport = { {}, 1, nullptr, 1, nullptr };
 
-	//TODO: depth + stencil testing
+        //rasteriser
+        rasterisation = {
+            {},
+            false,																			//clamp enable
+            false,																			//rasteriser discard
+            desc.polygon_mode,
+            desc.cull_mode,
+            desc.front_face,
+            false,																			//depth bias
+            0.0f,
+            0.0f,
+            0.0f,
+            1.0f																			//line width
+        };
 
-	//color blending TODO: implement blending
-	vk::PipelineColorBlendAttachmentState colour_blend_attachment = { false, {}, {}, {}, {}, {}, {},
-																	vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA };
+        //multisampling
+        multisample = { {}, desc.samples };
 
-	vk::PipelineColorBlendStateCreateInfo colour_blend_state = { {}, false, {}, 1, &colour_blend_attachment, {} };			//Blending is set to false for now
+        //color blending
+        colour_blend_attachment = { desc.blend,
+            vk::BlendFactor::eSrcAlpha, vk::BlendFactor::eOneMinusSrcAlpha, vk::BlendOp::eAdd,            //straight alpha over
+            vk::BlendFactor::eOne, vk::BlendFactor::eOneMinusSrcAlpha, vk::BlendOp::eAdd,
+            vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA };
 
-	//dynamic state
-	vk::DynamicState dynamic_states_array[] = { vk::DynamicState::eViewport, vk::DynamicState::eLineWidth };			
-	vk::PipelineDynamicStateCreateInfo dynamic_state = { {}, 2, dynamic_states_array };
+        colour_blend = { {}, false, {}, 1, &colour_blend_attachment, {} };
 
-	//depth stencil
-	vk::PipelineDepthStencilStateCreateInfo depth_stencil_state = {
-		{},
-		true,
-		true,
-		vk::CompareOp::eLess,
-		false,
-		false,
-		{},
-		{},
-		0.0f,
-		1.0f
-	};
+        //dynamic state
+        dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+#ifdef VK_EXT_extended_dynamic_state
+        if(desc.extended_dynamic_state) {
+            dynamic_states.insert(dynamic_states.end(), { vk::DynamicState::eCullModeEXT, vk::DynamicState::eDepthTestEnableEXT,
+                                                          vk::DynamicState::eDepthWriteEnableEXT, vk::DynamicState::ePrimitiveTopologyEXT });
+        }
+#endif
+        dynamic = { {}, static_cast<uint32_t>(dynamic_states.size()), dynamic_states.data() };
+
+        //depth stencil
+        depth_stencil = {
+            {},
+            desc.depth_test,
+            desc.depth_write,
+            desc.depth_compare,
+            false,
+            false,
+            {},
+            {},
+            0.0f,
+            1.0f
+        };
+    }
+
+    //through the c entry point: newer vulkan.hpp returns a ResultValue from createGraphicsPipeline, this builds either way
+    vk::Pipeline create_one(vk::Device dev, const vk::GraphicsPipelineCreateInfo& create_info, vk::PipelineCache cache)
+    {
+        VkPipeline out = VK_NULL_HANDLE;
+        const VkGraphicsPipelineCreateInfo& info = create_info;
+        if(vkCreateGraphicsPipelines(static_cast<VkDevice>(dev), static_cast<VkPipelineCache>(cache), 1, &info, nullptr, &out) != VK_SUCCESS) {
+            throw std::runtime_error("error: failed to create graphics pipeline.");
+        }
+        return vk::Pipeline(out);
+    }
+}
+
+vk::Pipeline create_graphics_pipeline(vk::Device dev, const pipeline_desc& desc, vk::RenderPass rp, vk::ShaderModule vertex_module, vk::ShaderModule frag_module, vk::PipelineCache cache)
+{
+	fixed_function_state state(desc);
+
+	//shader stages
+	vk::PipelineShaderStageCreateInfo vertex_stage_info = { {}, vk::ShaderStageFlagBits::eVertex, vertex_module, "main", nullptr };
+	vk::PipelineShaderStageCreateInfo frag_stage_info = { {}, vk::ShaderStageFlagBits::eFragment, frag_module, "main", state.specialization_info() };
+
+	vk::PipelineShaderStageCreateInfo shaders[] = { vertex_stage_info, frag_stage_info };
 
 	//create
-	vk::Pipeline pipeline;
 	vk::GraphicsPipelineCreateInfo create_info = {
 		{},
 		2,
 		shaders,
-		&vertex_input_state,
-		&input_assembly_state,
+		&state.vertex_input,
+		&state.input_assembly,
 		{},																	//tesselation
-		&viewport_state,
-		&rasterisation_state,
-		&multisample_state,
-		&depth_stencil_state,												// depth stencil
-		&colour_blend_state,
-		{},																	//TODO: implement dynamic state
-		lay,
+		&state.viewport,
+		&state.rasterisation,
+		&state.multisample,
+		&state.depth_stencil,												// depth stencil
+		&state.colour_blend,
+		&state.dynamic,
+		desc.layout,
 		rp
 	};
-
-
-	try {
-		m_handle = m_device.createGraphicsPipeline(vk::PipelineCache(), create_info, nullptr);
-	}
-	catch (...) {
-		throw std::runtime_error("error: failed to create graphics pipeline.");
-	}
-	
+	return create_one(dev, create_info, cache);
 }
 
-void pipeline::destroy()
+pipeline_desc library_key(const pipeline_desc& desc, pipeline_part part)
 {
-    //note: no safety is provided if object is in use
-    if(m_device != vk::Device() && m_handle != vk::Pipeline()) {
-        m_device.destroyPipeline(m_handle);
+    //only what the part is built from, everything else left at its default
+    pipeline_desc key;
+    key.vertex_shader.clear();
+    key.fragment_shader.clear();
+    switch(part) {
+        case pipeline_part::vertex_input:
+            key.bindings = desc.bindings;
+            key.attributes = desc.attributes;
+            key.topology = desc.topology;
+            key.extended_dynamic_state = desc.extended_dynamic_state;
+            break;
+        case pipeline_part::pre_rasterisation:
+            key.vertex_shader = desc.vertex_shader;                             //no specialization, the vertex shader declares none
+            key.layout = desc.layout;
+            key.colour_format = desc.colour_format;
+            key.depth_format = desc.depth_format;
+            key.samples = desc.samples;
+            key.polygon_mode = desc.polygon_mode;
+            key.cull_mode = desc.cull_mode;
+            key.front_face = desc.front_face;
+            key.extended_dynamic_state = desc.extended_dynamic_state;
+            break;
+        case pipeline_part::fragment_shader:
+            key.fragment_shader = desc.fragment_shader;
+            key.specialization = desc.specialization;
+            key.layout = desc.layout;
+            key.colour_format = desc.colour_format;
+            key.depth_format = desc.depth_format;
+            key.samples = desc.samples;
+            key.depth_test = desc.depth_test;
+            key.depth_write = desc.depth_write;
+            key.depth_compare = desc.depth_compare;
+            key.extended_dynamic_state = desc.extended_dynamic_state;
+            break;
+        case pipeline_part::fragment_output:
+            key.colour_format = desc.colour_format;
+            key.depth_format = desc.depth_format;
+            key.samples = desc.samples;
+            key.blend = desc.blend;
+            break;
     }
-    for(auto shader: m_shaders) {
-        m_device.destroyShaderModule(shader);
+    return key;
+}
+
+#ifdef VK_EXT_graphics_pipeline_library
+vk::Pipeline create_pipeline_library(vk::Device dev, const pipeline_desc& desc, pipeline_part part, vk::RenderPass rp, vk::ShaderModule module, vk::PipelineCache cache)
+{
+    fixed_function_state state(desc);
+    vk::GraphicsPipelineLibraryCreateInfoEXT library_info;
+    vk::PipelineShaderStageCreateInfo stage;
+    vk::GraphicsPipelineCreateInfo create_info;
+    create_info.pNext = &library_info;
+    create_info.flags = vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT;   //keep the optimised link possible
+    create_info.pDynamicState = &state.dynamic;                                 //states a part doesn't own are ignored
+    switch(part) {
+        case pipeline_part::vertex_input:
+            library_info.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface;
+            create_info.pVertexInputState = &state.vertex_input;
+            create_info.pInputAssemblyState = &state.input_assembly;
+            break;
+        case pipeline_part::pre_rasterisation:
+            library_info.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders;
+            stage = { {}, vk::ShaderStageFlagBits::eVertex, module, "main", nullptr };
+            create_info.stageCount = 1;
+            create_info.pStages = &stage;
+            create_info.pViewportState = &state.viewport;
+            create_info.pRasterizationState = &state.rasterisation;
+            create_info.layout = desc.layout;
+            create_info.renderPass = rp;
+            break;
+        case pipeline_part::fragment_shader:
+            library_info.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader;
+            stage = { {}, vk::ShaderStageFlagBits::eFragment, module, "main", state.specialization_info() };
+            create_info.stageCount = 1;
+            create_info.pStages = &stage;
+            create_info.pMultisampleState = &state.multisample;
+            create_info.pDepthStencilState = &state.depth_stencil;
+            create_info.layout = desc.layout;
+            create_info.renderPass = rp;
+            break;
+        case pipeline_part::fragment_output:
+            library_info.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface;
+            create_info.pMultisampleState = &state.multisample;
+            create_info.pColorBlendState = &state.colour_blend;
+            create_info.renderPass = rp;
+            break;
     }
-    m_shaders.clear();
-    m_handle = vk::Pipeline(); 
+    return create_one(dev, create_info, cache);
+}
+
+vk::Pipeline link_pipeline_libraries(vk::Device dev, const std::array<vk::Pipeline, pipeline_part_count>& parts, vk::PipelineLayout layout, bool optimise, vk::PipelineCache cache)
+{
+    vk::PipelineLibraryCreateInfoKHR library_info = { static_cast<uint32_t>(parts.size()), parts.data() };
+    vk::GraphicsPipelineCreateInfo create_info;
+    create_info.pNext = &library_info;
+    create_info.flags = optimise ? vk::PipelineCreateFlags(vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT) : vk::PipelineCreateFlags();
+    create_info.layout = layout;
+    return create_one(dev, create_info, cache);
+}
+#else
+vk::Pipeline create_pipeline_library(vk::Device, const pipeline_desc&, pipeline_part, vk::RenderPass, vk::ShaderModule, vk::PipelineCache)
+{
+    throw std::runtime_error("built against vulkan headers without VK_EXT_graphics_pipeline_library.");
+}
+
+vk::Pipeline link_pipeline_libraries(vk::Device, const std::array<vk::Pipeline, pipeline_part_count>&, vk::PipelineLayout, bool, vk::PipelineCache)
+{
+    throw std::runtime_error("built against vulkan headers without VK_EXT_graphics_pipeline_library.");
 }
+#endif
 
 //helper
 
-vk::ShaderModule pipeline::create_shader(std::string path)
+vk::ShaderModule load_shader_module(vk::Device dev, const std::string& path)
 {
 	std::ifstream file(path, std::ifstream::ate | std::ifstream::binary);
 	if (!file.is_open()) {
@@ -150,7 +342,7 @@ vk::ShaderModule pipeline::create_shader(std::string path)
 		vk::ShaderModuleCreateInfo create_info = { {}, buffer.size(), reinterpret_cast<const uint32_t*>(buffer.data()) };
 		vk::ShaderModule shader;
 		try {
-			shader = m_device.createShaderModule(create_info, nullptr);
+			shader = dev.createShaderModule(create_info, nullptr);
 		}
 		catch (...) {
 			throw std::runtime_error("failed to create shader module.");
@@ -2,34 +2,61 @@
 #define PIPELINE_H
 
 #include <vulkan/vulkan.hpp>
+#include <array>
 #include <vector>
 #include <string>
 
 #include "buffers/buffer_base.h"
 #include "buffers/vertex_buffer.h"
 
+/*
+Usage: fill a pipeline_desc and hand it to pipeline_service, which owns the shader modules and every pipeline built here.
+Viewport and scissor are always dynamic, set them after every bind. With extended_dynamic_state (needs
+VK_EXT_extended_dynamic_state on the device) cull mode, depth test, depth write and topology are dynamic too, so one
+pipeline serves every combination of them; the values in the desc are only the defaults it is built with.
+*/
+
 namespace cwg {
 namespace graphics {
 
-class pipeline {
-    vk::Pipeline m_handle;
-    vk::Device m_device;
-    std::vector<vk::ShaderModule> m_shaders;
-
-    void create(vk::RenderPass rp, vk::PipelineLayout lay, vk::Extent2D extent, graphics::vertex_buffer *vb);
-    vk::ShaderModule create_shader(std::string path);
-    void destroy();
-public:
-    pipeline() {}
-    pipeline(vk::Device dev, vk::RenderPass rp, vk::PipelineLayout lay, vk::Extent2D extent,  graphics::vertex_buffer *vb);
-    ~pipeline();
-
-    inline vk::Pipeline get() { return m_handle; }
-    inline void reset() { destroy();}
-    //inline void reset(vk::Format format) { destroy(); create(format);  }      //dangerous
-    inline void reset(vk::Device dev, vk::RenderPass rp, vk::PipelineLayout lay, vk::Extent2D extent,  graphics::vertex_buffer *vb) { destroy(); m_device = dev; create(rp, lay, extent, vb); }
+struct pipeline_desc {                                                          //everything a graphics pipeline is built from
+    std::string vertex_shader = "./resources/vert.spv";
+    std::string fragment_shader = "./resources/frag.spv";
+    std::vector<uint32_t> specialization;                                       //word i is constant_id i of the fragment stage, see shader_permutation.h
+    std::vector<vk::VertexInputBindingDescription> bindings;
+    std::vector<vk::VertexInputAttributeDescription> attributes;
+    vk::PipelineLayout layout;
+    vk::Format colour_format = vk::Format::eUndefined;                          //render pass compatibility, the handle itself isn't part of the key
+    vk::Format depth_format = vk::Format::eUndefined;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+    vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+    vk::PolygonMode polygon_mode = vk::PolygonMode::eFill;
+    vk::CullModeFlags cull_mode = vk::CullModeFlagBits::eBack;
+    vk::FrontFace front_face = vk::FrontFace::eCounterClockwise;
+    bool depth_test = true;
+    bool depth_write = true;
+    vk::CompareOp depth_compare = vk::CompareOp::eLess;
+    bool blend = false;                                                         //straight alpha over when set
+    bool extended_dynamic_state = false;
+
+    void set_vertex_layout(graphics::vertex_buffer *vb);
+    uint64_t hash() const;
+    bool operator==(const pipeline_desc& o) const;
+    inline bool operator!=(const pipeline_desc& o) const { return !(*this == o); }
 };
 
+//builds one pipeline from desc with the given modules, rp only has to be compatible with desc's formats
+vk::Pipeline create_graphics_pipeline(vk::Device dev, const pipeline_desc& desc, vk::RenderPass rp, vk::ShaderModule vertex_module, vk::ShaderModule frag_module, vk::PipelineCache cache);
+vk::ShaderModule load_shader_module(vk::Device dev, const std::string& path);
+
+//VK_EXT_graphics_pipeline_library: the four parts are built on their own and linked into a full pipeline.
+//library_key() is the part of a desc one library depends on, so equal keys can share the library
+enum class pipeline_part : uint32_t { vertex_input, pre_rasterisation, fragment_shader, fragment_output };
+constexpr size_t pipeline_part_count = 4;
+pipeline_desc library_key(const pipeline_desc& desc, pipeline_part part);
+vk::Pipeline create_pipeline_library(vk::Device dev, const pipeline_desc& desc, pipeline_part part, vk::RenderPass rp, vk::ShaderModule module, vk::PipelineCache cache);   //module: the part's shader, if it has one
+vk::Pipeline link_pipeline_libraries(vk::Device dev, const std::array<vk::Pipeline, pipeline_part_count>& parts, vk::PipelineLayout layout, bool optimise, vk::PipelineCache cache);   //optimise: slow, about as fast at runtime as a monolithic one
+
 
 }
 }
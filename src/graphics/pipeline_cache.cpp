@@ -0,0 +1,158 @@
+#include "pipeline_cache.h"
+#include "../profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace cwg {
+namespace graphics {
+
+namespace {
+    uint64_t fnv1a(const uint8_t *data, size_t size)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for(size_t i = 0; i < size; i++) {
+            h = (h ^ data[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+}
+
+constexpr char pipeline_cache::magic[4];
+
+pipeline_cache::~pipeline_cache()
+{
+    shutdown();
+}
+
+void pipeline_cache::init(vk::Device dev, vk::PhysicalDevice p_dev, const std::string& path)
+{
+    CWG_PROFILE_SCOPE("pipeline_cache::init");
+    m_device = dev;
+    m_props = p_dev.getProperties();
+    m_path = path;
+
+    std::vector<uint8_t> blob;
+    if(!m_path.empty() && load(&blob)) {
+        CWG_LOG_DEBUG(log) << "loaded " << blob.size() << " bytes from " << m_path;
+    }
+    vk::PipelineCacheCreateInfo ci = { {}, blob.size(), blob.empty() ? nullptr : blob.data() };
+    try {
+        m_handle = m_device.createPipelineCache(ci);
+    }
+    catch(const std::exception& e) {
+        if(blob.empty()) {
+            CWG_LOG_ERROR(log) << "failed to create pipeline cache: " << e.what();
+            throw std::runtime_error("failed to create pipeline cache.");
+        }
+        CWG_LOG_WARN(log) << "driver rejected " << m_path << ", starting empty: " << e.what();
+        blob.clear();
+        m_handle = m_device.createPipelineCache(vk::PipelineCacheCreateInfo());
+    }
+    m_saved_size = blob.size();
+}
+
+bool pipeline_cache::load(std::vector<uint8_t> *blob)
+{
+    std::ifstream in(m_path, std::ios::binary | std::ios::ate);
+    if(!in) {
+        CWG_LOG_INFO(log) << "no pipeline cache at " << m_path << ", starting empty";
+        return false;
+    }
+    size_t size = static_cast<size_t>(in.tellg());
+    in.seekg(0);
+    file_header h;
+    if(size < sizeof(h) || !in.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+        CWG_LOG_WARN(log) << m_path << " is too short, starting empty";
+        return false;
+    }
+    if(std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version) {
+        CWG_LOG_WARN(log) << m_path << " is not a pipeline cache of this version, starting empty";
+        return false;
+    }
+    if(h.vendor_id != m_props.vendorID || h.device_id != m_props.deviceID || h.driver_version != m_props.driverVersion
+        || std::memcmp(h.uuid, m_props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        CWG_LOG_WARN(log) << m_path << " was written by another device or driver, starting empty";         //the driver would ignore it anyway, or worse
+        return false;
+    }
+    if(h.data_size != size - sizeof(h)) {
+        CWG_LOG_WARN(log) << m_path << " is truncated, starting empty";
+        return false;
+    }
+    blob->resize(static_cast<size_t>(h.data_size));
+    if(!in.read(reinterpret_cast<char*>(blob->data()), static_cast<std::streamsize>(blob->size())) || fnv1a(blob->data(), blob->size()) != h.data_hash) {
+        CWG_LOG_WARN(log) << m_path << " is corrupted, starting empty";
+        blob->clear();
+        return false;
+    }
+
+    //vulkan's own header: length, version one, vendor, device, uuid
+    uint32_t vk_header[4];
+    if(blob->size() < sizeof(vk_header) + VK_UUID_SIZE) {
+        blob->clear();
+        return false;
+    }
+    std::memcpy(vk_header, blob->data(), sizeof(vk_header));
+    if(vk_header[0] < sizeof(vk_header) + VK_UUID_SIZE || vk_header[1] != static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne)
+        || vk_header[2] != m_props.vendorID || vk_header[3] != m_props.deviceID || std::memcmp(blob->data() + sizeof(vk_header), m_props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        CWG_LOG_WARN(log) << m_path << " holds a blob for another device, starting empty";
+        blob->clear();
+        return false;
+    }
+    return true;
+}
+
+bool pipeline_cache::save()
+{
+    CWG_PROFILE_SCOPE("pipeline_cache::save");
+    if(m_handle == vk::PipelineCache() || m_path.empty()) {
+        return false;
+    }
+    std::vector<uint8_t> blob = m_device.getPipelineCacheData(m_handle);
+    if(blob.size() == m_saved_size) {
+        return true;                                            //drivers only ever add to it, same size means nothing new
+    }
+
+    file_header h = {};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.vendor_id = m_props.vendorID;
+    h.device_id = m_props.deviceID;
+    h.driver_version = m_props.driverVersion;
+    std::memcpy(h.uuid, m_props.pipelineCacheUUID, VK_UUID_SIZE);
+    h.data_size = blob.size();
+    h.data_hash = fnv1a(blob.data(), blob.size());
+
+    std::string tmp = m_path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(blob.data()), static_cast<std::streamsize>(blob.size()));
+        if(!out) {
+            CWG_LOG_ERROR(log) << "could not write " << tmp;
+            return false;
+        }
+    }
+    std::remove(m_path.c_str());                                //rename doesn't replace on windows
+    if(std::rename(tmp.c_str(), m_path.c_str()) != 0) {
+        CWG_LOG_ERROR(log) << "could not rename " << tmp << " to " << m_path;
+        return false;
+    }
+    CWG_LOG_DEBUG(log) << "saved " << blob.size() << " bytes to " << m_path;
+    m_saved_size = blob.size();
+    return true;
+}
+
+void pipeline_cache::shutdown()
+{
+    if(m_handle == vk::PipelineCache()) {
+        return;
+    }
+    save();
+    m_device.destroyPipelineCache(m_handle);
+    m_handle = vk::PipelineCache();
+}
+
+}
+}
@@ -0,0 +1,60 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <vulkan/vulkan.hpp>
+#include "../logger.h"
+#include <string>
+#include <vector>
+
+/*
+Usage: init() once the device exists, pass get() to every createGraphicsPipelines, save() whenever new pipelines were made
+and shutdown() before the device goes. init() starts from the file at path when it was written by this exact device and
+driver (vendor, device id, driver version and pipeline cache uuid, both in our header and in vulkan's own), else from empty.
+save() writes next to the file and renames it over, and skips the write when the driver has nothing new.
+*/
+
+namespace cwg {
+namespace graphics {
+
+class pipeline_cache {
+    cwg::logger log;
+
+    struct file_header {
+        char magic[4];
+        uint32_t version;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+        uint64_t data_hash;                                     //fnv-1a of the vulkan blob, catches truncated or corrupted files
+    };
+
+    vk::Device m_device;
+    vk::PhysicalDeviceProperties m_props;
+    vk::PipelineCache m_handle;
+    std::string m_path;
+    size_t m_saved_size = 0;                                    //size of the blob at the last load or save
+
+    bool load(std::vector<uint8_t> *blob);
+
+public:
+    static constexpr char magic[4] = { 'C', 'W', 'P', 'C' };
+    static constexpr uint32_t version = 1;
+
+    pipeline_cache() : log("pipeline_cache", "log/pipeline_cache.log", {}) {}
+    ~pipeline_cache();
+    pipeline_cache(const pipeline_cache& obj) = delete;
+    void operator=(const pipeline_cache& obj) = delete;
+
+    void init(vk::Device dev, vk::PhysicalDevice p_dev, const std::string& path);  //empty path: in memory only, never saved
+    bool save();
+    void shutdown();                                            //saves, then destroys the cache
+
+    inline vk::PipelineCache get() { return m_handle; }
+};
+
+}
+}
+
+#endif
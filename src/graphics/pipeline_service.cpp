@@ -0,0 +1,283 @@
+#include "pipeline_service.h"
+#include "../profiler.h"
+
+#include <chrono>
+
+namespace cwg {
+namespace graphics {
+
+vk::Pipeline pipeline_ticket::get() const
+{
+    if(ready()) {
+        return vk::Pipeline(p_job->handle.load(std::memory_order_acquire));
+    }
+    if(p_fallback && p_fallback->state.load(std::memory_order_acquire) == pipeline_job::ready) {
+        return vk::Pipeline(p_fallback->handle.load(std::memory_order_acquire));
+    }
+    return vk::Pipeline();
+}
+
+pipeline_service::~pipeline_service()
+{
+    shutdown();
+}
+
+void pipeline_service::init(vk::Device dev, vk::PipelineCache cache, uint32_t threads, bool libraries)
+{
+    m_device = dev;
+    m_cache = cache;
+    m_libraries = libraries;
+    m_async = threads > 0;
+    if(m_async) {
+        m_workers.reset(new thread_pool(threads));
+    }
+    CWG_LOG_INFO(log) << "pipeline compile threads: " << threads << ", pipeline libraries: " << (m_libraries ? "yes" : "no");
+}
+
+pipeline_ticket pipeline_service::request(const pipeline_desc& desc, vk::RenderPass rp, const pipeline_ticket& fallback)
+{
+    if(m_device == vk::Device()) {
+        throw std::runtime_error("pipeline_service: request before init.");
+    }
+    pipeline_ticket ticket;
+    ticket.p_fallback = fallback.p_job;
+    uint64_t hash = desc.hash();
+
+    std::lock_guard<std::mutex> lock(m_jobs_mu);
+    m_requests++;
+    std::vector<std::shared_ptr<pipeline_job>>& bucket = m_jobs[hash];
+    for(const auto& job : bucket) {
+        if(job->desc == desc) {
+            m_hits++;
+            ticket.p_job = job;
+            return ticket;
+        }
+    }
+
+    std::shared_ptr<pipeline_job> job = std::make_shared<pipeline_job>();
+    job->desc = desc;
+    job->hash = hash;
+    job->render_pass = rp;
+    bucket.push_back(job);
+    ticket.p_job = job;
+    //submitting under the lock, so whoever finds the job in the map also finds its future
+    pipeline_job *p = job.get();
+    if(m_workers) {
+        job->done = m_workers->submit([this, p]() { compile(p); }).share();
+    }
+    else {
+        std::packaged_task<void()> task([this, p]() { compile(p); });
+        job->done = task.get_future().share();
+        task();
+    }
+    return ticket;
+}
+
+void pipeline_service::compile(pipeline_job *job)
+{
+    CWG_PROFILE_SCOPE("pipeline_service::compile");
+    auto start = std::chrono::steady_clock::now();
+    std::array<vk::Pipeline, pipeline_part_count> parts;
+    bool fast_link = false;
+    try {
+        vk::Pipeline p;
+        if(m_libraries) {
+            for(uint32_t i = 0; i < pipeline_part_count; i++) {
+                parts[i] = library(job->desc, static_cast<pipeline_part>(i), job->render_pass);
+            }
+            fast_link = m_async;                                                //without workers nothing can hide the optimised link
+            p = link_pipeline_libraries(m_device, parts, job->desc.layout, !fast_link, m_cache);
+            if(fast_link) {
+                job->fast_linked = p;
+            }
+            job->linked = true;
+        }
+        else {
+            vk::ShaderModule vs = shader(job->desc.vertex_shader);
+            vk::ShaderModule fs = shader(job->desc.fragment_shader);
+            p = create_graphics_pipeline(m_device, job->desc, job->render_pass, vs, fs, m_cache);    //the cache is internally synchronised
+        }
+        job->handle.store(static_cast<VkPipeline>(p), std::memory_order_relaxed);
+        job->state.store(pipeline_job::ready, std::memory_order_release);
+        m_compiled++;
+    }
+    catch(const std::exception& e) {
+        CWG_LOG_ERROR(log) << "failed to compile pipeline " << job->hash << ": " << e.what();
+        job->state.store(pipeline_job::failed, std::memory_order_release);
+        m_failed++;
+        return;
+    }
+    uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    m_compile_us += us;
+    CWG_LOG_DEBUG(log) << (fast_link ? "fast linked pipeline " : "compiled pipeline ") << job->hash << " in " << us << "us";
+    if(fast_link) {
+        {
+            std::lock_guard<std::mutex> lock(m_optimise_mu);
+            m_optimising++;                                                     //counted before done is set, wait_idle() can't miss it
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_workers_mu);
+            if(m_workers) {
+                m_workers->submit([this, job, parts]() { optimise(job, parts); });  //only queued once the fast one is in, it can't overwrite this
+                return;
+            }
+        }
+        optimise(job, parts);                                                   //shutdown took the pool, this worker is being joined
+    }
+}
+
+void pipeline_service::optimise(pipeline_job *job, std::array<vk::Pipeline, pipeline_part_count> parts)
+{
+    CWG_PROFILE_SCOPE("pipeline_service::optimise");
+    try {
+        vk::Pipeline p = link_pipeline_libraries(m_device, parts, job->desc.layout, true, m_cache);
+        job->handle.store(static_cast<VkPipeline>(p), std::memory_order_release);    //the fast one stays alive, frames in flight may use it
+        m_optimised++;
+    }
+    catch(const std::exception& e) {
+        CWG_LOG_WARN(log) << "optimised link of pipeline " << job->hash << " failed, keeping the fast link: " << e.what();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_optimise_mu);
+        m_optimising--;
+    }
+    m_optimise_cv.notify_all();
+}
+
+vk::Pipeline pipeline_service::library(const pipeline_desc& desc, pipeline_part part, vk::RenderPass rp)
+{
+    pipeline_desc key = library_key(desc, part);
+    uint64_t hash = key.hash() ^ (static_cast<uint64_t>(part) << 56);
+    std::shared_ptr<pipeline_library> lib;
+    {
+        std::lock_guard<std::mutex> lock(m_libraries_mu);
+        std::vector<std::shared_ptr<pipeline_library>>& bucket = m_library_parts[hash];
+        for(const auto& l : bucket) {
+            if(l->part == part && l->key == key) {
+                lib = l;
+                break;
+            }
+        }
+        if(!lib) {
+            lib = std::make_shared<pipeline_library>();
+            lib->part = part;
+            lib->key = key;
+            bucket.push_back(lib);
+        }
+    }
+    //built from the key, not desc, so whoever shares it gets exactly what it was made from
+    std::call_once(lib->built, [this, &lib, &key, part, rp]() {
+        vk::ShaderModule module;
+        if(part == pipeline_part::pre_rasterisation) {
+            module = shader(key.vertex_shader);
+        }
+        else if(part == pipeline_part::fragment_shader) {
+            module = shader(key.fragment_shader);
+        }
+        lib->handle = create_pipeline_library(m_device, key, part, rp, module, m_cache);
+        m_library_builds++;
+    });
+    return lib->handle;
+}
+
+vk::ShaderModule pipeline_service::shader(const std::string& path)
+{
+    //held while loading, two workers wanting the same new module would otherwise both read it
+    std::lock_guard<std::mutex> lock(m_shaders_mu);
+    auto it = m_shaders.find(path);
+    if(it != m_shaders.end()) {
+        return it->second;
+    }
+    vk::ShaderModule module = load_shader_module(m_device, path);
+    m_shaders.emplace(path, module);
+    return module;
+}
+
+vk::Pipeline pipeline_service::wait(const pipeline_ticket& ticket)
+{
+    if(!ticket.valid()) {
+        return vk::Pipeline();
+    }
+    ticket.p_job->done.wait();
+    return ticket.ready() ? vk::Pipeline(ticket.p_job->handle.load(std::memory_order_acquire)) : vk::Pipeline();
+}
+
+void pipeline_service::wait_idle()
+{
+    std::vector<std::shared_future<void>> all;
+    {
+        std::lock_guard<std::mutex> lock(m_jobs_mu);
+        for(const auto& bucket : m_jobs) {
+            for(const auto& job : bucket.second) {
+                all.push_back(job->done);
+            }
+        }
+    }
+    for(auto& f : all) {
+        f.wait();
+    }
+    //every compile is done, so every optimised link they queue is counted
+    std::unique_lock<std::mutex> lock(m_optimise_mu);
+    m_optimise_cv.wait(lock, [this]() { return m_optimising == 0; });
+}
+
+uint32_t pipeline_service::pending()
+{
+    std::lock_guard<std::mutex> lock(m_jobs_mu);
+    uint32_t count = 0;
+    for(const auto& bucket : m_jobs) {
+        for(const auto& job : bucket.second) {
+            count += job->state.load(std::memory_order_acquire) == pipeline_job::pending ? 1 : 0;
+        }
+    }
+    return count;
+}
+
+void pipeline_service::shutdown()
+{
+    if(m_device == vk::Device()) {
+        return;
+    }
+    std::unique_ptr<thread_pool> pool;
+    {
+        std::lock_guard<std::mutex> lock(m_workers_mu);
+        pool = std::move(m_workers);
+    }
+    pool.reset();                                                               //finishes whatever is queued, outside the lock compile() takes
+    CWG_LOG_INFO(log) << "pipelines: " << m_requests << " requests, " << m_hits << " deduplicated, " << m_compiled.load() << " compiled in "
+        << m_compile_us.load() / 1000 << "ms, " << m_failed.load() << " failed";
+    if(m_libraries) {
+        CWG_LOG_INFO(log) << "pipeline libraries: " << m_library_builds.load() << " parts built, " << m_optimised.load() << " optimised links";
+    }
+    for(auto& bucket : m_jobs) {
+        for(auto& job : bucket.second) {
+            if(job->state.load() == pipeline_job::ready) {
+                vk::Pipeline p(job->handle.load());
+                m_device.destroyPipeline(p);
+                if(job->fast_linked != vk::Pipeline() && job->fast_linked != p) {
+                    m_device.destroyPipeline(job->fast_linked);
+                }
+                job->handle.store(VK_NULL_HANDLE);
+                job->fast_linked = vk::Pipeline();
+                job->state.store(pipeline_job::failed);                         //outstanding tickets fall back to null
+            }
+        }
+    }
+    m_jobs.clear();
+    for(auto& bucket : m_library_parts) {                                       //linked pipelines don't need their parts any more
+        for(auto& lib : bucket.second) {
+            if(lib->handle != vk::Pipeline()) {
+                m_device.destroyPipeline(lib->handle);
+            }
+        }
+    }
+    m_library_parts.clear();
+    for(auto& s : m_shaders) {
+        m_device.destroyShaderModule(s.second);
+    }
+    m_shaders.clear();
+    m_device = vk::Device();
+}
+
+}
+}
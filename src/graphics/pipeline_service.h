@@ -0,0 +1,122 @@
+#ifndef PIPELINE_SERVICE_H
+#define PIPELINE_SERVICE_H
+
+#include <vulkan/vulkan.hpp>
+#include "../logger.h"
+#include "pipeline.h"
+#include "misc/thread_pool.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+Usage: init() once the device and the pipeline cache exist. request() a pipeline_desc with any render pass compatible with
+its formats and keep the ticket: it is ready() once a worker has compiled it, until then get() gives the fallback's
+pipeline (or null, skip the draw). Identical descriptions share one pipeline, so asking again every frame is fine.
+wait() blocks for one ticket, wait_idle() for everything queued. shutdown() before the device and the cache go, it
+destroys every pipeline it made. Tickets stay safe to poll after shutdown, they just never become ready again.
+With libraries, a new pipeline is linked from four cached parts (see pipeline.h) and is ready after the fast link; the
+optimised link follows on a worker and replaces it in the ticket, optimised() tells which one get() returns. Without
+them every pipeline is one monolithic createGraphicsPipelines, and optimised() stays false for it, ready() is all it has.
+wait_idle() also waits for the optimised links still running.
+*/
+
+namespace cwg {
+namespace graphics {
+
+struct pipeline_job {                                                           //one per distinct pipeline_desc
+    enum : uint32_t { pending, ready, failed };
+
+    pipeline_desc desc;
+    uint64_t hash = 0;
+    vk::RenderPass render_pass;                                                 //only read by the compile
+    std::atomic<uint32_t> state { pending };
+    std::atomic<VkPipeline> handle { VK_NULL_HANDLE };                          //written before state turns ready, swapped for the optimised link
+    vk::Pipeline fast_linked;                                                   //may still be recorded somewhere, destroyed at shutdown
+    bool linked = false;                                                        //from libraries, not one monolithic create
+    std::shared_future<void> done;
+};
+
+struct pipeline_library {                                                       //one part, shared by every pipeline with the same library_key
+    pipeline_part part;
+    pipeline_desc key;
+    std::once_flag built;                                                       //a throwing build leaves it unset, the next user retries
+    vk::Pipeline handle;
+};
+
+class pipeline_ticket {
+    friend class pipeline_service;
+    std::shared_ptr<pipeline_job> p_job;
+    std::shared_ptr<pipeline_job> p_fallback;
+public:
+    inline bool valid() const { return p_job != nullptr; }
+    inline bool ready() const { return p_job && p_job->state.load(std::memory_order_acquire) == pipeline_job::ready; }
+    inline bool failed() const { return p_job && p_job->state.load(std::memory_order_acquire) == pipeline_job::failed; }
+    vk::Pipeline get() const;                                                   //the pipeline once ready, the fallback's until then
+    inline uint64_t hash() const { return p_job ? p_job->hash : 0; }
+    inline const pipeline_desc *desc() const { return p_job ? &p_job->desc : nullptr; }    //what it was requested with, to ask again for another render pass
+    inline bool has_fallback() const { return p_fallback != nullptr; }
+    inline bool optimised() const { return ready() && p_job->linked && p_job->fast_linked != vk::Pipeline(p_job->handle.load(std::memory_order_acquire)); }
+};
+
+class pipeline_service {
+    cwg::logger log;
+
+    vk::Device m_device;
+    vk::PipelineCache m_cache;
+    bool m_async = false;                                                       //init had threads, fixed until the next init
+    std::mutex m_workers_mu;                                                    //compile() submitting vs shutdown() taking the pool
+    std::unique_ptr<thread_pool> m_workers;                                     //null: compile on the requesting thread
+
+    std::mutex m_jobs_mu;
+    std::unordered_map<uint64_t, std::vector<std::shared_ptr<pipeline_job>>> m_jobs;      //by desc hash, a collision just adds one
+    uint64_t m_requests = 0;
+    uint64_t m_hits = 0;
+
+    std::mutex m_shaders_mu;
+    std::unordered_map<std::string, vk::ShaderModule> m_shaders;                //by path, shared by every pipeline
+
+    bool m_libraries = false;                                                   //VK_EXT_graphics_pipeline_library
+    std::mutex m_libraries_mu;                                                  //only for the map, parts are built outside it
+    std::unordered_map<uint64_t, std::vector<std::shared_ptr<pipeline_library>>> m_library_parts;
+
+    std::mutex m_optimise_mu;
+    std::condition_variable m_optimise_cv;
+    uint32_t m_optimising = 0;                                                  //optimised links queued or running, wait_idle() waits for 0
+
+    std::atomic<uint32_t> m_compiled { 0 };
+    std::atomic<uint32_t> m_failed { 0 };
+    std::atomic<uint64_t> m_compile_us { 0 };
+    std::atomic<uint32_t> m_library_builds { 0 };
+    std::atomic<uint32_t> m_optimised { 0 };
+
+    void compile(pipeline_job *job);
+    void optimise(pipeline_job *job, std::array<vk::Pipeline, pipeline_part_count> parts);
+    vk::Pipeline library(const pipeline_desc& desc, pipeline_part part, vk::RenderPass rp);
+    vk::ShaderModule shader(const std::string& path);
+
+public:
+    pipeline_service() : log("pipeline_service", "log/pipeline_service.log", {}) {}
+    ~pipeline_service();
+    pipeline_service(const pipeline_service& obj) = delete;
+    void operator=(const pipeline_service& obj) = delete;
+
+    void init(vk::Device dev, vk::PipelineCache cache, uint32_t threads, bool libraries = false);     //libraries: the device has graphics pipeline libraries
+    pipeline_ticket request(const pipeline_desc& desc, vk::RenderPass rp, const pipeline_ticket& fallback = pipeline_ticket());
+    vk::Pipeline wait(const pipeline_ticket& ticket);                           //null if the compile failed
+    void wait_idle();
+    uint32_t pending();
+    void shutdown();
+};
+
+}
+}
+
+#endif
@@ -5,9 +5,9 @@
 namespace cwg {
 namespace graphics {
 
-render_pass::render_pass(vk::Device dev, vk::Format colour_format, vk::Format depth_format) : m_device(dev)
+render_pass::render_pass(vk::Device dev, vk::Format colour_format, vk::Format depth_format, vk::ImageLayout final_layout) : m_device(dev)
 {
-    create(colour_format, depth_format);
+    create(colour_format, depth_format, final_layout);
 }
 
 render_pass::~render_pass()
@@ -15,7 +15,7 @@ render_pass::~render_pass()
     destroy();
 }
 
-void render_pass::create(vk::Format colour_format, vk::Format depth_format)
+void render_pass::create(vk::Format colour_format, vk::Format depth_format, vk::ImageLayout final_layout)
 {
     if(m_device == vk::Device()) { throw std::runtime_error("cannot create rendere pass if there is no device."); }
     //attachments
@@ -29,7 +29,7 @@ void render_pass::create(vk::Format colour_format, vk::Format depth_format)
 		vk::AttachmentLoadOp::eDontCare,					//stencil load op
 		vk::AttachmentStoreOp::eDontCare,					//stencil store op
 		vk::ImageLayout::eUndefined,
-		vk::ImageLayout::ePresentSrcKHR
+		final_layout										//present src for the swapchain, transfer src for offscreen readback
 	};
 	attach_desc_arr[1] = {
 		{},
@@ -90,6 +90,18 @@ void render_pass::create(vk::Format colour_format, vk::Format depth_format)
 	}
 }
 
+std::function<void()> render_pass::release()
+{
+    vk::Device dev = m_device;
+    vk::RenderPass handle = m_handle;
+    m_handle = vk::RenderPass();
+    return [dev, handle]() {
+        if(handle != vk::RenderPass()) {
+            dev.destroyRenderPass(handle);
+        }
+    };
+}
+
 void render_pass::destroy()
 {
     //note: no safety is provided if object is in use
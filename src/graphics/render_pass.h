@@ -2,6 +2,7 @@
 #define RENDER_PASS_H
 
 #include <vulkan/vulkan.hpp>
+#include <functional>
 
 namespace cwg {
 namespace graphics {
@@ -10,17 +11,18 @@ class render_pass {
     vk::RenderPass m_handle;
     vk::Device m_device;
 
-    void create(vk::Format colour_format, vk::Format depth_format);
+    void create(vk::Format colour_format, vk::Format depth_format, vk::ImageLayout final_layout);
     void destroy();
 public:
     render_pass() {}
-    render_pass(vk::Device dev, vk::Format colour_format, vk::Format depth_format);
+    render_pass(vk::Device dev, vk::Format colour_format, vk::Format depth_format, vk::ImageLayout final_layout = vk::ImageLayout::ePresentSrcKHR);      //final_layout of the colour attachment
     ~render_pass();
 
     inline vk::RenderPass get() { return m_handle; }
     inline void reset() { destroy();}
+    std::function<void()> release();                                            //empties the object, the returned function destroys what it held
     //inline void reset(vk::Format format) { destroy(); create(format);  }      //dangerous
-    inline void reset(vk::Device dev, vk::Format colour_format, vk::Format depth_format) { destroy(); m_device = dev; create(colour_format, depth_format); }
+    inline void reset(vk::Device dev, vk::Format colour_format, vk::Format depth_format, vk::ImageLayout final_layout = vk::ImageLayout::ePresentSrcKHR) { destroy(); m_device = dev; create(colour_format, depth_format, final_layout); }
 };
 
 }
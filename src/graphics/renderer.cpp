@@ -6,8 +6,10 @@
 
 #include <cmath>
 #include <algorithm>
+#include <unordered_map>
 
 #include "renderer.h"
+#include "../profiler.h"
 #include "buffers/uniform_buffer.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -26,8 +28,9 @@
 namespace cwg {
 namespace graphics {
 
-renderer::renderer() : log("renderer", "log/renderer.log", {})
+renderer::renderer(renderer_config config) : log("renderer", "log/renderer.log", {}), m_config(config)
 {
+	CWG_PROFILE_SCOPE("renderer::renderer");
 	const std::string model_path = "resources/chalet.obj";
 	const std::string tex_path = "resources/chalet.jpg";
 
@@ -35,55 +38,67 @@ renderer::renderer() : log("renderer", "log/renderer.log", {})
 	m_internal_state = renderer_states::init;
 
 	create_instance();	//first
-	m_window.create_window(640, 480, "window");
-	m_window.create_surface(m_instance);
+	if(!m_config.headless) {
+		m_window.create_window(m_config.width, m_config.height, "window");
+		m_window.create_surface(m_instance);
+	}
 	create_device();
+	m_allocator.init(m_device, m_physical_device);
+	m_pipeline_cache.init(m_device, m_physical_device, m_config.pipeline_cache_path);
+	m_pipelines.init(m_device, m_pipeline_cache.get(), m_config.pipeline_threads, m_pipeline_libraries);
 	create_swapchain();
     create_command_pool();
-	create_transfer_pool();
+	if(m_config.record_threads > 0) {
+		m_workers.reset(new thread_pool(m_config.record_threads));							//before load_mesh, a cache miss parses the obj on it
+		CWG_LOG_INFO(log) << "worker threads: " << m_config.record_threads;
+	}
+	m_uploads.init(m_device, &m_allocator, m_graphics_queue, m_graphics_queue_info.queue_family, m_transfer_queue, m_transfer_queue_info.queue_family);
 	//caution: vulkan uses inverted y axis
 	//NOTE: IMPORTANT: make sure the vertices are in the correct order
-	//NOTE: this does not take advantage of the index buffer
-	std::vector<float> vertices_data;
-	std::vector<uint32_t> indices_data;
-
-	load_model(&vertices_data, &indices_data, model_path);
-
-	auto t_size = vertices_data.size() * sizeof(float);
-	auto v_size = (3 + 3 + 2) * sizeof(float);
-
-	m_staging_buffer.reset(m_device, m_physical_device, vertices_data, t_size, v_size);
-	m_primary_vb.reset(m_device, m_physical_device, t_size, v_size);
-	m_staging_buffer.copy(m_primary_vb, m_transfer_pool, m_graphics_queue);
-	m_staging_buffer.reset();
+	load_mesh(model_path, model_path + ".mesh");
 
-	m_primary_vb.set_attribute(0, 0, 3);	//position
-	m_primary_vb.set_attribute(0, 1, 3);	//colour
-	m_primary_vb.set_attribute(0, 2, 2);	//texture coords
-
-	m_staging_buffer.reset(m_device, m_physical_device, indices_data, indices_data.size() * sizeof(uint32_t));
-	m_primary_ib.reset(m_device, m_physical_device, indices_data.size() * sizeof(uint32_t));
-	m_staging_buffer.copy(m_primary_ib, m_transfer_pool, m_graphics_queue);
-	m_staging_buffer.reset();
-
-	m_uniform_buffer.reset(m_device, m_physical_device, m_uniform_buffer_size);
+	//prerecorded command buffers bake the offset of their image's slot, per_frame ones use the frame slot
+	uint32_t ubo_slots = std::max(m_config.frames_in_flight, target_image_count());
+	m_uniform_buffer.reset(m_device, &m_allocator, m_uniform_buffer_size, ubo_slots);
 	
 	create_texture(tex_path.c_str());
 
 	create_descriptor_pool(1);
 	create_descriptor_set_layout();
 	create_descriptor_set();
-	update_uniform_buffer();
+
+	m_draw_list.push_back({ &m_primary_vb, &m_primary_ib, m_primary_ib.size() });
 
 	create_pipeline();
-	create_drawing_enviroment(m_primary_vb);
+	m_draw_list.back().pipeline = material_pipeline(m_config.scene_material);	//the default material is the primary pipeline itself
+	CWG_LOG_INFO(log) << "scene material flags: " << m_config.scene_material.flags << ", alpha cutoff: " << m_config.scene_material.used_cutoff();
+	if(m_config.min_draws_per_thread == 0) {
+		m_config.min_draws_per_thread = 1;												//the job count is divided by it
+	}
+	create_frame_data();
+	if(m_config.gpu_profiling && m_config.recording == command_recording::per_frame) {
+		m_gpu_profiler.init(m_device, m_physical_device, m_graphics_queue_info.queue_family, m_config.frames_in_flight, m_config.pipeline_statistics);
+	}
+	create_drawing_enviroment();
+	{
+		CWG_PROFILE_SCOPE("wait for startup uploads");
+		m_uploads.wait(m_uploads.flush());		//one submission for everything loaded above, the scene is drawn from the first frame on
+	}
+	m_allocator.log_stats();
 }
 
 renderer::~renderer()
 {
-	log << "last recorded fps: " << m_fps_counter.get_last();
+	for (frame_metric metric : { frame_metric::cpu_time, frame_metric::gpu_time, frame_metric::present_interval }) {
+		frame_summary s = m_frame_stats.summarise(metric);
+		CWG_LOG_INFO(log) << (metric == frame_metric::cpu_time ? "cpu frame time (ms), last " : metric == frame_metric::gpu_time ? "gpu frame time (ms), last " : "present interval (ms), last ") << s.count << " frames: "
+			<< "min " << s.min << ", avg " << s.avg << ", p50 " << s.p50 << ", p95 " << s.p95 << ", p99 " << s.p99 << ", max " << s.max << ", hitches " << s.hitches;
+	}
+	CWG_LOG_INFO(log) << "last command recording time (us): " << m_record_time.count();
+	CWG_LOG_INFO(log) << "last gpu frame time (ms): " << m_gpu_profiler.get_frame_time();
 	m_device.waitIdle();
-	m_staging_buffer.reset();
+	collect_retired(true);
+	m_uploads.shutdown();
 	destroy_texture();
 	m_uniform_buffer.reset();
 	destroy_descriptor_set();
@@ -92,12 +107,21 @@ renderer::~renderer()
 	m_primary_ib.reset();
 	m_primary_vb.reset();
     destroy_drawing_enviroment();
+	destroy_frame_data();
+	m_workers.reset();
+	m_pipelines.wait_idle();																//queued compiles still use the render pass and layout
 	clear_pipeline();
-	destroy_transfer_pool();
     destroy_command_pool();
 	clear_swapchain();
+	m_allocator.log_stats();
+	m_allocator.shutdown();
+	m_gpu_profiler.shutdown();
+	m_pipelines.shutdown();
+	m_pipeline_cache.shutdown();
 	destroy_device();
-	m_window.destroy_surface(m_instance);
+	if(!m_config.headless) {
+		m_window.destroy_surface(m_instance);
+	}
 	destroy_instance();	//do last
 }
 
@@ -105,16 +129,17 @@ renderer::~renderer()
 
 void renderer::create_instance()
 {
-	std::vector<name_and_version> instance_extensions = {
-		{ "VK_KHR_surface", ANY_NAV_VERSION }
-	};
+	std::vector<name_and_version> instance_extensions;
+	if(!m_config.headless) {										//headless needs no surface, so no display server either
+		instance_extensions.push_back({ "VK_KHR_surface", ANY_NAV_VERSION });
 #ifdef _WIN32
-	instance_extensions.push_back({ "VK_KHR_win32_surface", ANY_NAV_VERSION });
+		instance_extensions.push_back({ "VK_KHR_win32_surface", ANY_NAV_VERSION });
 #elif defined __linux
-	//TODO: detect XLIB vs XCB
-	instance_extensions.push_back({ "VK_KHR_xcb_surface", ANY_NAV_VERSION });
-	instance_extensions.push_back({ "VK_KHR_xlib_surface", ANY_NAV_VERSION });
+		//TODO: detect XLIB vs XCB
+		instance_extensions.push_back({ "VK_KHR_xcb_surface", ANY_NAV_VERSION });
+		instance_extensions.push_back({ "VK_KHR_xlib_surface", ANY_NAV_VERSION });
 #endif
+	}
 
 		std::vector<name_and_version> instance_layers;
 #ifndef NDEBUG
@@ -134,7 +159,7 @@ void renderer::create_instance()
 		m_instance = vk::createInstance(create_info);
 	}
 	catch (std::exception const &e) {
-		log << "Exception on instance creation: " << e.what() ;
+		CWG_LOG_ERROR(log) << "Exception on instance creation: " << e.what() ;
 	}
 }
 
@@ -153,18 +178,18 @@ void renderer::verify_instance_extensions(std::vector<name_and_version>& wanted,
             if (std::strcmp(a.extensionName, i.name) == 0 && i.version == ANY_NAV_VERSION ||
                 a.specVersion == i.version) {
                 out.push_back(i.name);
-                log << "Using instance extension: " << a.extensionName ;
+                CWG_LOG_DEBUG(log) << "Using instance extension: " << a.extensionName ;
                 found = 1;
                 break;
             } else if (std::strcmp(a.extensionName, i.name) == 0) {
                 out.push_back(i.name);
-                log << "Warning: instance extension version does not match" ;
+                CWG_LOG_WARN(log) << "Warning: instance extension version does not match" ;
                 found = 1;
                 break;
             }
         }
         if (!found) {
-            log << "Missing instance extension: " << i.name ;
+            CWG_LOG_WARN(log) << "Missing instance extension: " << i.name ;
             throw std::runtime_error("Instance extension missing");
         }
     }
@@ -180,19 +205,19 @@ void renderer::verify_instance_layers(std::vector<name_and_version>& wanted, std
 		for (const auto a : available) {
 			if (std::strcmp(a.layerName, i.name) == 0 && i.version == ANY_NAV_VERSION || a.implementationVersion == i.version) {
 				out.push_back(i.name);
-				log << "Using instance layer: " << a.layerName ;
+				CWG_LOG_DEBUG(log) << "Using instance layer: " << a.layerName ;
 				found = 1;
 				break;
 			}
 			else if (std::strcmp(a.layerName, i.name) == 0) {
 				out.push_back(i.name);
-				log << "Warning: instance layer version does not match" ;
+				CWG_LOG_WARN(log) << "Warning: instance layer version does not match" ;
 				found = 1;
 				break;
 			}
 		}
 		if (!found) {
-			log << "Missing instance layer: " << i.name ;
+			CWG_LOG_WARN(log) << "Missing instance layer: " << i.name ;
 			throw std::runtime_error("Instance layer missing");
 		}
 	}
@@ -208,11 +233,19 @@ void renderer::create_device()
 	for (auto& device : physical_devices) { //TODO: Make a proper evalutation system
 		if (device.getProperties().deviceType == vk::PhysicalDeviceType::eDiscreteGpu || device.getProperties().deviceType ==  vk::PhysicalDeviceType::eIntegratedGpu) {
 			m_physical_device = device;
-			log << "Physical Device: using " << device.getProperties().deviceName;
+			CWG_LOG_INFO(log) << "Physical Device: using " << device.getProperties().deviceName;
 			m_sampler_anistropy = device.getFeatures().samplerAnisotropy;
 			break;
 		}
 	}
+	if (m_physical_device == vk::PhysicalDevice() && !physical_devices.empty()) {	//e.g. a software implementation like lavapipe
+		m_physical_device = physical_devices[0];
+		CWG_LOG_WARN(log) << "Physical Device: no gpu found, using " << m_physical_device.getProperties().deviceName;
+		m_sampler_anistropy = m_physical_device.getFeatures().samplerAnisotropy;
+	}
+	if (m_physical_device == vk::PhysicalDevice()) {
+		throw std::runtime_error("No vulkan device found.");
+	}
 
 	//queue families
 	std::vector<vk::QueueFamilyProperties> device_queues = m_physical_device.getQueueFamilyProperties();
@@ -223,8 +256,8 @@ void renderer::create_device()
 
 	//TODO: eventually make better selection algorithm for queues
 	for (unsigned int i = 0; i < device_queues.size(); i++) {
-		if (device_queues[i].queueFlags & vk::QueueFlagBits::eGraphics && device_queues[i].queueCount >= 1 && m_physical_device.getSurfaceSupportKHR(i, m_window.get_surface())) {
-			log << "Physical Device: using universal queue family: " << i ;
+		if (device_queues[i].queueFlags & vk::QueueFlagBits::eGraphics && device_queues[i].queueCount >= 1 && (m_config.headless || m_physical_device.getSurfaceSupportKHR(i, m_window.get_surface()))) {
+			CWG_LOG_INFO(log) << "Physical Device: using universal queue family: " << i ;
 			gq_fam = i;
 			pq_fam = i;
 			break;
@@ -235,43 +268,129 @@ void renderer::create_device()
 		throw std::runtime_error("Failed to find suitable queue(s).");
 	}
 
+	//uploads go to a transfer only family (a dma engine) when there is one, so they run next to rendering.
+	//a compute family without graphics is the next best thing. either has to allow copies of any size
+	uint32_t tq_fam = gq_fam;
+	for (vk::QueueFlags unwanted : { vk::QueueFlags(vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute), vk::QueueFlags(vk::QueueFlagBits::eGraphics) }) {
+		for (unsigned int i = 0; i < device_queues.size() && tq_fam == gq_fam; i++) {
+			const vk::Extent3D& granularity = device_queues[i].minImageTransferGranularity;
+			if (device_queues[i].queueFlags & (vk::QueueFlagBits::eTransfer | vk::QueueFlagBits::eCompute) && !(device_queues[i].queueFlags & unwanted) && device_queues[i].queueCount >= 1
+				&& granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+				tq_fam = i;
+			}
+		}
+	}
+	if (tq_fam != gq_fam) {
+		CWG_LOG_INFO(log) << "Physical Device: using transfer queue family: " << tq_fam;
+	}
+	else {
+		CWG_LOG_INFO(log) << "Physical Device: no separate transfer queue family, uploading on the graphics queue";
+	}
+
 	const float priorites[] = { 1.0 };
-	vk::DeviceQueueCreateInfo queue_info = { {}, gq_fam, gq_count, priorites };
-	vk::DeviceQueueCreateInfo queues[] = { queue_info };
+	std::vector<vk::DeviceQueueCreateInfo> queues = { { {}, gq_fam, gq_count, priorites } };
+	if (tq_fam != gq_fam) {
+		queues.push_back({ {}, tq_fam, 1, priorites });
+	}
 	m_graphics_queue_info.queue_family = gq_fam;
 	m_graphics_queue_info.queue_indices = { 0 };
 	m_presentation_queue_info = m_graphics_queue_info;
+	m_transfer_queue_info.queue_family = tq_fam;
+	m_transfer_queue_info.queue_indices = { 0 };
 
 	//extensions
-	std::vector<name_and_version> requiredExtensions = {
-		{ "VK_KHR_swapchain", ANY_NAV_VERSION }
-	};
+	std::vector<name_and_version> requiredExtensions;
+	if (!m_config.headless) {
+		requiredExtensions.push_back({ "VK_KHR_swapchain", ANY_NAV_VERSION });
+	}
 	std::vector<const char*> checked_extensions;
     verify_device_extensions(requiredExtensions, checked_extensions);
+	//optional extensions, each feature below is required by its extension so there is nothing to query
+	void *feature_chain = nullptr;
+	auto has_extension = [this](const char *name) {
+		for (const auto& ext : m_physical_device.enumerateDeviceExtensionProperties()) {
+			if (std::strcmp(ext.extensionName, name) == 0) {
+				return true;
+			}
+		}
+		return false;
+	};
+#ifdef VK_EXT_extended_dynamic_state
+	vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_state_features;
+	if (m_config.extended_dynamic_state && has_extension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {	//without it draw_state falls back to the pipeline defaults
+		m_extended_dynamic_state = true;
+		checked_extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+		dynamic_state_features.extendedDynamicState = true;
+		dynamic_state_features.pNext = feature_chain;
+		feature_chain = &dynamic_state_features;
+	}
+#endif
+#ifdef VK_EXT_graphics_pipeline_library
+	vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features;
+	if (m_config.pipeline_libraries && has_extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && has_extension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {	//else monolithic pipelines
+		m_pipeline_libraries = true;
+		checked_extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		checked_extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		library_features.graphicsPipelineLibrary = true;
+		library_features.pNext = feature_chain;
+		feature_chain = &library_features;
+	}
+#endif
+	(void)has_extension;
+	CWG_LOG_INFO(log) << "extended dynamic state: " << (m_extended_dynamic_state ? "yes" : "no") << ", pipeline libraries: " << (m_pipeline_libraries ? "yes" : "no");
 
 	//device features
 	vk::PhysicalDeviceFeatures features = {};
-	features.samplerAnisotropy = true;
+	features.samplerAnisotropy = m_sampler_anistropy;			//only ask for what is there, software implementations may lack it
+	m_texture_compression_bc = m_physical_device.getFeatures().textureCompressionBC;
+	features.textureCompressionBC = m_texture_compression_bc;
+	if (m_config.pipeline_statistics && !m_physical_device.getFeatures().pipelineStatisticsQuery) {
+		CWG_LOG_WARN(log) << "pipeline statistics queries not supported";
+		m_config.pipeline_statistics = false;
+	}
+	//the statistics query stays active across executeCommands when the draws are recorded on the workers
+	bool secondaries = m_config.recording == command_recording::per_frame && m_config.record_threads > 0;
+	if (m_config.pipeline_statistics && secondaries && !m_physical_device.getFeatures().inheritedQueries) {
+		CWG_LOG_WARN(log) << "inherited queries not supported, no pipeline statistics with recording threads";
+		m_config.pipeline_statistics = false;
+	}
+	features.pipelineStatisticsQuery = m_config.pipeline_statistics;
+	features.inheritedQueries = m_config.pipeline_statistics && secondaries;
 	//create device
-	vk::DeviceCreateInfo dev_info = { {}, 1, queues, 0, nullptr, static_cast<uint32_t>(checked_extensions.size()), checked_extensions.data(), &features };
+	vk::DeviceCreateInfo dev_info = { {}, static_cast<uint32_t>(queues.size()), queues.data(), 0, nullptr, static_cast<uint32_t>(checked_extensions.size()), checked_extensions.data(), &features };
+	dev_info.pNext = feature_chain;
 	
 	try {
 		m_physical_device.createDevice(&dev_info, nullptr, &m_device);
-		log << "created device";
+		CWG_LOG_DEBUG(log) << "created device";
 	}
 	catch (const std::exception &e) {
-		log << "could not create extension: " << e.what()  ;
+		CWG_LOG_ERROR(log) << "could not create extension: " << e.what()  ;
 		throw std::runtime_error("could not create logical vulkan device");
 	}
 
+#ifdef VK_EXT_extended_dynamic_state
+	if (m_extended_dynamic_state) {
+		m_cmd_set_cull_mode = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(m_device.getProcAddr("vkCmdSetCullModeEXT"));
+		m_cmd_set_depth_test = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(m_device.getProcAddr("vkCmdSetDepthTestEnableEXT"));
+		m_cmd_set_depth_write = reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(m_device.getProcAddr("vkCmdSetDepthWriteEnableEXT"));
+		m_cmd_set_topology = reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(m_device.getProcAddr("vkCmdSetPrimitiveTopologyEXT"));
+		if (!m_cmd_set_cull_mode || !m_cmd_set_depth_test || !m_cmd_set_depth_write || !m_cmd_set_topology) {
+			CWG_LOG_WARN(log) << "extended dynamic state entry points missing, using pipeline defaults";
+			m_extended_dynamic_state = false;
+		}
+	}
+#endif
+
 
 	//retrieve queue handles
 	try {
 		 m_graphics_queue = m_device.getQueue(gq_fam, m_graphics_queue_info.queue_indices[0]);
-		 m_presentation_queue = m_graphics_queue;		//atm only using 1 queue
+		 m_presentation_queue = m_graphics_queue;		//atm only using 1 queue for rendering
+		 m_transfer_queue = m_device.getQueue(tq_fam, m_transfer_queue_info.queue_indices[0]);
 	}
 	catch (const std::exception &e) {
-		log << "could not retrieve vulkan queue handle(s): " << e.what()  ;
+		CWG_LOG_ERROR(log) << "could not retrieve vulkan queue handle(s): " << e.what()  ;
 		throw std::runtime_error("could not retrieve vulkan queue handle(s)");
 	}
 }
@@ -291,19 +410,19 @@ void renderer::verify_device_extensions(std::vector<name_and_version>& wanted, s
 		for (const auto a : available) {
 			if (std::strcmp(a.extensionName, i.name) == 0 && i.version == ANY_NAV_VERSION || a.specVersion == i.version) {
 				out.push_back(i.name);
-				log << "Using device extension: " << a.extensionName ;
+				CWG_LOG_DEBUG(log) << "Using device extension: " << a.extensionName ;
 				found = 1;
 				break;
 			}
 			else if (std::strcmp(a.extensionName, i.name) == 0) {
 				out.push_back(i.name);
-				log << "Warning: device extension version does not match" ;
+				CWG_LOG_WARN(log) << "Warning: device extension version does not match" ;
 				found = 1;
 				break;
 			}
 		}
 		if (!found) {
-			log << "Missing device extension: " << i.name ;
+			CWG_LOG_WARN(log) << "Missing device extension: " << i.name ;
 			throw std::runtime_error("missing device extension");
 		}
 	}
@@ -319,10 +438,10 @@ void renderer::create_command_pool()
 		m_command_pool = m_device.createCommandPool(create_info);
 	}
 	catch (const std::exception& e) {
-		log << "failed to create command pool: " << e.what() ;
+		CWG_LOG_ERROR(log) << "failed to create command pool: " << e.what() ;
 		throw std::runtime_error("failed to create command pool.");
 	}
-	log << "created command pool.\n";
+	CWG_LOG_DEBUG(log) << "created command pool.\n";
 }
 
 void renderer::destroy_command_pool()
@@ -330,38 +449,20 @@ void renderer::destroy_command_pool()
 	m_device.destroyCommandPool(m_command_pool);
 }
 
-void renderer::create_transfer_pool()
-{
-	vk::CommandPoolCreateInfo create_info = { vk::CommandPoolCreateFlagBits::eTransient , m_graphics_queue_info.queue_family };
-	try {
-		m_transfer_pool = m_device.createCommandPool(create_info);
-	}
-	catch (const std::exception& e) {
-		log << "failed to create command pool: " << e.what() ;
-		throw std::runtime_error("failed to create command pool.");
-	}
-	log << "created command pool.\n";
-}
-
-void renderer::destroy_transfer_pool()
-{
-	m_device.destroyCommandPool(m_transfer_pool);
-}
-
 void renderer::create_descriptor_pool(uint32_t max_sets)
 {
 	std::array<vk::DescriptorPoolSize, 2> sizes;
-	sizes[0] = { vk::DescriptorType::eUniformBuffer, 1 };
+	sizes[0] = { vk::DescriptorType::eUniformBufferDynamic, 1 };
 	sizes[1] = { vk::DescriptorType::eCombinedImageSampler, 1 };
 	vk::DescriptorPoolCreateInfo pool_info = { {} ,max_sets, static_cast<uint32_t>(sizes.size()), sizes.data() };
 	try {
 		m_descriptor_pool = m_device.createDescriptorPool(pool_info);
 	}
 	catch (const std::exception& e) {
-		log << "failed to create command pool: " << e.what() ;
+		CWG_LOG_ERROR(log) << "failed to create command pool: " << e.what() ;
 		throw std::runtime_error("failed to create command pool.");
 	}
-	log << "created descriptor pool.\n";
+	CWG_LOG_DEBUG(log) << "created descriptor pool.\n";
 }
 
 void renderer::destroy_descriptor_pool()
@@ -374,7 +475,7 @@ void renderer::destroy_descriptor_pool()
 void renderer::create_descriptor_set_layout()
 {
 	std::array<vk::DescriptorSetLayoutBinding, 2> bindings;
-	bindings[0] = { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex, {} };	//ubo
+	bindings[0] = { 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex, {} };	//ubo, offset picks the frame's slot
 	bindings[1] = { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment, {} };	//sampler
 
     vk::DescriptorSetLayoutCreateInfo ci = { {}, static_cast<uint32_t>(bindings.size()), bindings.data() };
@@ -407,11 +508,11 @@ void renderer::create_descriptor_set()
 	}
 
 	//configure
-	vk::DescriptorBufferInfo buf_info = { m_uniform_buffer.get(), 0, m_uniform_buffer_size };
+	vk::DescriptorBufferInfo buf_info = { m_uniform_buffer.get(), 0, m_uniform_buffer.size() };		//range of a single slot
 	vk::DescriptorImageInfo img_info = { m_tex_sampler, m_tex_view, vk::ImageLayout::eShaderReadOnlyOptimal };
 	std::array<vk::WriteDescriptorSet, 2> write_info;
 
-	write_info[0] = { m_descriptor_set, 0, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &buf_info, {} };
+	write_info[0] = { m_descriptor_set, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &buf_info, {} };
 	write_info[1] = { m_descriptor_set, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &img_info, {}, {} };
 	try {
 		m_device.updateDescriptorSets(write_info, {});
@@ -426,7 +527,7 @@ void renderer::destroy_descriptor_set()
 	//no need, will be destroyed along with pool
 }
 
-void renderer::update_uniform_buffer()
+void renderer::update_uniform_buffer(uint32_t slot)
 {
 	struct ubo {
 		glm::mat4 model;
@@ -444,14 +545,14 @@ void renderer::update_uniform_buffer()
 	//this_obj_ubo.model = glm::rotate(this_obj_ubo.model, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 	//NOTE: IMPORTANT! the up vector is defined as the z-axis
 	this_obj_ubo.view = glm::lookAt(glm::vec3(0.0f, 1.25f, 0.5f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	vk::Extent2D e = m_window.get_image_extent();
+	vk::Extent2D e = target_extent();
 	this_obj_ubo.proj = glm::perspective(glm::radians(90.0f), float(e.width) / float(e.height), 0.1f, 10.0f);
 
 	//NOTE: this is required for vulkan's inverted coordinate system
 	//it's also probably part of why my own projection matrix didn't work.
 	this_obj_ubo.proj[1][1] *= -1;
 
-	m_uniform_buffer.write(&this_obj_ubo, m_uniform_buffer_size);
+	m_uniform_buffer.write(&this_obj_ubo, m_uniform_buffer_size, slot);
 }
 
 
@@ -459,10 +560,14 @@ void renderer::update_uniform_buffer()
 
 void renderer::create_texture(std::string path)
 {
+	CWG_PROFILE_SCOPE("renderer::create_texture");
+	if(m_config.cooked_textures && create_texture_ktx2(path + ".ktx2", path)) {
+		return;
+	}
 	int32_t width, height, nchannels;
 	unsigned char *img = stbi_load(path.c_str(), &width, &height, &nchannels, STBI_rgb_alpha);
 	vk::DeviceSize size = width * height * 4;
-	log << "image size is: " << size;
+	CWG_LOG_DEBUG(log) << "image size is: " << size;
 	if(!img) {
 		throw std::runtime_error("failed to stbi_load()");
 	}
@@ -470,15 +575,61 @@ void renderer::create_texture(std::string path)
 	m_tex_mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
 
 	create_image(&m_tex, &m_tex_mem, width, height, m_tex_mip_levels, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
-	m_staging_buffer.reset(m_device, m_physical_device, img, size);
-	transition_image_layout(m_tex, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, m_tex_mip_levels);
-	m_staging_buffer.copy(m_tex, m_transfer_pool, m_graphics_queue, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-	generate_mipmaps(m_tex, width, height, m_tex_mip_levels);
-	//transition_image_layout(m_tex, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+	vk::BufferImageCopy region = { 0, 0, 0, { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, {}, { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 } };
+	m_uploads.upload(m_tex, img, size, { region }, m_tex_mip_levels, vk::ImageLayout::eTransferDstOptimal);
+	stbi_image_free(img);													//already copied into the staging ring
+	generate_mipmaps(m_uploads.commands(), m_tex, width, height, m_tex_mip_levels);		//recorded behind the copy, leaves every level shader read only
 	create_image_view(&m_tex, &m_tex_view, vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, m_tex_mip_levels);
 	create_sampler(static_cast<float>(m_tex_mip_levels));
+}
 
-	stbi_image_free(img);
+bool renderer::create_texture_ktx2(const std::string& path, const std::string& source_path)
+{
+	CWG_PROFILE_SCOPE("renderer::create_texture_ktx2");
+	ktx2 file;
+	std::string errstr;
+	if(!file.open(path, &errstr, source_path)) {
+		CWG_LOG_DEBUG(log) << "no cooked texture, decoding the source image: " << errstr;
+		return false;
+	}
+	texture_format format = static_cast<texture_format>(file.format());
+	vk::Format vk_format = static_cast<vk::Format>(file.format());
+	bool native = !is_block_compressed(format)
+		|| (m_texture_compression_bc && (m_physical_device.getFormatProperties(vk_format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage));
+
+	//every level goes up in one staging copy, a region each, so there is nothing to blit afterwards
+	std::vector<vk::BufferImageCopy> regions;
+	const uint8_t *data = file.data();
+	vk::DeviceSize size = file.data_size();
+	std::vector<uint8_t> decoded;
+	if(!native) {
+		vk_format = vk::Format::eR8G8B8A8Unorm;
+		std::vector<uint8_t> level;
+		for(uint32_t i = 0; i < file.levels(); i++) {
+			if(!decode_image(format, file.level_data(i), std::max(1u, file.width() >> i), std::max(1u, file.height() >> i), &level)) {
+				CWG_LOG_ERROR(log) << "can't decode " << path << " without textureCompressionBC";
+				return false;
+			}
+			regions.push_back({ decoded.size(), 0, 0, { vk::ImageAspectFlagBits::eColor, i, 0, 1 }, {}, { std::max(1u, file.width() >> i), std::max(1u, file.height() >> i), 1 } });
+			decoded.insert(decoded.end(), level.begin(), level.end());
+		}
+		data = decoded.data();
+		size = decoded.size();
+		CWG_LOG_WARN(log) << "no textureCompressionBC, " << format_name(format) << " decoded to rgba8";
+	}
+	else {
+		for(uint32_t i = 0; i < file.levels(); i++) {
+			regions.push_back({ file.level_offset(i), 0, 0, { vk::ImageAspectFlagBits::eColor, i, 0, 1 }, {}, { std::max(1u, file.width() >> i), std::max(1u, file.height() >> i), 1 } });
+		}
+	}
+
+	m_tex_mip_levels = file.levels();
+	create_image(&m_tex, &m_tex_mem, file.width(), file.height(), m_tex_mip_levels, vk_format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	m_uploads.upload(m_tex, data, size, regions, m_tex_mip_levels, vk::ImageLayout::eShaderReadOnlyOptimal);
+	create_image_view(&m_tex, &m_tex_view, vk_format, vk::ImageAspectFlagBits::eColor, m_tex_mip_levels);
+	create_sampler(static_cast<float>(m_tex_mip_levels));
+	CWG_LOG_DEBUG(log) << "texture " << path << ": " << (native ? format_name(format) : "rgba8") << ", " << file.width() << "x" << file.height() << ", " << m_tex_mip_levels << " levels, " << size << " bytes";
+	return true;
 }
 
 void renderer::destroy_texture()
@@ -488,7 +639,7 @@ void renderer::destroy_texture()
 	destroy_image(&m_tex, &m_tex_mem);
 }
 
-void renderer::create_image(vk::Image *img, vk::DeviceMemory *mem, int32_t width, int32_t height, uint32_t mip_level,vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlagBits mem_flags)
+void renderer::create_image(vk::Image *img, allocation *mem, int32_t width, int32_t height, uint32_t mip_level,vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlagBits mem_flags)
 {
 	
 	//create image
@@ -516,48 +667,25 @@ void renderer::create_image(vk::Image *img, vk::DeviceMemory *mem, int32_t width
 		throw std::runtime_error("failed to create vk::Image");
 	}
 
-	vk::MemoryRequirements mem_req = m_device.getImageMemoryRequirements(*img);
-	vk::PhysicalDeviceMemoryProperties p_props = m_physical_device.getMemoryProperties();
-
-	uint32_t mem_i = std::numeric_limits<uint32_t>::max();
-	
-	for(uint32_t i = 0; i < p_props.memoryTypeCount; i++) {
-		if(mem_req.memoryTypeBits & (1 << i) && p_props.memoryTypes[i].propertyFlags & (mem_flags)) {
-			mem_i = i;
-			break;
-		}
-	}
-	
-	if(mem_i == std::numeric_limits<uint32_t>::max()) {
-		throw std::runtime_error("failed to find suitable device memory.");
-	}
-
-	vk::MemoryAllocateInfo ai = { mem_req.size, mem_i };
-
 	try {
-		*mem = m_device.allocateMemory(ai);
+		*mem = m_allocator.allocate_image(*img, mem_flags, tiling);					//binds too. large images get a dedicated allocation
 	}
 	catch(const std::exception& e) {
+		CWG_LOG_ERROR(log) << "failed to allocate image memory: " << e.what();
 		throw std::runtime_error("failed to allocate memory");
 	}
 
-	m_device.bindImageMemory(*img, *mem, 0);
-
-	log << "created + allocated image";
+	CWG_LOG_DEBUG(log) << "created + allocated image";
 }
 
-void renderer::destroy_image(vk::Image *img, vk::DeviceMemory *img_mem)
+void renderer::destroy_image(vk::Image *img, allocation *img_mem)
 {
-	m_device.freeMemory(*img_mem);
+	m_allocator.free(*img_mem);
 	m_device.destroyImage(*img);
 }
 
-void renderer::transition_image_layout(vk::Image& img, vk::Format format, vk::ImageLayout old_layout, vk::ImageLayout new_layout, uint32_t mip_levels)
+void renderer::transition_image_layout(vk::CommandBuffer cmd_buffer, vk::Image& img, vk::Format format, vk::ImageLayout old_layout, vk::ImageLayout new_layout, uint32_t mip_levels)
 {
-	log << "begin transition";
-	vk::CommandBuffer cmd_buffer = create_command_buffer(vk::CommandBufferLevel::ePrimary);
-	vk::CommandBufferBeginInfo bi = { vk::CommandBufferUsageFlagBits::eOneTimeSubmit, {} };
-	cmd_buffer.begin(bi);
 	/* commands here */
 	vk::AccessFlags src_access_flags;
 	vk::AccessFlags dst_access_flags;
@@ -587,6 +715,7 @@ void renderer::transition_image_layout(vk::Image& img, vk::Format format, vk::Im
 	else {
 		throw std::runtime_error("invalid access rules for transisitoning image layout!");
 	}
+	CWG_BLOG(log, debug, "transition image {}: layout {} -> {}, {} mips", static_cast<VkImage>(img), old_layout, new_layout, mip_levels);
 
 	//determine the aspect flags
 	if(new_layout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
@@ -619,15 +748,6 @@ void renderer::transition_image_layout(vk::Image& img, vk::Format format, vk::Im
 		{ barrier }
 	);
 	/* end commands */
-	cmd_buffer.end();
-	vk::Fence end_fence = m_device.createFence({});
-	vk::SubmitInfo si = { {}, {}, {}, 1, &cmd_buffer, {}, {} };
-	m_graphics_queue.submit({ si}, end_fence);
-
-	m_device.waitForFences({ end_fence }, true, std::numeric_limits<uint64_t>::max());
-	m_device.freeCommandBuffers(m_command_pool, {cmd_buffer});
-	m_device.destroyFence(end_fence);
-	log << "end transition.";
 }
 
 void renderer::create_image_view(vk::Image *img, vk::ImageView *iv, vk::Format format, vk::ImageAspectFlagBits asp_flags, uint32_t mip_level)
@@ -681,11 +801,9 @@ void renderer::destroy_sampler()
 	m_device.destroySampler(m_tex_sampler);
 }
 
-void renderer::generate_mipmaps(vk::Image img, int32_t width, int32_t height, uint32_t mip_levels)
+void renderer::generate_mipmaps(vk::CommandBuffer cmd_buffer, vk::Image img, int32_t width, int32_t height, uint32_t mip_levels)
 {
-	vk::CommandBuffer cmd_buffer = create_command_buffer(vk::CommandBufferLevel::ePrimary);
-	vk::CommandBufferBeginInfo bi = { vk::CommandBufferUsageFlagBits::eOneTimeSubmit, {} };
-	cmd_buffer.begin(bi);
+	CWG_PROFILE_SCOPE("renderer::generate_mipmaps");									//recording only, the blits run with the upload batch
 	/* begin cmd buffer */
 	vk::ImageMemoryBarrier barrier = { {}, {}, {}, {}, {}, {}, img, { vk::ImageAspectFlagBits::eColor, {}, 1, 0, 1} };
 
@@ -728,14 +846,6 @@ void renderer::generate_mipmaps(vk::Image img, int32_t width, int32_t height, ui
 	cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier } );
 
 	/* end cmd buffer */
-	cmd_buffer.end();
-	vk::Fence end_fence = m_device.createFence({});
-	vk::SubmitInfo si = { {}, {}, {}, 1, &cmd_buffer, {}, {} };
-	m_graphics_queue.submit({ si}, end_fence);
-
-	m_device.waitForFences({ end_fence }, true, std::numeric_limits<uint64_t>::max());
-	m_device.freeCommandBuffers(m_command_pool, {cmd_buffer});
-	m_device.destroyFence(end_fence);
 }
 
 //depth buffer
@@ -747,10 +857,10 @@ void renderer::create_depth_buffer()
 		vk::ImageTiling::eOptimal,
 		vk::FormatFeatureFlagBits::eDepthStencilAttachment
 	);
-	vk::Extent2D e = m_window.get_image_extent();
+	vk::Extent2D e = target_extent();
 	create_image(&m_depth_image, &m_depth_mem, e.width, e.height, 1, m_depth_format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal);
 	create_image_view(&m_depth_image, &m_depth_view, m_depth_format, vk::ImageAspectFlagBits::eDepth, 1);
-	transition_image_layout(m_depth_image, m_depth_format, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, 1);
+	transition_image_layout(m_uploads.commands(), m_depth_image, m_depth_format, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, 1);		//submitted with the next flush, before the frame that uses it
 }
 
 void renderer::destroy_depth_buffer() {
@@ -783,41 +893,198 @@ vk::Format renderer::select_image_format(std::vector<vk::Format>&& formats, vk::
 
 //model loading
 
-void renderer::load_model(std::vector<float> *vertices, std::vector<uint32_t> *indices, const std::string path)
+namespace {
+	//what else a cooked mesh depends on: the quantisation bounds and the obj loader, the two triangulate concave faces differently
+	uint64_t mesh_cook_key(const renderer_config& config)
+	{
+		const quantise_settings& q = config.vertex_quantisation;
+		uint32_t words[7] = { 0, 0, 0, 0, q.octahedral_normals ? 1u : 0u, q.allowed, static_cast<uint32_t>(config.obj_loader) };
+		std::memcpy(&words[0], &q.position_error, sizeof(float));
+		std::memcpy(&words[1], &q.texcoord_error, sizeof(float));
+		std::memcpy(&words[2], &q.colour_error, sizeof(float));
+		std::memcpy(&words[3], &q.normal_error, sizeof(float));
+		uint64_t h = 14695981039346656037ull;							//fnv-1a over the words
+		for(uint32_t w : words) {
+			h = (h ^ w) * 1099511628211ull;
+		}
+		return h;
+	}
+}
+
+void renderer::load_mesh(const std::string& path, const std::string& cache_path)
 {
-	log << "loading model...";
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string errstr;
+	CWG_PROFILE_SCOPE("renderer::load_mesh");
+	mesh_file mesh;
+	uint32_t cook_flags = (m_config.optimise_meshes ? mesh_file::flag_optimised : 0) | (m_config.quantise_vertices ? mesh_file::flag_quantised : 0);
+	uint32_t supported = supported_vertex_formats();
+	uint64_t cook_key = mesh_cook_key(m_config);
+	bool hit = mesh.open(cache_path, path, cook_flags, cook_key);
+	for(uint32_t i = 0; hit && i < mesh.header().attribute_count; i++) {
+		if((supported & format_bit(mesh.header().attributes[i].format)) == 0) {
+			CWG_LOG_WARN(log) << "mesh cache uses " << format_name(mesh.header().attributes[i].format) << ", which this device can't fetch";	//cooked on another gpu
+			hit = false;
+		}
+	}
+	if(hit) {
+		CWG_LOG_DEBUG(log) << "mesh cache hit: " << cache_path;
+	}
+	else {
+		std::vector<float> vertices_data;
+		std::vector<uint32_t> indices_data;
+		load_model(&vertices_data, &indices_data, path);
+
+		std::vector<vertex_source> sources = { { 0, attribute_kind::position, 3 }, { 1, attribute_kind::colour, 3 }, { 2, attribute_kind::texcoord, 2 } };
+		uint32_t vertex_count = static_cast<uint32_t>(vertices_data.size() / 8);
+		if(m_config.optimise_meshes) {
+			vertex_cache_stats before = analyse_vertex_cache(indices_data, vertex_count);
+			optimise_vertex_cache(&indices_data, vertex_count);
+			optimise_overdraw(&indices_data, vertices_data.data(), 8, 0, vertex_count);
+			vertex_count = optimise_vertex_fetch(&vertices_data, 8, &indices_data);
+			vertex_cache_stats after = analyse_vertex_cache(indices_data, vertex_count);
+			CWG_LOG_DEBUG(log) << "mesh optimised: acmr " << before.acmr << " -> " << after.acmr << ", atvr " << before.atvr << " -> " << after.atvr;
+		}
 
-	if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &errstr, path.c_str())) {
-		throw std::runtime_error(errstr);
+		quantise_settings settings = m_config.vertex_quantisation;
+		settings.allowed &= m_config.quantise_vertices ? supported : float_formats;
+		std::vector<quantised_attribute> quantised;
+		std::vector<uint8_t> packed = quantise_vertices(vertices_data.data(), vertex_count, sources, settings, &quantised);
+		std::vector<mesh_attribute> layout;
+		for(const quantised_attribute& a : quantised) {
+			layout.push_back({ a.location, a.format });
+			CWG_LOG_DEBUG(log) << "vertex attribute " << a.location << ": " << format_name(a.format) << ", error " << a.error;
+		}
+		vertices_data = std::vector<float>();
+
+		uint32_t index_size = index_buffer::pick_index_type(vertex_count) == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		std::vector<uint8_t> blob = mesh_file::build(path, layout, packed.data(), vertex_count, indices_data, index_size, cook_flags, cook_key);
+		if(mesh_file::save(cache_path, blob)) {
+			CWG_LOG_DEBUG(log) << "wrote mesh cache: " << cache_path;
+		}
+		else {
+			CWG_LOG_WARN(log) << "could not write mesh cache: " << cache_path;							//not fatal, the next run parses again
+		}
+		mesh.open_memory(std::move(blob));
+	}
+
+	//straight from the mapping into the staging ring
+	const mesh_header& h = mesh.header();
+	m_primary_vb.reset(m_device, &m_allocator, mesh.vertex_bytes(), h.vertex_stride);
+	m_uploads.upload(m_primary_vb, mesh.vertex_data(), mesh.vertex_bytes());
+	m_primary_vb.clear_attributes();
+	for(uint32_t i = 0; i < h.attribute_count; i++) {
+		m_primary_vb.set_attribute(0, static_cast<unsigned char>(h.attributes[i].location), h.attributes[i].format);
+	}
+
+	vk::IndexType index_type = h.index_size == sizeof(uint16_t) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+	m_primary_ib.reset(m_device, &m_allocator, mesh.index_bytes(), index_type);
+	m_uploads.upload(m_primary_ib, mesh.index_data(), mesh.index_bytes());
+	CWG_LOG_DEBUG(log) << "mesh: " << h.vertex_count << " vertices, " << h.index_count << " indices, bounds (" << h.bounds_min[0] << ", " << h.bounds_min[1] << ", " << h.bounds_min[2]
+		<< ") - (" << h.bounds_max[0] << ", " << h.bounds_max[1] << ", " << h.bounds_max[2] << ")";
+}
+
+uint32_t renderer::supported_vertex_formats()
+{
+	uint32_t mask = 0;
+	for(uint32_t f = 0; f < static_cast<uint32_t>(vertex_format::count); f++) {
+		vk::FormatProperties props = m_physical_device.getFormatProperties(vertex_buffer::to_vk_format(static_cast<vertex_format>(f)));
+		if(props.bufferFeatures & vk::FormatFeatureFlagBits::eVertexBuffer) {
+			mask |= format_bit(static_cast<vertex_format>(f));
+		}
+	}
+	return mask;
+}
+
+namespace {
+	struct vertex_key {												//what makes two obj corners the same vertex, compared bit for bit
+		float position[3];
+		float uv[2];
+		float normal[3];
+		inline bool operator==(const vertex_key& o) const { return std::memcmp(this, &o, sizeof(vertex_key)) == 0; }
+	};
+
+	struct vertex_key_hash {
+		inline size_t operator()(const vertex_key& k) const
+		{
+			uint32_t words[sizeof(vertex_key) / sizeof(uint32_t)];
+			std::memcpy(words, &k, sizeof(vertex_key));
+			uint64_t h = 14695981039346656037ull;						//fnv-1a over the words
+			for(uint32_t w : words) {
+				h = (h ^ w) * 1099511628211ull;
+			}
+			return static_cast<size_t>(h ^ (h >> 32));
+		}
+	};
+}
+
+void renderer::load_model(std::vector<float> *vertices, std::vector<uint32_t> *indices, const std::string path)
+{
+	CWG_PROFILE_SCOPE("renderer::load_model");
+	CWG_LOG_DEBUG(log) << "loading model...";
+	obj_mesh obj;
+	if(m_config.obj_loader == obj_backend::parallel) {
+		std::string errstr;
+		if(!parse_obj(path, &obj, m_workers.get(), &errstr)) {					//without workers it parses inline
+			throw std::runtime_error(errstr);
+		}
 	}
 	else {
-		log << "importing vertices...";
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string errstr;
+
+		if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &errstr, path.c_str())) {
+			throw std::runtime_error(errstr);
+		}
+		obj.positions = std::move(attrib.vertices);
+		obj.texcoords = std::move(attrib.texcoords);
+		obj.normals = std::move(attrib.normals);
+		for(const auto& s : shapes) {
+			for(const auto& i : s.mesh.indices) {
+				obj.corners.push_back({ i.vertex_index, i.texcoord_index, i.normal_index });
+			}
+		}
 	}
+	CWG_LOG_DEBUG(log) << "importing vertices...";
+
+	//weld corners that share position, uv and normal, so the index buffer actually indexes something
+	size_t corner_count = obj.corners.size();
+	std::unordered_map<vertex_key, uint32_t, vertex_key_hash> unique;
+	unique.reserve(corner_count);
+	indices->reserve(indices->size() + corner_count);
+	uint32_t first_vertex = static_cast<uint32_t>(vertices->size() / 8);
+
+	for(const obj_corner& i : obj.corners) {
+		vertex_key key = {};
+		key.position[0] = obj.positions[3 * i.position + 0];
+		key.position[1] = obj.positions[3 * i.position + 1];
+		key.position[2] = obj.positions[3 * i.position + 2];
+		if(i.texcoord >= 0) {
+			key.uv[0] = obj.texcoords[2 * i.texcoord + 0];
+			key.uv[1] = 1.0f - obj.texcoords[2 * i.texcoord + 1];		//dont't forget to invert the y-axis
+		}
+		if(i.normal >= 0) {
+			key.normal[0] = obj.normals[3 * i.normal + 0];
+			key.normal[1] = obj.normals[3 * i.normal + 1];
+			key.normal[2] = obj.normals[3 * i.normal + 2];
+		}
 
-	uint32_t i_count = 0;
-	for(const auto& s : shapes) {
-		for(const auto& i : s.mesh.indices){
-			
-			vertices->push_back(attrib.vertices[3 * i.vertex_index + 0]);		//x
-			vertices->push_back(attrib.vertices[3 * i.vertex_index + 1]);		//y
-			vertices->push_back(attrib.vertices[3 * i.vertex_index + 2]);		//z
+		auto found = unique.emplace(key, first_vertex + static_cast<uint32_t>(unique.size()));
+		if(found.second) {
+			vertices->push_back(key.position[0]);		//x
+			vertices->push_back(key.position[1]);		//y
+			vertices->push_back(key.position[2]);		//z
 
 			vertices->push_back(1.0f);				//colours
 			vertices->push_back(1.0f);
 			vertices->push_back(1.0f);
 
-			vertices->push_back(attrib.texcoords[2 * i.texcoord_index + 0]);		//tex x
-			vertices->push_back(1.0 - attrib.texcoords[2 * i.texcoord_index + 1]);		//tex y. dont't forget to invert the y-axis
-
-			indices->push_back(i_count);
-			i_count++;
+			vertices->push_back(key.uv[0]);			//tex x
+			vertices->push_back(key.uv[1]);			//tex y
 		}
+		indices->push_back(found.first->second);
 	}
-	log << "model loaded";
+	CWG_LOG_DEBUG(log) << "model loaded: " << corner_count << " corners welded into " << unique.size() << " vertices";
 }
 
 //Command buffers
@@ -830,7 +1097,7 @@ vk::CommandBuffer renderer::create_command_buffer(vk::CommandBufferLevel level)
 		m_device.allocateCommandBuffers(&info, &out);
 	}
 	catch (const std::exception& e) {
-		log << "failed to allocate command buffer:" << e.what() ;
+		CWG_LOG_ERROR(log) << "failed to allocate command buffer:" << e.what() ;
 		throw std::runtime_error("failed to allocate command buffer.");
 	}
 	return out;
@@ -841,129 +1108,425 @@ void renderer::destroy_command_buffer(vk::CommandBuffer buffer)
 	m_device.freeCommandBuffers(m_command_pool, buffer);
 }
 
-void renderer::record_command_buffer(vk::CommandBuffer cmd_buffer, vk::Framebuffer framebuffer, vk::Pipeline pipeline, graphics::vertex_buffer& vb)
+void renderer::record_command_buffer(vk::CommandBuffer cmd_buffer, vk::Framebuffer framebuffer, vk::Pipeline pipeline, const std::vector<draw_command>& draws, uint32_t ubo_slot, vk::CommandBufferUsageFlags usage, frame_data *frame)
 {
-	vk::CommandBufferBeginInfo buf_info = { vk::CommandBufferUsageFlagBits::eSimultaneousUse, {} };
+	uint32_t ubo_offset = m_uniform_buffer.offset(ubo_slot);
+	vk::CommandBufferBeginInfo buf_info = { usage, {} };										//m_images_in_flight keeps a buffer from being resubmitted while pending
 	try {
 		cmd_buffer.begin(buf_info);
 	}
 	catch (const std::exception& e) {
-		log << "failed to begin command buffer: " << e.what() ;
+		CWG_LOG_ERROR(log) << "failed to begin command buffer: " << e.what() ;
+	}
+
+	//large draw lists are split over the worker threads, which record secondary command buffers
+	bool use_secondary = frame != nullptr && m_workers && draws.size() >= 2 * m_config.min_draws_per_thread;
+
+	uint32_t pass_region = gpu_profiler::no_region;
+	if(frame != nullptr) {
+		m_gpu_profiler.begin_frame(cmd_buffer, static_cast<uint32_t>(frame - m_frames.data()));
+		pass_region = m_gpu_profiler.begin_region(cmd_buffer, "render pass", true);
 	}
 
-	vk::Rect2D area = { {0, 0}, m_window.get_image_extent() };
+	vk::Rect2D area = { {0, 0}, target_extent() };
 	std::array<vk::ClearValue, 2> clear =  {
 		vk::ClearColorValue(std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 1.0f }),
 		vk::ClearDepthStencilValue(1.0f, 0)
 	};
 	vk::RenderPassBeginInfo rp_info = { m_primary_render_pass.get(), framebuffer, area, static_cast<uint32_t>(clear.size()), clear.data() };
 	try {
-		cmd_buffer.beginRenderPass(rp_info, vk::SubpassContents::eInline);								//TODO: modify for secondary command buffers
+		cmd_buffer.beginRenderPass(rp_info, use_secondary ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
 	}
 	catch (std::exception& e) {
-		log << "failed to begin render pass: " << e.what() ;
+		CWG_LOG_ERROR(log) << "failed to begin render pass: " << e.what() ;
 		throw std::runtime_error("see log.");
 	}
 	
 	//draw
-	cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-	cmd_buffer.bindVertexBuffers(0, { vb.get() }, { 0 });
-	cmd_buffer.bindIndexBuffer(m_primary_ib.get(), 0, m_primary_ib.get_index_type());
-	cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_primary_layout.get(), 0, { m_descriptor_set }, {});
-	
-	
-	cmd_buffer.drawIndexed(m_primary_ib.size(), 1, 0, 0, 0);
-	//cmd_buffer.draw(vb.size(), 1, 0, 0);
+	if(use_secondary) {
+		//only executeCommands is allowed in this subpass, so no timestamps around it: the render pass region times the draws
+		uint32_t count = record_secondary_buffers(*frame, framebuffer, pipeline, draws, ubo_offset);
+		cmd_buffer.executeCommands(vk::ArrayProxy<const vk::CommandBuffer>(count, frame->secondary_buffers.data()));
+	}
+	else {
+		uint32_t region = frame != nullptr ? m_gpu_profiler.begin_region(cmd_buffer, "draws") : gpu_profiler::no_region;
+		record_draws(cmd_buffer, pipeline, draws, ubo_offset, 0, draws.size());
+		m_gpu_profiler.end_region(cmd_buffer, region);
+	}
 
 	cmd_buffer.endRenderPass();
+	m_gpu_profiler.end_region(cmd_buffer, pass_region);
 
 	try {
 		cmd_buffer.end();
 	}
 	catch (const std::exception& e) {
-		log << "Failed to record render pass:" << e.what() ;										//not fatal
+		CWG_LOG_ERROR(log) << "Failed to record render pass:" << e.what() ;										//not fatal
 	}
 }
 
-void renderer::create_drawing_enviroment(graphics::vertex_buffer& vb)
+void renderer::record_draws(vk::CommandBuffer cmd_buffer, vk::Pipeline pipeline, const std::vector<draw_command>& draws, uint32_t ubo_offset, size_t begin, size_t end)
 {
-	size_t count = m_window.m_framebuffers.size();
-	log << "framebuffer size(): " << count ;
-	m_command_buffers.resize(count);
-	for (int i = 0; i < count; i++) {																	//create command buffers
-		m_command_buffers[i] = create_command_buffer(vk::CommandBufferLevel::ePrimary);
-		record_command_buffer(m_command_buffers[i], m_window.m_framebuffers[i], m_primary_pipeline.get(), vb);			//TODO: make vertex count dynamic
-		log << "created command buffer: " << m_command_buffers[i] ;
+	//note: called from the recording workers, only read renderer state here
+	cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+	cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_primary_layout.get(), 0, { m_descriptor_set }, { ubo_offset });
+	//dynamic state isn't inherited by secondary buffers, so every buffer sets its own
+	vk::Extent2D extent = target_extent();
+	cmd_buffer.setViewport(0, { vk::Viewport(0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f) });
+	cmd_buffer.setScissor(0, { vk::Rect2D({ 0, 0 }, extent) });
+
+	vertex_buffer *bound_vb = nullptr;
+	index_buffer *bound_ib = nullptr;
+	const draw_state *bound_state = nullptr;
+	vk::Pipeline bound_pipeline = pipeline;
+	for(size_t i = begin; i < end; i++) {
+		const draw_command& d = draws[i];
+		if(d.pipeline.valid()) {														//its own pipeline, has to share the primary layout
+			vk::Pipeline p = d.pipeline.get();
+			if(p == vk::Pipeline()) {
+				continue;																//still compiling and no fallback
+			}
+			if(p != bound_pipeline) {
+				cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, p);
+				bound_pipeline = p;
+				bound_state = nullptr;													//a pipeline with that state static leaves it undefined, set it again
+			}
+		}
+		else if(bound_pipeline != pipeline) {
+			cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+			bound_pipeline = pipeline;
+			bound_state = nullptr;
+		}
+#ifdef VK_EXT_extended_dynamic_state
+		if(m_extended_dynamic_state && (bound_state == nullptr || d.state != *bound_state)) {
+			VkCommandBuffer raw = static_cast<VkCommandBuffer>(cmd_buffer);
+			m_cmd_set_cull_mode(raw, static_cast<VkCullModeFlags>(d.state.cull_mode));
+			m_cmd_set_depth_test(raw, d.state.depth_test);
+			m_cmd_set_depth_write(raw, d.state.depth_write);
+			m_cmd_set_topology(raw, static_cast<VkPrimitiveTopology>(d.state.topology));
+			bound_state = &d.state;
+		}
+#else
+		(void)bound_state;
+#endif
+		if(d.vb != bound_vb) {															//only rebind when the draw list switches buffers
+			cmd_buffer.bindVertexBuffers(0, { d.vb->get() }, { 0 });
+			bound_vb = d.vb;
+		}
+		if(d.ib != bound_ib) {
+			cmd_buffer.bindIndexBuffer(d.ib->get(), 0, d.ib->get_index_type());
+			bound_ib = d.ib;
+		}
+		cmd_buffer.drawIndexed(d.index_count, d.instance_count, d.first_index, d.vertex_offset, 0);
 	}
+}
 
-	try {
-		m_render_should_begin =	m_device.createSemaphore({});
-		m_render_has_finished = m_device.createSemaphore({});
+uint32_t renderer::record_secondary_buffers(frame_data& frame, vk::Framebuffer framebuffer, vk::Pipeline pipeline, const std::vector<draw_command>& draws, uint32_t ubo_offset)
+{
+	uint32_t jobs = static_cast<uint32_t>(std::min<size_t>(frame.secondary_buffers.size(), draws.size() / m_config.min_draws_per_thread));
+	size_t per_job = (draws.size() + jobs - 1) / jobs;
+	vk::RenderPass rp = m_primary_render_pass.get();
+
+	std::vector<std::future<void>> pending;
+	pending.reserve(jobs);
+	for(uint32_t i = 0; i < jobs; i++) {
+		size_t begin = i * per_job;
+		size_t end = std::min(draws.size(), begin + per_job);
+		//job i owns worker_pools[i] for the duration of the frame, whichever thread happens to run it
+		pending.push_back(m_workers->submit([this, &frame, &draws, i, begin, end, rp, framebuffer, pipeline, ubo_offset]() {
+			CWG_PROFILE_SCOPE("record secondary");
+			m_device.resetCommandPool(frame.worker_pools[i], {});
+			vk::CommandBuffer secondary = frame.secondary_buffers[i];
+			vk::CommandBufferInheritanceInfo inherit_info = { rp, 0, framebuffer, false, {}, m_gpu_profiler.statistics() ? gpu_profiler::statistic_flags() : vk::QueryPipelineStatisticFlags() };	//has to cover the active statistics query
+			vk::CommandBufferBeginInfo buf_info = { vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inherit_info };
+			secondary.begin(buf_info);
+			record_draws(secondary, pipeline, draws, ubo_offset, begin, end);
+			secondary.end();
+		}));
 	}
-	catch (const std::exception& e) {
-		log << "failed to create synchronisation semaphores:" << e.what() ;
+	for(auto& p : pending) {
+		p.wait();																		//every job, they write into frame's buffers
+	}
+	for(auto& p : pending) {
+		p.get();																		//rethrows anything a worker threw
 	}
+	return jobs;
+}
+
+void renderer::create_frame_data()
+{
+	if(m_config.frames_in_flight == 0) {
+		throw std::runtime_error("renderer needs at least one frame in flight.");
+	}
+	m_frames.resize(m_config.frames_in_flight);
+	for(auto& frame : m_frames) {
+		try {
+			frame.in_flight = m_device.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));	//signalled so the first wait on the slot returns
+			frame.image_available = m_device.createSemaphore({});
+			frame.render_finished = m_device.createSemaphore({});
+		}
+		catch (const std::exception& e) {
+			CWG_LOG_ERROR(log) << "failed to create frame synchronisation objects:" << e.what() ;
+			throw std::runtime_error("failed to create frame synchronisation objects.");
+		}
+
+		vk::CommandPoolCreateInfo pool_info = { vk::CommandPoolCreateFlagBits::eTransient, m_graphics_queue_info.queue_family };
+		try {
+			frame.command_pool = m_device.createCommandPool(pool_info);
+			vk::CommandBufferAllocateInfo alloc_info = { frame.command_pool, vk::CommandBufferLevel::ePrimary, 1 };
+			m_device.allocateCommandBuffers(&alloc_info, &frame.command_buffer);
+		}
+		catch (const std::exception& e) {
+			CWG_LOG_ERROR(log) << "failed to create frame command pool:" << e.what() ;
+			throw std::runtime_error("failed to create frame command pool.");
+		}
+
+		uint32_t workers = m_config.recording == command_recording::per_frame && m_workers ? m_workers->size() : 0;
+		frame.worker_pools.resize(workers);
+		frame.secondary_buffers.resize(workers);
+		for(uint32_t i = 0; i < workers; i++) {
+			try {
+				frame.worker_pools[i] = m_device.createCommandPool(pool_info);
+				vk::CommandBufferAllocateInfo alloc_info = { frame.worker_pools[i], vk::CommandBufferLevel::eSecondary, 1 };
+				m_device.allocateCommandBuffers(&alloc_info, &frame.secondary_buffers[i]);
+			}
+			catch (const std::exception& e) {
+				CWG_LOG_ERROR(log) << "failed to create worker command pool:" << e.what() ;
+				throw std::runtime_error("failed to create worker command pool.");
+			}
+		}
+	}
+	m_current_frame = 0;
+	CWG_LOG_DEBUG(log) << "frames in flight: " << m_frames.size();
+}
+
+void renderer::destroy_frame_data()
+{
+	for(auto& frame : m_frames) {
+		m_device.destroyFence(frame.in_flight);
+		m_device.destroySemaphore(frame.image_available);
+		m_device.destroySemaphore(frame.render_finished);
+		m_device.destroyCommandPool(frame.command_pool);					//frees the command buffer too
+		for(auto pool : frame.worker_pools) {
+			m_device.destroyCommandPool(pool);
+		}
+	}
+	m_frames.clear();
+}
+
+void renderer::create_drawing_enviroment()
+{
+	size_t count = target_framebuffers().size();
+	CWG_LOG_DEBUG(log) << "framebuffer size(): " << count ;
+	if(m_config.recording == command_recording::prerecorded) {
+		if(count > m_uniform_buffer.slot_count()) {
+			throw std::runtime_error("more swapchain images than uniform buffer slots.");
+		}
+		m_command_buffers.resize(count);
+		for (int i = 0; i < count; i++) {																	//create command buffers
+			m_command_buffers[i] = create_command_buffer(vk::CommandBufferLevel::ePrimary);
+			record_command_buffer(m_command_buffers[i], target_framebuffers()[i], m_primary_pipeline.get(), m_draw_list, i, {});
+			CWG_LOG_DEBUG(log) << "created command buffer: " << m_command_buffers[i] ;
+		}
+	}
+	m_images_in_flight.assign(count, vk::Fence());
 }
 
 void renderer::destroy_drawing_enviroment()
 {
     m_device.waitIdle();            //safeguard
-	m_device.destroySemaphore(m_render_should_begin);
-	m_device.destroySemaphore(m_render_has_finished);
-
 	for (auto item: m_command_buffers) {
 		destroy_command_buffer(item);
 	}
+	m_command_buffers.clear();
+	m_images_in_flight.clear();
 }
 
 //draw command
 
 void renderer::draw()
 {
-	//update_uniform_buffer();
+	CWG_PROFILE_SCOPE("renderer::draw");
 	//do logic here
-	m_graphics_queue.waitIdle();
-	m_fps_counter.tick(std::chrono::steady_clock::now());
-	
+	frame_data& frame = m_frames[m_current_frame];
+	//only wait for the frame that last used this slot, the other slots keep the gpu busy meanwhile
+	{
+		CWG_PROFILE_SCOPE("wait frame fence");
+		m_device.waitForFences({ frame.in_flight }, true, std::numeric_limits<uint64_t>::max());
+	}
+	auto frame_start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration waited { 0 };						//acquire + image waits, not counted as cpu time
+	collect_retired(false);
+
+	if(!m_config.headless) {
+		if(m_window.is_minimised()) {
+			return;													//nothing to render to, the slot is untouched
+		}
+		if(m_rebuild_swapchain || m_window.has_resized()) {
+			m_window.clear_resized();
+			m_rebuild_swapchain = false;
+			rebuild_swapchain();
+		}
+	}
+
     vk::Result res;
+    uint32_t img_index;
+    vk::SwapchainKHR current_swapchain;
     aquire:
-        uint32_t img_index;
-        vk::SwapchainKHR current_swapchain = m_window.get_swapchain();
-        res = m_device.acquireNextImageKHR(current_swapchain, std::numeric_limits<uint64_t>::max(), m_render_should_begin, {}, &img_index);
-
-        if(res == vk::Result::eErrorOutOfDateKHR) {
-            destroy_drawing_enviroment();
-            recreate_swapchain();
-            recreate_pipeline();    //create a new render pass with the new extent and possible new format
-            create_drawing_enviroment(m_primary_vb);
-            goto aquire;
+        if(m_config.headless) {
+            img_index = m_current_frame;								//the slot's own image, free since its fence was waited on
+        }
+        else {
+            CWG_PROFILE_SCOPE("acquire");
+            auto t1 = std::chrono::steady_clock::now();
+            current_swapchain = m_window.get_swapchain();
+            res = m_device.acquireNextImageKHR(current_swapchain, std::numeric_limits<uint64_t>::max(), frame.image_available, {}, &img_index);
+            waited += std::chrono::steady_clock::now() - t1;
+
+            if(res == vk::Result::eErrorOutOfDateKHR) {
+                rebuild_swapchain();
+                goto aquire;
+            }
+            else if(res == vk::Result::eSuboptimalKHR) {
+                m_rebuild_swapchain = true;								//still usable, rebuild before the next frame
+            }
         }
 
-    render:
-        vk::Semaphore begin_sema[] = { m_render_should_begin };
-        vk::Semaphore signal_sema[] = { m_render_has_finished };
-
-        vk::PipelineStageFlags flags[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
-        vk::SubmitInfo submit_info = { 1, begin_sema, flags, 1, &m_command_buffers[img_index], 1, signal_sema };
-        try {
-            m_graphics_queue.submit(submit_info, {});
+        //the command buffer of this image may still be executing for another slot
+        if(m_images_in_flight[img_index] != vk::Fence()) {
+            auto t1 = std::chrono::steady_clock::now();
+            m_device.waitForFences({ m_images_in_flight[img_index] }, true, std::numeric_limits<uint64_t>::max());
+            waited += std::chrono::steady_clock::now() - t1;
+        }
+        m_images_in_flight[img_index] = frame.in_flight;
+        m_last_image = img_index;
+
+    record:
+        vk::CommandBuffer cmd_buffer;
+        uint32_t ubo_slot = (m_config.recording == command_recording::per_frame) ? m_current_frame : img_index;
+        update_uniform_buffer(ubo_slot);								//nothing in flight reads this slot any more, no stall or map needed
+        if(m_config.recording == command_recording::per_frame) {
+            CWG_PROFILE_SCOPE("record");
+            auto t1 = std::chrono::steady_clock::now();
+            m_device.resetCommandPool(frame.command_pool, {});			//the slot's fence was waited on, so nothing in the pool is pending
+            record_command_buffer(frame.command_buffer, target_framebuffers()[img_index], m_primary_pipeline.get(), m_draw_list, ubo_slot, vk::CommandBufferUsageFlagBits::eOneTimeSubmit, &frame);
+            m_record_time = std::chrono::steady_clock::now() - t1;
+            cmd_buffer = frame.command_buffer;
         }
-        catch (const std::exception& e) {
-            log << "failed to submit command buffer to the graphics queue: " << e.what() ;
+        else {
+            cmd_buffer = m_command_buffers[img_index];
         }
 
-	present:
-        vk::PresentInfoKHR pres_info = { 1, signal_sema, 1, &current_swapchain, &img_index, {} };
-        try {
-            res = m_presentation_queue.presentKHR(pres_info);
+    render:
+        vk::Semaphore begin_sema[] = { frame.image_available };
+        vk::Semaphore signal_sema[] = { frame.render_finished };
+
+        {
+            CWG_PROFILE_SCOPE("submit");
+            m_uploads.flush();											//submits new uploads + hands finished ones to the graphics queue ahead of the frame
+
+            vk::PipelineStageFlags flags[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+            uint32_t sema_count = m_config.headless ? 0 : 1;			//nothing acquired, nothing to present
+            vk::SubmitInfo submit_info = { sema_count, begin_sema, flags, 1, &cmd_buffer, sema_count, signal_sema };
+            if(m_config.recording == command_recording::per_frame) {
+                m_gpu_profiler.end_frame();
+            }
+            m_device.resetFences({ frame.in_flight });					//only now, nothing between here and the submit can skip it
+            try {
+                m_graphics_queue.submit(submit_info, frame.in_flight);
+            }
+            catch (const std::exception& e) {
+                //the fence would never signal and the next wait on the slot would hang, so this is fatal
+                CWG_LOG_ERROR(log) << "failed to submit command buffer to the graphics queue: " << e.what() ;
+                throw std::runtime_error("failed to submit command buffer to the graphics queue.");
+            }
         }
-        catch (const std::exception& e) {
-            log << "failed to present: " << e.what() ;
+
+	present:
+        if(!m_config.headless) {
+            CWG_PROFILE_SCOPE("present");
+            vk::PresentInfoKHR pres_info = { 1, signal_sema, 1, &current_swapchain, &img_index, {} };
+            try {
+                res = m_presentation_queue.presentKHR(pres_info);
+                if(res == vk::Result::eSuboptimalKHR) {
+                    m_rebuild_swapchain = true;
+                }
+            }
+            catch (const vk::OutOfDateKHRError& e) {
+                m_rebuild_swapchain = true;
+            }
+            catch (const std::exception& e) {
+                CWG_LOG_ERROR(log) << "failed to present: " << e.what() ;
+            }
         }
+
+	auto frame_end = std::chrono::steady_clock::now();
+	if(m_frame_number > 0) {
+		std::chrono::duration<float, std::milli> cpu_time = frame_end - frame_start - waited;
+		std::chrono::duration<float, std::milli> interval = frame_end - m_last_present;
+		m_frame_stats.record(cpu_time.count(), static_cast<float>(m_gpu_profiler.get_frame_time()), interval.count());
+		CWG_BLOG(log, trace, "frame {}: slot {}, image {}, cpu {} ms, interval {} ms", m_frame_number, m_current_frame, img_index, cpu_time.count(), interval.count());
+	}
+	m_last_present = frame_end;
+
+	m_current_frame = (m_current_frame + 1) % static_cast<uint32_t>(m_frames.size());
+	m_frame_number++;
+}
+
+void renderer::read_back(std::vector<uint8_t> *rgba, uint32_t *width, uint32_t *height)
+{
+	CWG_PROFILE_SCOPE("renderer::read_back");
+	if(!m_config.headless) {
+		throw std::runtime_error("read_back() needs a headless renderer.");
+	}
+	if(m_frame_number == 0) {
+		throw std::runtime_error("read_back() before the first frame, no image has been rendered.");		//undefined contents, still in the initial layout
+	}
+	vk::Extent2D e = m_offscreen.get_image_extent();
+	vk::Image img = m_offscreen.get_image(m_last_image);
+
+	vk::CommandBuffer cmd_buffer = create_command_buffer(vk::CommandBufferLevel::ePrimary);
+	vk::CommandBufferBeginInfo bi = { vk::CommandBufferUsageFlagBits::eOneTimeSubmit, {} };
+	cmd_buffer.begin(bi);
+	//the render pass already left the image in transfer src, only the writes have to be made visible
+	vk::ImageMemoryBarrier barrier = {
+		vk::AccessFlagBits::eColorAttachmentWrite,
+		vk::AccessFlagBits::eTransferRead,
+		vk::ImageLayout::eTransferSrcOptimal,
+		vk::ImageLayout::eTransferSrcOptimal,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		img,
+		{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
+	};
+	cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, { barrier });
+	vk::BufferImageCopy region = { 0, 0, 0, { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, {}, { e.width, e.height, 1 } };
+	cmd_buffer.copyImageToBuffer(img, vk::ImageLayout::eTransferSrcOptimal, m_offscreen.get_readback_buffer(), { region });
+	vk::BufferMemoryBarrier host_barrier = { vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_offscreen.get_readback_buffer(), 0, VK_WHOLE_SIZE };
+	cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, {}, { host_barrier }, {});
+	cmd_buffer.end();
+
+	//queued behind the frame, so waiting for this fence waits for the frame too
+	vk::Fence end_fence = m_device.createFence({});
+	vk::SubmitInfo si = { {}, {}, {}, 1, &cmd_buffer, {}, {} };
+	m_graphics_queue.submit({ si }, end_fence);
+	m_device.waitForFences({ end_fence }, true, std::numeric_limits<uint64_t>::max());
+	m_device.destroyFence(end_fence);
+	destroy_command_buffer(cmd_buffer);
+
+	const uint8_t *src = static_cast<const uint8_t*>(m_offscreen.get_readback_data());
+	rgba->assign(src, src + m_offscreen.get_readback_size());
+	*width = e.width;
+	*height = e.height;
 }
 
 void renderer::create_swapchain()
 {
+	if(m_config.headless) {
+		//one image per frame slot, so a slot's image is free again once its fence has signalled
+		m_offscreen.create(m_device, &m_allocator, { m_config.width, m_config.height }, vk::Format::eR8G8B8A8Unorm, m_config.frames_in_flight);
+		return;
+	}
 	m_window.set_device(m_device);
 	m_window.set_physical_device(m_physical_device);
 	m_window.set_presentation_queue(m_presentation_queue);
@@ -975,42 +1538,149 @@ void renderer::create_swapchain()
 void renderer::clear_swapchain()
 {
     m_device.waitIdle();
+	if(m_config.headless) {
+		m_offscreen.destroy();
+		return;
+	}
 	m_window.destroy_swapchain();
 }
 
-void renderer::recreate_swapchain()
+void renderer::rebuild_swapchain()
 {
-	clear_swapchain();
-	create_swapchain();
+	CWG_PROFILE_SCOPE("renderer::rebuild_swapchain");
+	//nothing here waits for the device: whatever the frames in flight may still use goes on the retire queue
+	CWG_LOG_INFO(log) << "rebuilding swapchain";
+	if(!m_command_buffers.empty()) {
+		std::vector<vk::CommandBuffer> old_buffers = std::move(m_command_buffers);
+		m_command_buffers.clear();
+		retire([this, old_buffers]() { for (auto item : old_buffers) { destroy_command_buffer(item); } });
+	}
+	m_images_in_flight.clear();
+
+	vk::Format old_format = m_window.get_image_format();
+	retire(m_window.recreate_swapchain());
+
+	vk::Image old_depth = m_depth_image;
+	allocation old_depth_mem = m_depth_mem;
+	vk::ImageView old_depth_view = m_depth_view;
+	retire([this, old_depth, old_depth_mem, old_depth_view]() mutable { destroy_image_view(&old_depth_view); destroy_image(&old_depth, &old_depth_mem); });
+	create_depth_buffer();
+
+	if(m_window.get_image_format() != old_format) {										//viewport and scissor are dynamic, only a new format needs a new pipeline
+		m_pipelines.wait_idle();																		//queued compiles may still name the old render pass
+		retire(m_primary_render_pass.release());
+		m_primary_render_pass.reset(m_device, target_format(), m_depth_format, vk::ImageLayout::ePresentSrcKHR);
+		create_primary_pipeline();																		//the old one stays in m_pipelines, formats may flip back
+		m_material_pipelines.clear();																	//their render pass went too, ask again
+		refresh_draw_pipelines();
+	}
+	m_window.create_framebuffers(m_primary_render_pass.get(), m_depth_view);
+
+	create_drawing_enviroment();
+	m_uploads.wait(m_uploads.flush());		//the new depth buffer's transition has to be on the graphics queue before the next frame
+}
+
+void renderer::retire(std::function<void()> destroy)
+{
+	//frame m_frame_number - 1 is the last one that can use it. its slot fence is waited on frames_in_flight frames later
+	m_retired.push_back({ m_frame_number + m_config.frames_in_flight - 1, std::move(destroy) });
+}
+
+void renderer::collect_retired(bool all)
+{
+	while(!m_retired.empty() && (all || m_retired.front().retire_at <= m_frame_number)) {
+		m_retired.front().destroy();
+		m_retired.pop_front();
+	}
 }
 
 void renderer::create_pipeline()
 {
-    log << "creating pipeline...";
+	CWG_PROFILE_SCOPE("renderer::create_pipeline");
+    CWG_LOG_DEBUG(log) << "creating pipeline...";
 	create_depth_buffer();
-    m_primary_render_pass.reset(m_device, m_window.get_image_format(), m_depth_format);
+    m_primary_render_pass.reset(m_device, target_format(), m_depth_format, m_config.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR);
 	//m_descriptor_layouts.clear();
 	//m_descriptor_layouts.push_back(m_descriptor_set.get_layout());
     m_primary_layout.reset(m_device, &m_descriptor_layout);
-    m_primary_pipeline.reset(m_device, m_primary_render_pass.get(), m_primary_layout.get(), m_window.get_image_extent(), &m_primary_vb);
-    m_window.create_framebuffers(m_primary_render_pass.get(), m_depth_view);
+	create_primary_pipeline();
+	if(m_config.headless) {
+		m_offscreen.create_framebuffers(m_primary_render_pass.get(), m_depth_view);
+	}
+	else {
+		m_window.create_framebuffers(m_primary_render_pass.get(), m_depth_view);
+	}
+}
+
+void renderer::create_primary_pipeline()
+{
+	//nothing can be drawn without it, so this one is waited for
+	m_primary_pipeline = m_pipelines.request(primary_pipeline_desc(), m_primary_render_pass.get());
+	if(m_pipelines.wait(m_primary_pipeline) == vk::Pipeline()) {
+		throw std::runtime_error("failed to create the primary pipeline.");
+	}
+	m_pipeline_cache.save();															//new pipelines are the expensive ones, don't wait for shutdown
+}
+
+pipeline_desc renderer::primary_pipeline_desc()
+{
+	pipeline_desc desc;
+	desc.set_vertex_layout(&m_primary_vb);
+	desc.layout = m_primary_layout.get();
+	desc.colour_format = target_format();
+	desc.depth_format = m_depth_format;
+	desc.extended_dynamic_state = m_extended_dynamic_state;
+	desc.specialization = shader_permutation().specialization();			//spelled out, so material_pipeline() of the default material is this one
+	return desc;
+}
+
+pipeline_ticket renderer::request_pipeline(const pipeline_desc& desc, bool primary_fallback)
+{
+	return m_pipelines.request(desc, m_primary_render_pass.get(), primary_fallback ? m_primary_pipeline : pipeline_ticket());
+}
+
+pipeline_ticket renderer::material_pipeline(const shader_permutation& material)
+{
+	auto it = m_material_pipelines.find(material.key());
+	if(it != m_material_pipelines.end()) {
+		return it->second;
+	}
+	pipeline_desc desc = primary_pipeline_desc();
+	desc.specialization = material.specialization();
+	pipeline_ticket ticket = request_pipeline(desc);
+	m_material_pipelines[material.key()] = ticket;
+	return ticket;
+}
+
+void renderer::refresh_draw_pipelines()
+{
+	//the tickets name pipelines made for the old formats, binding them in the new render pass isn't allowed
+	for(draw_command& draw : m_draw_list) {
+		if(!draw.pipeline.valid()) {
+			continue;
+		}
+		pipeline_desc desc = *draw.pipeline.desc();
+		desc.colour_format = target_format();
+		desc.depth_format = m_depth_format;
+		draw.pipeline = request_pipeline(desc, draw.pipeline.has_fallback());
+	}
 }
 
 void renderer::clear_pipeline()
 {
     m_device.waitIdle();
-    log << "clearing pipeline...";
+    CWG_LOG_DEBUG(log) << "clearing pipeline...";
 	destroy_depth_buffer();
-    m_window.destroy_framebuffers();
+	if(m_config.headless) {
+		m_offscreen.destroy_framebuffers();
+	}
+	else {
+		m_window.destroy_framebuffers();
+	}
     m_primary_render_pass.reset();
     m_primary_layout.reset();
-	m_primary_pipeline.reset();
-}
-
-void renderer::recreate_pipeline()
-{
-    clear_pipeline();
-    create_pipeline();
+	m_primary_pipeline = pipeline_ticket();												//the pipeline itself goes with m_pipelines
+	m_material_pipelines.clear();
 }
 
 }
@@ -4,23 +4,39 @@
 #include <vulkan/vulkan.hpp>
 #include "../logger.h"
 #include "window.h"
+#include "offscreen_target.h"
 #include <memory>
 #include <chrono>
 #include <string>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <functional>
 
 
 #include "renderer.inl"
 #include "render_pass.h"
 #include "pipeline.h"
 #include "pipeline_layout.h"
+#include "pipeline_cache.h"
+#include "pipeline_service.h"
+#include "shader_permutation.h"
 #include "descriptor_set.h"
+#include "device_allocator.h"
 
 #include "buffers/vertex_buffer.h"
 #include "buffers/index_buffer.h"
-#include "buffers/staging_buffer.h"
 #include "buffers/uniform_buffer.h"
+#include "buffers/upload_manager.h"
 
-#include "misc/fps_counter.h"
+#include "misc/frame_stats.h"
+#include "misc/thread_pool.h"
+#include "misc/gpu_profiler.h"
+#include "misc/mesh_file.h"
+#include "misc/obj_parser.h"
+#include "misc/mesh_optimiser.h"
+#include "misc/block_compression.h"
+#include "misc/ktx2.h"
 
 namespace cwg {
 namespace graphics {
@@ -30,15 +46,88 @@ enum class renderer_states {
 	init
 };
 
+enum class command_recording {
+	prerecorded,															//one command buffer per framebuffer, recorded when the swapchain is built
+	per_frame																//re-recorded every frame from the current draw list
+};
+
+enum class obj_backend {
+	parallel,																//misc/obj_parser: mapped, chunked over a thread pool
+	tinyobj																	//tiny_obj_loader, ear clips concave polygons
+};
+
+struct renderer_config {
+	uint32_t frames_in_flight = 2;											//how many frames the cpu may record ahead of the gpu
+	command_recording recording = command_recording::per_frame;
+	uint32_t record_threads = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0;		//records per_frame buffers and parses the obj, 0 does both inline
+	uint32_t min_draws_per_thread = 128;									//smaller draw lists aren't worth handing to the workers
+	bool gpu_profiling = true;												//per_frame only, timestamps around the render pass, read back frames_in_flight frames later
+	bool pipeline_statistics = false;										//vertex/fragment invocation counts for the render pass, if the device can
+	bool headless = false;													//render into offscreen images, no window, surface or swapchain
+	uint32_t width = 640;
+	uint32_t height = 480;
+	obj_backend obj_loader = obj_backend::parallel;						//only used when the mesh cache misses
+	bool optimise_meshes = true;											//reorder for the post-transform cache, overdraw and fetch before cooking
+	bool quantise_vertices = true;											//smallest vertex formats within the bounds below, otherwise all floats
+	quantise_settings vertex_quantisation;									//a cooked mesh keeps its formats until the source changes
+	bool cooked_textures = true;											//load <texture>.ktx2 from tools/tex_cook instead of the image when it is there and not older than it
+	std::string pipeline_cache_path = "pipeline_cache.bin";				//kept across runs, empty keeps the cache in memory only
+	bool extended_dynamic_state = true;										//use VK_EXT_extended_dynamic_state when the device has it
+	uint32_t pipeline_threads = 1;											//background pipeline compiles, 0 compiles inside request_pipeline()
+	bool pipeline_libraries = true;											//link pipelines from cached parts when the device has VK_EXT_graphics_pipeline_library
+	shader_permutation scene_material;										//the loaded mesh is drawn with material_pipeline() of it
+};
+
+struct frame_data {															//per frame slot, indexed by m_current_frame
+	vk::Fence in_flight;													//signalled when the gpu has finished with the slot
+	vk::Semaphore image_available;
+	vk::Semaphore render_finished;
+	vk::CommandPool command_pool;											//transient, reset as a whole before the slot is recorded again
+	vk::CommandBuffer command_buffer;
+	std::vector<vk::CommandPool> worker_pools;								//one per recording job so no pool is shared between threads
+	std::vector<vk::CommandBuffer> secondary_buffers;
+};
+
+struct retired_object {													//destroyed once no frame in flight can use it any more
+	uint64_t retire_at;														//m_frame_number from which it is safe
+	std::function<void()> destroy;
+};
+
+struct draw_state {															//set per draw on the one pipeline, needs extended dynamic state
+	vk::CullModeFlags cull_mode = vk::CullModeFlagBits::eBack;
+	bool depth_test = true;
+	bool depth_write = true;
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;	//only within the triangle class the pipeline was made with
+
+	inline bool operator==(const draw_state& o) const { return cull_mode == o.cull_mode && depth_test == o.depth_test && depth_write == o.depth_write && topology == o.topology; }
+	inline bool operator!=(const draw_state& o) const { return !(*this == o); }
+};
+
+struct draw_command {														//a single indexed draw of the scene
+	vertex_buffer *vb;
+	index_buffer *ib;
+	uint32_t index_count;
+	uint32_t first_index = 0;
+	int32_t vertex_offset = 0;
+	uint32_t instance_count = 1;
+	draw_state state;														//ignored (pipeline defaults) without extended dynamic state
+	pipeline_ticket pipeline;												//from request_pipeline(), empty for the primary one. a draw whose
+																			//pipeline and fallback aren't ready is skipped; prerecorded
+																			//buffers resolve it once, when they are recorded
+};
+
 class renderer {
 private:
 	//internal
 	renderer_states m_internal_state = renderer_states::no_init;
 	//logger
 	cwg::logger log;
+	renderer_config m_config;
 	//vulkan
 	vk::Instance m_instance;
 	window m_window;
+	offscreen_target m_offscreen;											//headless only, replaces the swapchain images
+	uint32_t m_last_image = 0;												//target image of the last submitted frame
 
 	vk::Device m_device;													//vulkan device handle
 	vk::PhysicalDevice m_physical_device;	
@@ -46,39 +135,62 @@ private:
 	queue_info m_graphics_queue_info;										//struct containing queue family + queue indices
 	vk::Queue m_presentation_queue;											//same but for presentation
 	queue_info m_presentation_queue_info;									//same. it could have the same queue family as the graphics queue depending on the hardware
+	vk::Queue m_transfer_queue;												//uploads, the graphics queue when there is no transfer only family
+	queue_info m_transfer_queue_info;
+
+	device_allocator m_allocator;											//all buffer + image memory comes from here
 
 	render_pass m_primary_render_pass;
 	pipeline_layout m_primary_layout;
-	pipeline m_primary_pipeline;
+	pipeline_ticket m_primary_pipeline;										//what draws without their own pipeline use
+	pipeline_cache m_pipeline_cache;										//every pipeline is created through it
+	pipeline_service m_pipelines;
+	std::unordered_map<uint64_t, pipeline_ticket> m_material_pipelines;	//shader_permutation::key() -> its variant of the primary pipeline
 	
-	staging_buffer m_staging_buffer;
+	upload_manager m_uploads;												//batches every copy to the gpu, flushed once per frame
 	vertex_buffer m_primary_vb;									//vertex buffer being used to draw
 	index_buffer m_primary_ib;
 
 	vk::CommandPool m_command_pool;
-	vk::CommandPool m_transfer_pool;
-	std::vector<vk::CommandBuffer> m_command_buffers;						//use 1 command buffer per frame (example: 3 for triple-buffering)
+	std::vector<vk::CommandBuffer> m_command_buffers;						//prerecorded mode only: 1 command buffer per framebuffer
+	std::vector<draw_command> m_draw_list;									//the scene, recorded into the command buffers
+	std::chrono::duration<double, std::micro> m_record_time { 0 };			//cpu cost of recording the last frame
+	std::unique_ptr<thread_pool> m_workers;									//record_threads of them: secondary command buffers, obj parsing
+	gpu_profiler m_gpu_profiler;
 
 	vk::DescriptorPool m_descriptor_pool;
-	uniform_buffer m_uniform_buffer;
+	uniform_buffer m_uniform_buffer;										//one slot per frame in flight (or per image when prerecorded)
 	vk::DeviceSize m_uniform_buffer_size = 3 * 16 * sizeof(float);
 	vk::DescriptorSet m_descriptor_set;
 	vk::DescriptorSetLayout m_descriptor_layout;
 
 	vk::Image m_tex;
-	vk::DeviceMemory m_tex_mem;
+	allocation m_tex_mem;
 	vk::ImageView m_tex_view;
 	vk::Sampler m_tex_sampler;
 	bool m_sampler_anistropy;
+	bool m_texture_compression_bc = false;
+	bool m_extended_dynamic_state = false;									//draw_state is honoured, see record_draws
+	bool m_pipeline_libraries = false;
+#ifdef VK_EXT_extended_dynamic_state
+	PFN_vkCmdSetCullModeEXT m_cmd_set_cull_mode = nullptr;
+	PFN_vkCmdSetDepthTestEnableEXT m_cmd_set_depth_test = nullptr;
+	PFN_vkCmdSetDepthWriteEnableEXT m_cmd_set_depth_write = nullptr;
+	PFN_vkCmdSetPrimitiveTopologyEXT m_cmd_set_topology = nullptr;
+#endif
 	uint32_t m_tex_mip_levels;
 
 	vk::Image m_depth_image;
-	vk::DeviceMemory m_depth_mem;
+	allocation m_depth_mem;
 	vk::ImageView m_depth_view;
 	vk::Format m_depth_format;
 
-	vk::Semaphore m_render_should_begin;										//semaphores used for synchronisation in the draw() function
-	vk::Semaphore m_render_has_finished;
+	std::vector<frame_data> m_frames;										//synchronisation used in the draw() function, one per frame in flight
+	std::vector<vk::Fence> m_images_in_flight;								//fence of the frame slot last rendering to each swapchain image
+	uint32_t m_current_frame = 0;
+	uint64_t m_frame_number = 0;											//frames submitted so far
+	std::deque<retired_object> m_retired;									//oldest first
+	bool m_rebuild_swapchain = false;										//present reported suboptimal/out of date
 
 	//functions
 	void create_instance();
@@ -92,11 +204,11 @@ private:
 
 	void create_command_pool();
 	void destroy_command_pool();
-	void create_transfer_pool();
-	void destroy_transfer_pool();
 	vk::CommandBuffer create_command_buffer(vk::CommandBufferLevel level);
 	void destroy_command_buffer(vk::CommandBuffer buffer);
-	void record_command_buffer(vk::CommandBuffer cmd_buffer, vk::Framebuffer framebuffer, vk::Pipeline pipeline, graphics::vertex_buffer& vb);
+	void record_command_buffer(vk::CommandBuffer cmd_buffer, vk::Framebuffer framebuffer, vk::Pipeline pipeline, const std::vector<draw_command>& draws, uint32_t ubo_slot, vk::CommandBufferUsageFlags usage, frame_data *frame = nullptr);
+	void record_draws(vk::CommandBuffer cmd_buffer, vk::Pipeline pipeline, const std::vector<draw_command>& draws, uint32_t ubo_offset, size_t begin, size_t end);
+	uint32_t record_secondary_buffers(frame_data& frame, vk::Framebuffer framebuffer, vk::Pipeline pipeline, const std::vector<draw_command>& draws, uint32_t ubo_offset);
 
 	void create_descriptor_pool(uint32_t max_sets = 1);
 	void destroy_descriptor_pool();
@@ -104,45 +216,74 @@ private:
 	void destroy_descriptor_set_layout();
 	void create_descriptor_set();
 	void destroy_descriptor_set();
-	void update_uniform_buffer();
+	void update_uniform_buffer(uint32_t slot);
 
 	void create_texture(std::string path);
+	bool create_texture_ktx2(const std::string& path, const std::string& source_path);		//false when there is no usable cooked file, or it is older than source_path
 	void destroy_texture();
-	void create_image( vk::Image *img, vk::DeviceMemory *mem, int32_t width, int32_t height, uint32_t mip_level, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlagBits mem_flags);
-	void destroy_image(vk::Image *img, vk::DeviceMemory *img_mem);
-	void transition_image_layout(vk::Image& img, vk::Format format, vk::ImageLayout old_layout, vk::ImageLayout new_layout, uint32_t mip_levels);
+	void create_image( vk::Image *img, allocation *mem, int32_t width, int32_t height, uint32_t mip_level, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlagBits mem_flags);
+	void destroy_image(vk::Image *img, allocation *img_mem);
+	void transition_image_layout(vk::CommandBuffer cmd_buffer, vk::Image& img, vk::Format format, vk::ImageLayout old_layout, vk::ImageLayout new_layout, uint32_t mip_levels);
 	void create_image_view(vk::Image *img, vk::ImageView *iv, vk::Format format, vk::ImageAspectFlagBits asp_flags, uint32_t mip_level);
 	void destroy_image_view(vk::ImageView *iv);
 	void create_sampler(float mip_levels);
 	void destroy_sampler();
-	void generate_mipmaps(vk::Image img, int32_t width, int32_t height, uint32_t mip_levels);
+	void generate_mipmaps(vk::CommandBuffer cmd_buffer, vk::Image img, int32_t width, int32_t height, uint32_t mip_levels);
 
 	void create_depth_buffer();
 	void destroy_depth_buffer();
 	vk::Format select_image_format(std::vector<vk::Format>&& formats, vk::ImageTiling tiling, vk::FormatFeatureFlags features);
 
 	void load_model(std::vector<float> *vertices, std::vector<uint32_t> *indices, const std::string path);
+	void load_mesh(const std::string& path, const std::string& cache_path);			//through the cooked cache, cooks it on a miss
+	uint32_t supported_vertex_formats();												//format_bit() mask of what the device can fetch
 
-	void create_drawing_enviroment(graphics::vertex_buffer& vb);
+	void create_frame_data();
+	void destroy_frame_data();
+
+	void create_drawing_enviroment();
 	void destroy_drawing_enviroment();
 
 	void create_swapchain();
 	void clear_swapchain();
-	void recreate_swapchain();
+	void rebuild_swapchain();												//after a resize, without waiting for the device
 
     void create_pipeline();
+    void create_primary_pipeline();                                     //m_primary_pipeline for the current render pass, waits for it
+	void refresh_draw_pipelines();											//after a render pass change, every draw's ticket for the new one
     void clear_pipeline();
-    void recreate_pipeline();                                                    //dont know what to name yet. recreates the pipeline
 
-	fps_counter m_fps_counter;
+	void retire(std::function<void()> destroy);							//destroys once the frames submitted so far have finished
+	void collect_retired(bool all);
+
+	//whichever of the window and the offscreen target is being rendered to
+	inline vk::Extent2D target_extent() { return m_config.headless ? m_offscreen.get_image_extent() : m_window.get_image_extent(); }
+	inline vk::Format target_format() { return m_config.headless ? m_offscreen.get_image_format() : m_window.get_image_format(); }
+	inline uint32_t target_image_count() { return static_cast<uint32_t>(m_config.headless ? m_offscreen.get_image_views().size() : m_window.get_image_views().size()); }
+	inline std::vector<vk::Framebuffer>& target_framebuffers() { return m_config.headless ? m_offscreen.m_framebuffers : m_window.m_framebuffers; }
+
+	frame_stats m_frame_stats;												//read from any thread through get_frame_stats()
+	std::chrono::steady_clock::time_point m_last_present;
 public:
-	renderer();
+	renderer(renderer_config config = renderer_config());
 	~renderer();
 
 	void draw();
 
-	inline bool should_close() { return m_window.should_close(); }
-	inline void poll_events() { m_window.poll_events(); }
+	inline std::vector<draw_command>& draw_list() { return m_draw_list; }			//prerecorded mode only picks up changes when the swapchain is rebuilt
+	pipeline_desc primary_pipeline_desc();											//start from this: the primary pass's formats, layout and vertex layout
+	pipeline_ticket request_pipeline(const pipeline_desc& desc, bool primary_fallback = true);	//compiled in the background, draws use the primary pipeline meanwhile
+	pipeline_ticket material_pipeline(const shader_permutation& material);			//the primary pipeline specialised for material, through request_pipeline()
+	inline std::chrono::duration<double, std::micro> get_record_time() { return m_record_time; }
+	inline const std::vector<gpu_region>& get_gpu_results() { return m_gpu_profiler.get_results(); }
+	inline const frame_stats& get_frame_stats() { return m_frame_stats; }
+	inline double get_gpu_frame_time() { return m_gpu_profiler.get_frame_time(); }	//ms, compare with the cpu frame time to see which side is the bottleneck
+
+	void read_back(std::vector<uint8_t> *rgba, uint32_t *width, uint32_t *height);	//headless only, after at least one draw(): waits for the last frame and copies it out, rows tightly packed
+
+	inline bool is_headless() { return m_config.headless; }
+	inline bool should_close() { return m_config.headless ? false : m_window.should_close(); }
+	inline void poll_events() { if(!m_config.headless) { m_window.poll_events(); } }
 };
 
 
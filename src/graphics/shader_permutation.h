@@ -0,0 +1,62 @@
+#ifndef SHADER_PERMUTATION_H
+#define SHADER_PERMUTATION_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+Usage: describe a material with material flags, then renderer::material_pipeline() gives the pipeline for it. The flags
+become specialization constants (constant_id in resources/shader.frag, same order as shader_constant), so each variant is
+compiled without the branches it doesn't take instead of one uber shader testing them per fragment.
+renderer_config::scene_material (--material in main) is the one the loaded mesh is drawn with.
+*/
+
+namespace cwg {
+namespace graphics {
+
+enum material_flag : uint32_t {
+    material_textured = 1,
+    material_vertex_colour = 2,                                                 //modulate by the vertex colour
+    material_alpha_test = 4                                                     //discard below alpha_cutoff
+};
+
+enum class shader_constant : uint32_t {                                         //constant_id of each switch
+    textured,
+    vertex_colour,
+    alpha_test,
+    alpha_cutoff,
+    count
+};
+
+struct shader_permutation {
+    uint32_t flags = material_textured;                                         //what the shaders do without specialization
+    float alpha_cutoff = 0.5f;
+
+    //one 32 bit word per constant_id: VkBool32 for the switches, the float's bits for the cutoff
+    inline std::vector<uint32_t> specialization() const
+    {
+        std::vector<uint32_t> out(static_cast<size_t>(shader_constant::count));
+        out[static_cast<size_t>(shader_constant::textured)] = (flags & material_textured) ? 1 : 0;
+        out[static_cast<size_t>(shader_constant::vertex_colour)] = (flags & material_vertex_colour) ? 1 : 0;
+        out[static_cast<size_t>(shader_constant::alpha_test)] = (flags & material_alpha_test) ? 1 : 0;
+        float cutoff = used_cutoff();
+        std::memcpy(&out[static_cast<size_t>(shader_constant::alpha_cutoff)], &cutoff, sizeof(float));
+        return out;
+    }
+
+    inline uint64_t key() const                                                 //for registries
+    {
+        uint32_t cutoff;
+        float used = used_cutoff();
+        std::memcpy(&cutoff, &used, sizeof(float));
+        return (static_cast<uint64_t>(cutoff) << 32) | flags;
+    }
+
+    inline float used_cutoff() const { return (flags & material_alpha_test) ? alpha_cutoff : 0.5f; }     //ignored without alpha test, so it can't split variants
+};
+
+}
+}
+
+#endif
@@ -8,10 +8,6 @@ namespace cwg {
 
 window::window() : log("window", "log/window.log", {})
 {
-	if (!glfwInit()) {
-		log << "GLFW failed to initialise." ;
-		throw std::runtime_error("GLFW failed to initialise.");
-	}
 }
 
 window::~window()
@@ -34,31 +30,38 @@ std::vector<const char*> getRequiredExtensions()
 
 void window::create_window(uint32_t width, uint32_t height, const char * name)
 {
+	//initialised here rather than in the constructor, a headless renderer never gets this far and needs no display
+	if (!glfwInit()) {
+		CWG_LOG_ERROR(log) << "GLFW failed to initialise." ;
+		throw std::runtime_error("GLFW failed to initialise.");
+	}
 	if (glfwVulkanSupported()) {
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 		m_window.reset(glfwCreateWindow(width, height, name, nullptr, nullptr));
-		log << "Window created.";
+		glfwSetWindowUserPointer(m_window.get(), this);
+		glfwSetFramebufferSizeCallback(m_window.get(), framebuffer_size_callback);
+		CWG_LOG_DEBUG(log) << "Window created.";
 	}
 	make_current();
 }
 
 void window::create_surface(vk::Instance instance)
 {
-	log << "Required GLFW extensions: ";
+	CWG_LOG_DEBUG(log) << "Required GLFW extensions: ";
 	uint32_t count;
 	const char** extensions = glfwGetRequiredInstanceExtensions(&count);
 	for(uint32_t i = 0; i < count; i++) {
-		log << extensions[i];
+		CWG_LOG_DEBUG(log) << extensions[i];
 	}
 	VkSurfaceKHR temp;
 	VkResult res = glfwCreateWindowSurface(instance, m_window.get(), nullptr, &temp);
 	if (res != VK_SUCCESS) {
-		log << "Error: failed to create window surface. Result: " << res;
+		CWG_LOG_ERROR(log) << "Error: failed to create window surface. Result: " << res;
 		throw std::runtime_error("Failed to create window surface.");
 	}
 	else {
-		log << "Window: created surface" ;
+		CWG_LOG_DEBUG(log) << "Window: created surface" ;
 		m_surface = temp;
 	}
 }
@@ -74,7 +77,12 @@ vk::SurfaceKHR window::get_surface()
 }
 
 
-void window::create_swapchain()
+void window::framebuffer_size_callback(GLFWwindow *handle, int width, int height)
+{
+	static_cast<window*>(glfwGetWindowUserPointer(handle))->m_resized = true;
+}
+
+void window::create_swapchain(vk::SwapchainKHR old_swapchain)
 {
 	assert(m_device != vk::Device() || m_physical_device != vk::PhysicalDevice() || m_presentation_queue != vk::Queue() || p_presentation_queue_info != nullptr);
 	
@@ -86,7 +94,7 @@ void window::create_swapchain()
 		formats = m_physical_device.getSurfaceFormatsKHR(m_surface);
 	}
 	catch (const std::exception& e) {
-		log << "failed to retrieve surface formats: " << e.what() ;
+		CWG_LOG_ERROR(log) << "failed to retrieve surface formats: " << e.what() ;
 	}
 
 	if (formats.size() == 1 && formats[0].format == vk::Format::eUndefined) {	//if undefined set it to default
@@ -108,7 +116,7 @@ void window::create_swapchain()
 			selected_format_index = formats.size() - 1;	//select last //temp
 		}
 	}
-	log << "got number of surface formast: " << formats.size();
+	CWG_LOG_DEBUG(log) << "got number of surface formast: " << formats.size();
 
 	//present modes
 	std::vector<vk::PresentModeKHR> present_modes;
@@ -118,9 +126,9 @@ void window::create_swapchain()
 		present_modes = m_physical_device.getSurfacePresentModesKHR(m_surface);
 	}
 	catch (const std::exception& e) {
-		log << "Window: failed to retrieve present modes: " << e.what() ;
+		CWG_LOG_ERROR(log) << "Window: failed to retrieve present modes: " << e.what() ;
 	}
-	log << "got present modes.";
+	CWG_LOG_DEBUG(log) << "got present modes.";
 
 	//TODO: add support/warnings for other modes
 	for (int i = 0; i < present_modes.size(); i++) {
@@ -146,15 +154,17 @@ void window::create_swapchain()
 		surface_capabilites = m_physical_device.getSurfaceCapabilitiesKHR(m_surface);
 	}
 	catch (const std::exception& e) {
-		log << "Window: failed to retrieve present modes: " << e.what() ;
+		CWG_LOG_ERROR(log) << "Window: failed to retrieve present modes: " << e.what() ;
 	}
-	log << "retrieved surface capabilites." ;
+	CWG_LOG_DEBUG(log) << "retrieved surface capabilites." ;
 
 	//extent
 	//some window managers do this
 	if (surface_capabilites.currentExtent.width == std::numeric_limits<uint32_t>::max() || surface_capabilites.currentExtent.height == std::numeric_limits<uint32_t>::max()) {
-		extent.setWidth(std::max(surface_capabilites.minImageExtent.width, surface_capabilites.maxImageExtent.width));
-		extent.setHeight(std::max(surface_capabilites.minImageExtent.height, surface_capabilites.maxImageExtent.height));
+		int width, height;
+		glfwGetFramebufferSize(m_window.get(), &width, &height);
+		extent.setWidth(std::min(std::max(static_cast<uint32_t>(width), surface_capabilites.minImageExtent.width), surface_capabilites.maxImageExtent.width));
+		extent.setHeight(std::min(std::max(static_cast<uint32_t>(height), surface_capabilites.minImageExtent.height), surface_capabilites.maxImageExtent.height));
 	}
 	else {
 		extent = surface_capabilites.currentExtent;
@@ -186,16 +196,16 @@ void window::create_swapchain()
 		vk::CompositeAlphaFlagBitsKHR::eOpaque,
 		present_modes[selected_present_index],
 		true,
-		vk::SwapchainKHR() };
+		old_swapchain };													//lets the driver hand resources over, the old one keeps presenting what it has queued
 	try {
 		m_swapchain = m_device.createSwapchainKHR(create_info);
 	}
 	catch (const std::exception &e) {
-		log << "failed to create swapchain: " << e.what() ;
+		CWG_LOG_ERROR(log) << "failed to create swapchain: " << e.what() ;
 		throw std::runtime_error("see log");
 	}
 
-	log << "swapchain created." ;
+	CWG_LOG_INFO(log) << "swapchain created: " << extent.width << "x" << extent.height;
 	//store
 	m_image_format = formats[selected_format_index].format;
 	m_image_extent = extent;
@@ -204,7 +214,7 @@ void window::create_swapchain()
 		m_swapchain_images = m_device.getSwapchainImagesKHR(m_swapchain);
 	}
 	catch(const std::exception& e) {
-		log << "failed to retrieve swapchain images";
+		CWG_LOG_ERROR(log) << "failed to retrieve swapchain images";
 		throw std::runtime_error("see log.");
 	}
 }
@@ -218,6 +228,29 @@ void window::destroy_swapchain()
 	m_device.destroySwapchainKHR(m_swapchain, nullptr);
 }
 
+std::function<void()> window::recreate_swapchain()
+{
+	vk::SwapchainKHR old_swapchain = m_swapchain;
+	std::vector<vk::ImageView> old_views = std::move(m_swapchain_image_views);
+	std::vector<vk::Framebuffer> old_framebuffers = std::move(m_framebuffers);
+	m_swapchain_image_views.clear();
+	m_framebuffers.clear();
+
+	create_swapchain(old_swapchain);		//the old swapchain is retired by this but stays valid until destroyed
+	create_image_views();
+
+	vk::Device dev = m_device;
+	return [dev, old_swapchain, old_views, old_framebuffers]() {
+		for (auto fb : old_framebuffers) {
+			dev.destroyFramebuffer(fb);
+		}
+		for (auto iv : old_views) {
+			dev.destroyImageView(iv);
+		}
+		dev.destroySwapchainKHR(old_swapchain);
+	};
+}
+
 void window::create_image_views()
 {
 	m_swapchain_image_views.resize(m_swapchain_images.size());
@@ -230,11 +263,11 @@ void window::create_image_views()
 			m_swapchain_image_views[i] = m_device.createImageView(create_info, nullptr);
 		}
 		catch (const std::exception& e) {
-			log << "failed to create image view " << i << ":" << e.what() ;
+			CWG_LOG_ERROR(log) << "failed to create image view " << i << ":" << e.what() ;
 			throw std::runtime_error("see log.");
 		}
 	}
-	log << "create image views" ;
+	CWG_LOG_DEBUG(log) << "create image views" ;
 }
 
 	void window::create_framebuffers(vk::RenderPass render_pass, vk::ImageView depth_view)
@@ -251,7 +284,7 @@ void window::create_image_views()
 				m_framebuffers[i] = m_device.createFramebuffer(info);
 			}
 			catch (const std::exception &e) {
-				log << "failed to create framebuffer:" << e.what() ;
+				CWG_LOG_ERROR(log) << "failed to create framebuffer:" << e.what() ;
 				throw std::runtime_error("failed to create framebuffer.");
 			}
 		}
@@ -264,21 +297,11 @@ void window::create_image_views()
 		}
 	}
 
-
-    bool window::has_resized()
-    {
-        static bool init = false;
-        static int lwidth = 0;
-        static int lheight = 0;
-        if(!init) {
-            glfwGetWindowSize(m_window.get(), &lwidth, &lheight);
-        }
-        int nwidth, nheight;
-        glfwGetWindowSize(m_window.get(), &nwidth, &nheight);
-        if(nwidth != lwidth || nheight != lheight)
-            return true;
-        else
-            return false;
-    }
+	bool window::is_minimised()
+	{
+		int width, height;
+		glfwGetFramebufferSize(m_window.get(), &width, &height);
+		return width == 0 || height == 0;
+	}
 
 } //end namespace
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "../logger.h"
 #include <GLFW/glfw3.h>
 #include <memory>
+#include <functional>
 
 #include "renderer.inl"
 
@@ -37,6 +38,10 @@ private:
 	vk::Format m_image_format;
 	vk::Extent2D m_image_extent;
 
+	bool m_resized = false;													//set by the framebuffer size callback
+
+	static void framebuffer_size_callback(GLFWwindow *handle, int width, int height);
+
 public:
 	std::vector<vk::Framebuffer> m_framebuffers;							//required for blending
 
@@ -62,8 +67,11 @@ public:
 	void destroy_surface(vk::Instance instance);
 	vk::SurfaceKHR get_surface();
 	
-	void create_swapchain();
+	void create_swapchain(vk::SwapchainKHR old_swapchain = vk::SwapchainKHR());
 	void destroy_swapchain();
+	//replaces the swapchain without waiting for the device. the returned function destroys the old swapchain, its views and framebuffers,
+	//call it once the frames using them have finished
+	std::function<void()> recreate_swapchain();
 
 	void create_image_views();
 	//void destroy_image_views();
@@ -71,7 +79,9 @@ public:
 	void create_framebuffers(vk::RenderPass render_pass, vk::ImageView depth_view);
 	void destroy_framebuffers();
 
-    bool has_resized();
+	inline bool has_resized() { return m_resized; }
+	inline void clear_resized() { m_resized = false; }
+	bool is_minimised();													//zero sized framebuffer, no swapchain can be made
 };
 
 }
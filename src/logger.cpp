@@ -1,8 +1,165 @@
 #include "logger.h"
+#include "profiler.h"
 
+#include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
 
 namespace cwg {
 
+struct log_sink {
+	std::ofstream file;
+	std::string batch;																	//only touched by the writer thread
+};
+
+namespace {
+	struct log_ring {																	//single producer (the owning thread), single consumer (the writer)
+		std::unique_ptr<log_record[]> records;
+		uint64_t mask;
+		std::atomic<uint64_t> head { 0 };												//next record the producer writes, published with release
+		std::atomic<uint64_t> tail { 0 };												//next record the writer reads
+	};
+
+	//the registry is only locked when a thread logs its first async message, a new file is opened or the writer picks up new rings
+	std::mutex registry_mu;
+	std::vector<std::unique_ptr<log_ring>> rings;										//rings and sinks live until exit, loggers keep pointers to them
+	std::map<std::string, std::unique_ptr<log_sink>> sinks;
+	thread_local log_ring *local = nullptr;
+
+	std::thread writer;
+	std::atomic<bool> stopping { false };
+	std::atomic<bool> writer_done { false };											//set once the writer has written its last batch
+	std::mutex fallback_mu;																//blocked producers writing themselves once the writer is gone
+	std::atomic<uint64_t> dropped_count { 0 };
+	uint32_t capacity = 1024;
+	log_overflow overflow = log_overflow::drop;
+
+	log_ring *local_ring()
+	{
+		if(local == nullptr) {
+			std::unique_ptr<log_ring> r(new log_ring);
+			std::lock_guard<std::mutex> lock(registry_mu);
+			r->records.reset(new log_record[capacity]);
+			r->mask = capacity - 1;
+			rings.push_back(std::move(r));
+			local = rings.back().get();
+		}
+		return local;
+	}
+
+	void append(std::string& out, const char *stamp, const log_record& r)
+	{
+		out += '[';
+		out += stamp;
+		out += "][";
+		out += r.src;
+		out += "]: ";
+		out.append(r.text, r.length);
+		out += '\n';
+	}
+
+	//after stop_async(): the writer is gone, so the owning thread writes what is left in its ring itself
+	void drain_orphaned(log_ring *ring)
+	{
+		while(!writer_done.load(std::memory_order_acquire)) {
+			if(logger::is_async()) {
+				return;																	//started again, the new writer takes it
+			}
+			std::this_thread::yield();
+		}
+		std::lock_guard<std::mutex> lock(fallback_mu);
+		uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		uint64_t head = ring->head.load(std::memory_order_relaxed);
+		std::string line;
+		for(; tail != head; tail++) {
+			const log_record& r = ring->records[tail & ring->mask];
+			line.clear();
+			append(line, logger::time_string(r.time), r);
+			if(r.screen) {
+				std::cout.write(line.data(), static_cast<std::streamsize>(line.size()));
+				std::cout.flush();
+			}
+			if(r.file != nullptr) {
+				r.file->file.write(line.data(), static_cast<std::streamsize>(line.size()));
+				r.file->file.flush();
+			}
+		}
+		ring->tail.store(tail, std::memory_order_release);
+	}
+
+	void write_loop()
+	{
+		CWG_PROFILE_THREAD("log writer");
+		std::vector<log_ring*> snapshot;
+		std::vector<log_sink*> touched;
+		std::string screen;
+		uint64_t reported = 0;
+
+		while(true) {
+			bool stop = stopping.load(std::memory_order_acquire);						//anything pushed before stop_async() is visible below
+			{
+				std::lock_guard<std::mutex> lock(registry_mu);
+				snapshot.clear();
+				for(auto& r : rings) {
+					snapshot.push_back(r.get());
+				}
+			}
+
+			size_t written = 0;
+			for(log_ring *ring : snapshot) {
+				uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+				uint64_t head = ring->head.load(std::memory_order_acquire);
+				for(; tail != head; tail++) {
+					const log_record& r = ring->records[tail & ring->mask];
+					const char *stamp = logger::time_string(r.time);
+					if(r.screen) {
+						append(screen, stamp, r);
+					}
+					if(r.file != nullptr) {
+						if(r.file->batch.empty()) {
+							touched.push_back(r.file);
+						}
+						append(r.file->batch, stamp, r);
+					}
+					written++;
+				}
+				ring->tail.store(tail, std::memory_order_release);						//hand the slots back before doing any i/o
+			}
+
+			uint64_t dropped = dropped_count.load(std::memory_order_relaxed);
+			if(dropped != reported) {
+				screen += "[" + std::string(logger::time_string(std::time(nullptr))) + "][logger]: queue full, dropped " + std::to_string(dropped - reported) + " messages\n";
+				reported = dropped;
+			}
+
+			//one write and one flush per sink per batch instead of one per line
+			if(!screen.empty()) {
+				std::cout.write(screen.data(), static_cast<std::streamsize>(screen.size()));
+				std::cout.flush();
+				screen.clear();
+			}
+			for(log_sink *s : touched) {
+				s->file.write(s->batch.data(), static_cast<std::streamsize>(s->batch.size()));
+				s->file.flush();
+				s->batch.clear();
+			}
+			touched.clear();
+
+			if(stop) {
+				writer_done.store(true, std::memory_order_release);						//the sinks are free for push()'s fallback from here on
+				break;
+			}
+			if(written == 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	}
+}
+
+std::atomic<bool> logger::s_async { false };
+
 logger::logger(const std::string src, logger_flags flags) : m_src_str(src)
 {
 	m_src_str.shrink_to_fit();									//free unused memory as this cannot be changed
@@ -24,4 +181,90 @@ logger::~logger()
 
 }
 
-}
\ No newline at end of file
+const char *logger::time_string(std::time_t t)
+{
+	thread_local std::time_t cached = 0;
+	thread_local char t_str[20] = "";
+	if(t != cached) {
+		cached = t;
+#ifdef _WIN32
+		std::tm time;
+		localtime_s(&time, &t);
+#else
+		std::tm time;
+		localtime_r(&t, &time);									//std::localtime shares one buffer between threads
+#endif
+		std::strftime(t_str, sizeof(t_str), "%T", &time);
+	}
+	return t_str;
+}
+
+void logger::start_async(uint32_t ring_capacity, log_overflow policy)
+{
+	if(is_async()) {
+		return;
+	}
+	uint32_t rounded = 1;
+	while(rounded < ring_capacity) {
+		rounded <<= 1;
+	}
+	{
+		std::lock_guard<std::mutex> lock(registry_mu);
+		capacity = rounded;										//threads that already have a ring keep its size
+		overflow = policy;
+	}
+	stopping.store(false, std::memory_order_relaxed);
+	writer_done.store(false, std::memory_order_relaxed);
+	writer = std::thread(write_loop);
+	s_async.store(true, std::memory_order_release);
+}
+
+void logger::stop_async()
+{
+	if(!is_async()) {
+		return;
+	}
+	s_async.store(false, std::memory_order_release);			//new messages go the synchronous way
+	stopping.store(true, std::memory_order_release);
+	writer.join();
+}
+
+uint64_t logger::dropped()
+{
+	return dropped_count.load(std::memory_order_relaxed);
+}
+
+log_sink *logger::open_sink(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(registry_mu);
+	std::unique_ptr<log_sink>& s = sinks[path];
+	if(!s) {
+		s.reset(new log_sink);
+		s->file.open(path);
+	}
+	return s.get();
+}
+
+void logger::push(const log_record& r)
+{
+	log_ring *ring = local_ring();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	while(head - ring->tail.load(std::memory_order_acquire) > ring->mask) {
+		if(overflow == log_overflow::drop) {
+			dropped_count.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		if(!is_async()) {
+			drain_orphaned(ring);													//stop_async() ran while this waited, nobody else will make room
+			continue;
+		}
+		std::this_thread::yield();
+	}
+	ring->records[head & ring->mask] = r;
+	ring->head.store(head + 1, std::memory_order_release);
+	if(!is_async()) {
+		drain_orphaned(ring);														//published after the writer's last pass, it would never be written
+	}
+}
+
+}
@@ -3,6 +3,12 @@
 
 /*
 Usage: construct a logger object and call either ouput or use operator<< to log. see flags for options
+Async mode: keep a logger::async_scope alive in main (before anything logs, declared before the objects that log in their destructors).
+While it lives each thread formats its message into a record in its own ring and a background thread stamps, batches and writes them,
+so callers never take a lock or touch the disk. messages longer than log_record::text_size are cut, ordering is per thread only.
+Levels: CWG_LOG_DEBUG(log) << ... compiles to nothing when the level is below CWG_LOG_LEVEL (cmake -DCWG_LOG_LEVEL=0..5, by default
+debug in debug builds and info in release), arguments included. CWG_BLOG(log, level, "fmt {}", args...) writes a binary record when
+binary_log is open (see binary_log.h) and falls back to formatting the text otherwise.
 */
 
 #include <iostream>
@@ -10,6 +16,13 @@ Usage: construct a logger object and call either ouput or use operator<< to log.
 #include <fstream>
 #include <ctime>
 #include <string>
+#include <atomic>
+#include <streambuf>
+#include <ostream>
+#include <cstdint>
+#include <sstream>
+#include <cstring>
+#include "binary_log.h"
 //#include <typeinfo>                   //caution: if the header is not included, every use of the keyword typeid makes the program ill-formed.
 
 namespace cwg {
@@ -18,23 +31,152 @@ enum class line {
 	endl
 };
 
+enum class log_level {
+	trace = 0,																			//per frame / per call detail, meant for the binary log
+	debug = 1,
+	info = 2,
+	warn = 3,
+	error = 4,
+	off = 5
+};
+
+#ifndef CWG_LOG_LEVEL
+#ifdef NDEBUG
+#define CWG_LOG_LEVEL 2
+#else
+#define CWG_LOG_LEVEL 1
+#endif
+#endif
+
+//the whole statement, << operands included, is discarded at compile time below CWG_LOG_LEVEL
+#define CWG_LOG(log, level) if constexpr(static_cast<int>(::cwg::log_level::level) < CWG_LOG_LEVEL) {} else (log)
+#define CWG_LOG_TRACE(log) CWG_LOG(log, trace)
+#define CWG_LOG_DEBUG(log) CWG_LOG(log, debug)
+#define CWG_LOG_INFO(log) CWG_LOG(log, info)
+#define CWG_LOG_WARN(log) CWG_LOG(log, warn)
+#define CWG_LOG_ERROR(log) CWG_LOG(log, error)
+
+//format string literal with {} per argument, the id is assigned the first time the call site runs
+#define CWG_BLOG(log, level, ...) do { if constexpr(static_cast<int>(::cwg::log_level::level) >= CWG_LOG_LEVEL) { \
+		static ::cwg::binary_log::site cwg_blog_site; \
+		(log).binary(cwg_blog_site, ::cwg::log_level::level, __FILE__, __LINE__, __VA_ARGS__); } } while(0)
+
 enum logger_flags {
 	file_too = 0b0000'0001,
 	file_only = 0b0000'0010,
 	no_colour = 0b0000'0100
 };
 
+enum class log_overflow {
+	drop,																				//count it and carry on, the writer reports how many went missing
+	block																				//spin until the writer has made room, after stop_async() the caller writes it itself
+};
+
+struct log_sink;																		//a file owned by the async writer, shared by loggers with the same path
+
+struct log_record {
+	static constexpr uint32_t src_size = 32;
+	static constexpr uint32_t text_size = 216;
+
+	std::time_t time;
+	log_sink *file;																		//nullptr: screen only
+	bool screen;
+	uint16_t length;
+	char src[src_size];
+	char text[text_size];
+};
+
 class logger {
+public:
+	class async_scope {
+	public:
+		async_scope(uint32_t ring_capacity = 1024, log_overflow policy = log_overflow::drop) { start_async(ring_capacity, policy); }
+		~async_scope() { stop_async(); }
+		async_scope(const async_scope& obj) = delete;
+		void operator=(const async_scope& obj) = delete;
+	};
+
+	static void start_async(uint32_t ring_capacity = 1024, log_overflow policy = log_overflow::drop);	//records per thread, rounded up to a power of two
+	static void stop_async();															//writes everything queued, then back to synchronous
+	static inline bool is_async() { return s_async.load(std::memory_order_acquire); }
+	static uint64_t dropped();
+	static const char *time_string(std::time_t t);										//"%T", cached per thread and only reformatted when the second changes
+
 private:
+	class record_buf : public std::streambuf {											//formats straight into a record, never allocates
+	public:
+		inline void reset(char *begin, char *end) { setp(begin, end); }
+		inline size_t size() const { return static_cast<size_t>(pptr() - pbase()); }
+	};
+
+	static std::atomic<bool> s_async;
+
 	std::string m_src_str;
 	std::string m_file_path;
-	unsigned char m_flags;																
+	unsigned char m_flags = 0;
 	std::ofstream m_file;
 	std::once_flag m_file_once_flag;
 	std::mutex m_file_mu;
+	std::once_flag m_sink_once_flag;
+	log_sink *p_sink = nullptr;
+
+	static log_sink *open_sink(const std::string& path);
+	static void push(const log_record& r);
+
+	static inline void format_text(std::ostream& out, const char *format)
+	{
+		out << format;
+	}
+
+	template<typename T, typename... Args>
+	static void format_text(std::ostream& out, const char *format, const T& a, const Args&... rest)
+	{
+		const char *next = std::strstr(format, "{}");
+		if(next == nullptr) {
+			out << format;
+			return;
+		}
+		out.write(format, next - format);
+		if constexpr(std::is_enum<T>::value) {
+			out << static_cast<int64_t>(a);												//as the binary log stores them
+		}
+		else {
+			out << a;
+		}
+		format_text(out, next + 2, rest...);
+	}
+
+	template<typename T>
+	void log_async(T a, std::time_t t)
+	{
+		thread_local record_buf buf;
+		thread_local std::ostream stream(&buf);
+		log_record r;
+		r.time = t;
+#ifndef NDEBUG
+		r.screen = true;
+#else
+		r.screen = false;
+#endif
+		r.file = nullptr;
+		if(m_flags & logger_flags::file_too) {
+			std::call_once(m_sink_once_flag, [this]() { p_sink = open_sink(m_file_path); });
+			r.file = p_sink;
+		}
+		if(!r.screen && r.file == nullptr) {
+			return;
+		}
+		size_t src_length = m_src_str.copy(r.src, log_record::src_size - 1);
+		r.src[src_length] = '\0';
+		buf.reset(r.text, r.text + log_record::text_size);
+		stream.clear();
+		stream << a;
+		r.length = static_cast<uint16_t>(buf.size());
+		push(r);
+	}
 
 	template<typename T>
-	void log_to_screen(T a, char *time)                                                     //usage: the dev must specify a new line
+	void log_to_screen(T a, const char *time)                                                     //usage: the dev must specify a new line
 	{
 		//process
 		static std::mutex m_cout_mu; //shared across all logger instances
@@ -54,7 +196,7 @@ private:
 
 
 	template<typename T>
-	void log_to_file(T a, char *time)
+	void log_to_file(T a, const char *time)
 	{
 		//process
 		std::call_once(m_file_once_flag, [this]() { m_file.open(m_file_path); });		//lazy init
@@ -81,14 +223,11 @@ public:
 	void output(T a)
 	{
 		std::time_t t = std::time(nullptr);
-#ifdef _WIN32
-		std::tm time;
-		localtime_s(&time, &t);
-#else
-		std::tm time = *std::localtime(&t);
-#endif
-		char t_str[20];
-		std::strftime(t_str, sizeof(t_str), "%T", &time);
+		if(is_async()) {
+			log_async(a, t);
+			return;
+		}
+		const char *t_str = time_string(t);
 #ifndef NDEBUG                                                                          //dont print anything to screen in release
 		log_to_screen(a, t_str);
 #endif
@@ -97,6 +236,22 @@ public:
 		}
 	}
 
+	template<typename... Args>
+	void binary(binary_log::site& site, log_level level, const char *file, uint32_t line, const char *format, const Args&... args)
+	{
+		if(binary_log::is_open()) {
+			uint32_t id = site.id.load(std::memory_order_acquire);
+			if(id == 0) {
+				id = binary_log::register_format(site, static_cast<uint8_t>(level), m_src_str, file, line, format);
+			}
+			binary_log::write(id, args...);
+			return;
+		}
+		std::ostringstream text;
+		format_text(text, format, args...);
+		output(text.str());
+	}
+
 	template<typename T>
 	friend logger& operator<<(logger& log, T a)
 	{
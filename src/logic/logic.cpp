@@ -13,7 +13,7 @@ namespace {								//anonymous namespace
 
 void init()
 {
-	log << "logic initialising...";
+	CWG_LOG_DEBUG(log) << "logic initialising...";
 }
 
 }
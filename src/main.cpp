@@ -1,30 +1,89 @@
 //#include "vk_functions.h"		//need to build into the vulkan renderer
 #include "logger.h"
+#include "profiler.h"
 #include "graphics/renderer.h"
 #include "logic/logic.h"
 
 #include <iostream>
+#include <fstream>
 #include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
 
 /* "Make a game, not an engine." ~ someone from a game engine lecture on youtube*/
 /* my thoughts: I've never made a game, so how could I possibly know what a game engine should be .*/
 
 int main(int argc, char **argv) {
+	cwg::logger::async_scope async_logging(4096, cwg::log_overflow::drop);	//first, so it outlives the renderer's loggers
 	cwg::logger l("main", "log/main.log", {});
+	CWG_PROFILE_THREAD("main");
 
-	if(argc < 2) { l << "no args."; }
+	//--binary-log: CWG_BLOG call sites write ids + raw arguments to log/binary.blog (decode with blog_decode)
+	std::string binary_path;
+	for(int i = 1; i < argc; i++) {
+		if(std::strcmp(argv[i], "--binary-log") == 0) { binary_path = "log/binary.blog"; }
+	}
+	cwg::binary_log::scope binary_logging(binary_path);		//closed after the renderer, which logs while shutting down
+
+	if(argc < 2) { CWG_LOG_DEBUG(l) << "no args."; }
+
+	//--headless [frames]: render offscreen (no window or display needed), then dump the last frame
+	cwg::graphics::renderer_config config;
+	uint32_t frames = 1000;
+	for(int i = 1; i < argc; i++) {
+		if(std::strcmp(argv[i], "--headless") == 0) {
+			config.headless = true;
+			if(i + 1 < argc && argv[i + 1][0] != '-') { frames = static_cast<uint32_t>(std::stoul(argv[++i])); }
+			if(frames == 0) {
+				std::cerr << "--headless needs at least one frame to read back" << std::endl;
+				return 1;
+			}
+		}
+		//--material <flags> [cutoff]: draw the scene with that shader permutation (bits of material_flag, see shader_permutation.h)
+		if(std::strcmp(argv[i], "--material") == 0 && i + 1 < argc) {
+			config.scene_material.flags = static_cast<uint32_t>(std::stoul(argv[++i]));
+			if(i + 1 < argc && argv[i + 1][0] != '-') { config.scene_material.alpha_cutoff = std::stof(argv[++i]); }
+		}
+	}
 
 	auto t1 = std::chrono::steady_clock::now();
 
-	cwg::graphics::renderer render;
+	cwg::graphics::renderer render(config);
 	auto t2 = std::chrono::steady_clock::now();
 	std::chrono::duration<double, std::milli> t_elapsed = t2 - t1;
 	std::cout << "Took: " << t_elapsed.count() << "ms" << std::endl;
 	//cwg::logic::init();
+	if(render.is_headless()) {
+		t1 = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < frames; i++) {
+			render.draw();
+		}
+		std::vector<uint8_t> rgba;
+		uint32_t width, height;
+		render.read_back(&rgba, &width, &height);				//waits for the last frame, so the timing covers the gpu too
+		t_elapsed = std::chrono::steady_clock::now() - t1;
+		std::cout << "Rendered " << frames << " frames in " << t_elapsed.count() << "ms (" << t_elapsed.count() / frames << "ms per frame)" << std::endl;
+		for(auto metric : { cwg::graphics::frame_metric::cpu_time, cwg::graphics::frame_metric::gpu_time, cwg::graphics::frame_metric::present_interval }) {
+			cwg::graphics::frame_summary s = render.get_frame_stats().summarise(metric);
+			std::cout << (metric == cwg::graphics::frame_metric::cpu_time ? "cpu " : metric == cwg::graphics::frame_metric::gpu_time ? "gpu " : "interval ")
+				<< "p50 " << s.p50 << "ms, p95 " << s.p95 << "ms, p99 " << s.p99 << "ms, max " << s.max << "ms, hitches " << s.hitches << std::endl;
+		}
+
+		std::ofstream out("log/frame.ppm", std::ios::binary);
+		out << "P6\n" << width << " " << height << "\n255\n";
+		for(size_t p = 0; p < rgba.size(); p += 4) {
+			out.write(reinterpret_cast<const char*>(&rgba[p]), 3);		//drop alpha
+		}
+		CWG_LOG_INFO(l) << "wrote last frame to log/frame.ppm";
+		if(cwg::profiler::write("log/trace.json")) { CWG_LOG_INFO(l) << "wrote cpu trace to log/trace.json"; }
+		return 0;
+	}
 	while (!render.should_close()) {
 		render.draw();
 		render.poll_events();
 	}
+	if(cwg::profiler::write("log/trace.json")) { CWG_LOG_INFO(l) << "wrote cpu trace to log/trace.json"; }
 	
 	return 0;
 }
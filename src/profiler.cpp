@@ -0,0 +1,128 @@
+#include "profiler.h"
+
+#ifdef CWG_PROFILING
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cwg {
+
+namespace {
+	//the registry is only locked when a thread records its first event or a chunk is added, never per event
+	std::mutex registry_mu;
+	std::vector<std::unique_ptr<profiler::thread_buffer>> buffers;
+	std::vector<std::unique_ptr<profiler::chunk>> chunks;								//buffers and chunks live until exit so write() can read them any time
+	std::vector<profiler::thread_buffer*> tracks;
+	thread_local profiler::thread_buffer *local = nullptr;
+}
+
+std::chrono::steady_clock::time_point profiler::start_time()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return start;
+}
+
+profiler::thread_buffer *profiler::local_buffer()
+{
+	if(local == nullptr) {
+		local = register_thread();
+	}
+	return local;
+}
+
+profiler::thread_buffer *profiler::register_thread()
+{
+	start_time();																		//pin the epoch before the first event
+	std::unique_ptr<chunk> c(new chunk);
+	std::unique_ptr<thread_buffer> b(new thread_buffer);
+	b->head = b->tail = c.get();
+
+	std::lock_guard<std::mutex> lock(registry_mu);
+	b->thread_index = static_cast<uint32_t>(buffers.size());
+	chunks.push_back(std::move(c));
+	buffers.push_back(std::move(b));
+	return buffers.back().get();
+}
+
+profiler::chunk *profiler::add_chunk(thread_buffer *b)
+{
+	std::unique_ptr<chunk> c(new chunk);
+	chunk *out = c.get();
+	{
+		std::lock_guard<std::mutex> lock(registry_mu);
+		chunks.push_back(std::move(c));
+	}
+	b->tail->next.store(out, std::memory_order_release);								//readers walking the list see a complete chunk
+	b->tail = out;
+	return out;
+}
+
+uint32_t profiler::create_track(const char *name)
+{
+	thread_buffer *b = register_thread();												//a buffer no thread owns
+	b->name.store(name, std::memory_order_release);
+	std::lock_guard<std::mutex> lock(registry_mu);
+	tracks.push_back(b);
+	return static_cast<uint32_t>(tracks.size() - 1);
+}
+
+void profiler::record_track(uint32_t track, const char *name, uint64_t begin, uint64_t end)
+{
+	thread_buffer *b;
+	{
+		std::lock_guard<std::mutex> lock(registry_mu);									//tracks may grow, events on them are rare enough
+		b = tracks[track];
+	}
+	append(b, name, begin, end);
+}
+
+void profiler::set_thread_name(const char *name)
+{
+	local_buffer()->name.store(name, std::memory_order_release);
+}
+
+bool profiler::write(const std::string& path)
+{
+	std::ofstream out(path);
+	if(!out) {
+		return false;
+	}
+
+	std::vector<thread_buffer*> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(registry_mu);
+		for(auto& b : buffers) {
+			snapshot.push_back(b.get());
+		}
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	char buf[64];
+	for(thread_buffer *b : snapshot) {
+		const char *name = b->name.load(std::memory_order_acquire);
+		if(name) {
+			out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << b->thread_index << ",\"args\":{\"name\":\"" << name << "\"}}";
+			first = false;
+		}
+		for(chunk *c = b->head; c != nullptr; c = c->next.load(std::memory_order_acquire)) {
+			uint32_t count = c->count.load(std::memory_order_acquire);
+			for(uint32_t i = 0; i < count; i++) {
+				const event& e = c->events[i];
+				//complete events, microseconds with ns precision
+				std::snprintf(buf, sizeof(buf), "\"ts\":%.3f,\"dur\":%.3f", e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+				out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":\"" << e.name << "\",\"pid\":0,\"tid\":" << b->thread_index << "," << buf << "}";
+				first = false;
+			}
+		}
+	}
+	out << "\n]}\n";
+	return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+Usage: put CWG_PROFILE_SCOPE("name") at the top of a scope to time it, then call profiler::write() once at the end to get a chrome trace
+(open in chrome://tracing or ui.perfetto.dev). names must be string literals, only the pointer is stored.
+Events measured elsewhere (e.g. gpu timestamps) go on a track made with create_track(), shown as a thread of its own.
+Everything compiles away unless CWG_PROFILING is defined (cmake -DCWG_PROFILING=ON).
+*/
+
+#include <cstdint>
+#include <string>
+
+#ifdef CWG_PROFILING
+#include <atomic>
+#include <chrono>
+#endif
+
+namespace cwg {
+
+#ifdef CWG_PROFILING
+
+class profiler {
+public:
+	struct event {
+		const char *name;
+		uint64_t begin;																	//ns since profiler start
+		uint64_t end;
+	};
+
+	struct chunk {
+		static constexpr uint32_t capacity = 16 * 1024;
+		event events[capacity];
+		std::atomic<uint32_t> count { 0 };												//written by the owning thread only, published with release
+		std::atomic<chunk*> next { nullptr };
+	};
+
+	struct thread_buffer {																//one per thread, never shared for writing
+		chunk *head;
+		chunk *tail;
+		uint32_t thread_index;
+		std::atomic<const char*> name { nullptr };
+	};
+
+	static inline uint64_t now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time()).count());
+	}
+
+	static inline void record(const char *name, uint64_t begin, uint64_t end)
+	{
+		append(local_buffer(), name, begin, end);
+	}
+
+	static void set_thread_name(const char *name);										//string literal
+	static bool write(const std::string& path);											//safe while other threads keep recording
+
+	static uint32_t create_track(const char *name);
+	static void record_track(uint32_t track, const char *name, uint64_t begin, uint64_t end);	//one thread per track
+
+private:
+	static inline void append(thread_buffer *b, const char *name, uint64_t begin, uint64_t end)
+	{
+		chunk *c = b->tail;
+		uint32_t i = c->count.load(std::memory_order_relaxed);
+		if(i == chunk::capacity) {
+			c = add_chunk(b);
+			i = 0;
+		}
+		c->events[i] = { name, begin, end };
+		c->count.store(i + 1, std::memory_order_release);
+	}
+
+	static std::chrono::steady_clock::time_point start_time();
+	static thread_buffer *local_buffer();
+	static thread_buffer *register_thread();
+	static chunk *add_chunk(thread_buffer *b);
+};
+
+class profile_zone {
+	const char *m_name;
+	uint64_t m_begin;
+public:
+	inline profile_zone(const char *name) : m_name(name), m_begin(profiler::now()) {}
+	inline ~profile_zone() { profiler::record(m_name, m_begin, profiler::now()); }
+	profile_zone(const profile_zone& obj) = delete;
+	void operator=(const profile_zone& obj) = delete;
+};
+
+#define CWG_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CWG_PROFILE_CONCAT(a, b) CWG_PROFILE_CONCAT_IMPL(a, b)
+#define CWG_PROFILE_SCOPE(name) ::cwg::profile_zone CWG_PROFILE_CONCAT(cwg_profile_zone_, __LINE__)(name)
+#define CWG_PROFILE_THREAD(name) ::cwg::profiler::set_thread_name(name)
+
+#else
+
+class profiler {																		//stubs so call sites don't need #ifdefs
+public:
+	static inline uint64_t now() { return 0; }
+	static inline void set_thread_name(const char *) {}
+	static inline bool write(const std::string&) { return false; }
+	static inline uint32_t create_track(const char *) { return 0; }
+	static inline void record_track(uint32_t, const char *, uint64_t, uint64_t) {}
+};
+
+#define CWG_PROFILE_SCOPE(name)
+#define CWG_PROFILE_THREAD(name)
+
+#endif
+
+}
+
+#endif
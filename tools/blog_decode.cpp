@@ -0,0 +1,213 @@
+#include "binary_log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+Usage: blog_decode <file.blog> [--sites]
+Turns a binary log written by cwg::binary_log back into text lines in the format of the text logs, sorted by time
+(threads flush their buffers independently, so the file itself is only ordered per thread). --sites adds file:line to every line.
+*/
+
+namespace {
+
+struct format_site {
+	uint8_t level;
+	uint32_t line;
+	std::string src;
+	std::string file;
+	std::string format;
+};
+
+struct message {
+	uint64_t time;
+	std::string text;
+};
+
+class reader {
+	const std::vector<char>& m_data;
+	size_t m_pos = 0;
+public:
+	reader(const std::vector<char>& data) : m_data(data) {}
+
+	inline bool done() const { return m_pos >= m_data.size(); }
+	inline bool has(size_t n) const { return m_pos + n <= m_data.size(); }
+
+	template<typename T>
+	T value()
+	{
+		if(!has(sizeof(T))) {
+			throw std::runtime_error("truncated record");
+		}
+		T out;
+		std::memcpy(&out, m_data.data() + m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return out;
+	}
+
+	std::string string()
+	{
+		uint16_t length = value<uint16_t>();
+		if(!has(length)) {
+			throw std::runtime_error("truncated string");
+		}
+		std::string out(m_data.data() + m_pos, length);
+		m_pos += length;
+		return out;
+	}
+
+	void bytes(char *out, size_t n)
+	{
+		if(!has(n)) {
+			throw std::runtime_error("truncated header");
+		}
+		std::memcpy(out, m_data.data() + m_pos, n);
+		m_pos += n;
+	}
+};
+
+const char *level_name(uint8_t level)
+{
+	static const char *names[] = { "trace", "debug", "info", "warn", "error" };
+	return level < 5 ? names[level] : "?";
+}
+
+std::string argument(reader& r)
+{
+	std::ostringstream out;
+	switch(r.value<uint8_t>()) {
+	case cwg::binary_log::arg_int:
+		out << r.value<int64_t>();
+		break;
+	case cwg::binary_log::arg_uint:
+		out << r.value<uint64_t>();
+		break;
+	case cwg::binary_log::arg_double:
+		out << r.value<double>();
+		break;
+	case cwg::binary_log::arg_bool:
+		out << r.value<uint64_t>();								//same as streaming a bool into the text logger
+		break;
+	case cwg::binary_log::arg_pointer:
+		out << "0x" << std::hex << r.value<uint64_t>();
+		break;
+	case cwg::binary_log::arg_string:
+		out << r.string();
+		break;
+	default:
+		throw std::runtime_error("unknown argument type");
+	}
+	return out.str();
+}
+
+std::string substitute(const std::string& format, const std::vector<std::string>& args)
+{
+	std::string out;
+	size_t pos = 0;
+	for(const std::string& a : args) {
+		size_t next = format.find("{}", pos);
+		if(next == std::string::npos) {
+			break;
+		}
+		out.append(format, pos, next - pos);
+		out += a;
+		pos = next + 2;
+	}
+	out.append(format, pos, std::string::npos);
+	return out;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2) {
+		std::cerr << "usage: blog_decode <file.blog> [--sites]" << std::endl;
+		return 1;
+	}
+	bool sites = argc > 2 && std::string(argv[2]) == "--sites";
+
+	std::ifstream in(argv[1], std::ios::binary);
+	if(!in) {
+		std::cerr << "could not open " << argv[1] << std::endl;
+		return 1;
+	}
+	std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	std::map<uint32_t, format_site> formats;
+	std::vector<message> messages;
+	reader r(data);
+	uint64_t wall_start = 0, steady_start = 0;
+	try {
+		char magic[sizeof(cwg::binary_log::magic)];
+		r.bytes(magic, sizeof(magic));
+		if(std::memcmp(magic, cwg::binary_log::magic, sizeof(magic)) != 0) {
+			std::cerr << argv[1] << " is not a binary log" << std::endl;
+			return 1;
+		}
+		wall_start = r.value<uint64_t>();
+		steady_start = r.value<uint64_t>();
+
+		while(!r.done()) {
+			uint8_t kind = r.value<uint8_t>();
+			uint32_t id = r.value<uint32_t>();
+			if(kind == cwg::binary_log::format_record) {
+				format_site& f = formats[id];
+				f.level = r.value<uint8_t>();
+				f.line = r.value<uint32_t>();
+				f.src = r.string();
+				f.file = r.string();
+				f.format = r.string();
+			}
+			else if(kind == cwg::binary_log::message_record) {
+				uint64_t time = r.value<uint64_t>();
+				uint8_t count = r.value<uint8_t>();
+				std::vector<std::string> args;
+				for(uint8_t i = 0; i < count; i++) {
+					args.push_back(argument(r));
+				}
+				auto f = formats.find(id);
+				if(f == formats.end()) {
+					throw std::runtime_error("message with unknown format id " + std::to_string(id));
+				}
+				std::string text = "[" + f->second.src + "][" + level_name(f->second.level) + "]: " + substitute(f->second.format, args);
+				if(sites) {
+					text += " (" + f->second.file + ":" + std::to_string(f->second.line) + ")";
+				}
+				messages.push_back({ time, std::move(text) });
+			}
+			else {
+				throw std::runtime_error("unknown record kind " + std::to_string(kind));
+			}
+		}
+	}
+	catch(const std::exception& e) {
+		std::cerr << "stopped decoding: " << e.what() << std::endl;		//a crashed program leaves a partial last record, print what came before
+	}
+
+	std::stable_sort(messages.begin(), messages.end(), [](const message& a, const message& b) { return a.time < b.time; });
+	for(const message& m : messages) {
+		uint64_t wall = wall_start + (m.time - steady_start);
+		std::time_t seconds = static_cast<std::time_t>(wall / 1000000000ull);
+		std::tm time;
+#ifdef _WIN32
+		localtime_s(&time, &seconds);
+#else
+		localtime_r(&seconds, &time);
+#endif
+		char t_str[20];
+		std::strftime(t_str, sizeof(t_str), "%T", &time);
+		char micro[8];
+		std::snprintf(micro, sizeof(micro), ".%06u", static_cast<unsigned>((wall / 1000) % 1000000));
+		std::cout << "[" << t_str << micro << "]" << m.text << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,161 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "dependencies/tiny_obj_loader.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Usage: obj_bench <file.obj> [threads] [--no-tinyobj]
+       obj_bench --synthetic <file.obj> <megabytes>     writes a grid mesh of about that size first, then benchmarks it
+Times tiny_obj_loader against parse_obj on one thread and on the pool, and checks they produce the same triangles.
+parse_obj fans polygons while tiny_obj_loader ear clips them, so files with concave polygons are expected to differ there.
+*/
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+double ms_since(clock_type::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t).count();
+}
+
+void write_synthetic(const std::string& path, uint64_t megabytes)
+{
+    //rows of a 1024 wide grid with positions, uvs and normals, one quad per cell
+    std::ofstream out(path, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    out.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    const uint32_t w = 1024;
+    uint64_t target = megabytes << 20;
+    uint64_t written = 0;
+    uint32_t row = 0;
+    char line[160];
+    for(; written < target; row++) {
+        for(uint32_t x = 0; x < w; x++) {
+            int n = std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0.000000 1.000000 0.000000\n", x * 0.01f, 0.0f, row * 0.01f, x / float(w), (row % 1024) / 1024.0f);
+            out.write(line, n);
+            written += static_cast<uint64_t>(n);
+        }
+        if(row == 0) {
+            continue;
+        }
+        for(uint32_t x = 0; x + 1 < w; x++) {
+            uint64_t a = uint64_t(row - 1) * w + x + 1, b = a + 1, c = a + w, d = c + 1;
+            int n = std::snprintf(line, sizeof(line), "f %llu/%llu/%llu %llu/%llu/%llu %llu/%llu/%llu %llu/%llu/%llu\n",
+                (unsigned long long)a, (unsigned long long)a, (unsigned long long)a, (unsigned long long)b, (unsigned long long)b, (unsigned long long)b,
+                (unsigned long long)d, (unsigned long long)d, (unsigned long long)d, (unsigned long long)c, (unsigned long long)c, (unsigned long long)c);
+            out.write(line, n);
+            written += static_cast<uint64_t>(n);
+        }
+    }
+    std::cout << "wrote " << path << ": " << (written >> 20) << " MiB, " << row << " rows" << std::endl;
+}
+
+bool same(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, const cwg::graphics::obj_mesh& mesh)
+{
+    if(attrib.vertices != mesh.positions || attrib.texcoords != mesh.texcoords || attrib.normals != mesh.normals) {
+        std::cout << "attributes differ" << std::endl;
+        return false;
+    }
+    size_t k = 0;
+    for(const auto& s : shapes) {
+        for(const auto& i : s.mesh.indices) {
+            if(k == mesh.corners.size()) {
+                std::cout << "tiny_obj_loader has more corners" << std::endl;
+                return false;
+            }
+            const cwg::graphics::obj_corner& c = mesh.corners[k];
+            if(c.position != i.vertex_index || c.texcoord != i.texcoord_index || c.normal != i.normal_index) {
+                std::cout << "corner " << k << " differs" << std::endl;
+                return false;
+            }
+            k++;
+        }
+    }
+    if(k != mesh.corners.size()) {
+        std::cout << "corner count differs: " << k << " vs " << mesh.corners.size() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2) {
+        std::cerr << "usage: obj_bench <file.obj> [threads] [--no-tinyobj] | --synthetic <file.obj> <megabytes>" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    uint32_t threads = std::thread::hardware_concurrency();
+    bool tinyobj_too = true;
+    int i = 2;
+    if(path == "--synthetic") {
+        if(argc < 4) {
+            std::cerr << "usage: obj_bench --synthetic <file.obj> <megabytes>" << std::endl;
+            return 1;
+        }
+        path = argv[2];
+        write_synthetic(path, std::stoull(argv[3]));
+        i = 4;
+    }
+    for(; i < argc; i++) {
+        if(std::strcmp(argv[i], "--no-tinyobj") == 0) {
+            tinyobj_too = false;
+        }
+        else {
+            threads = static_cast<uint32_t>(std::stoul(argv[i]));
+        }
+    }
+
+    std::string error;
+    cwg::graphics::obj_mesh single;
+    auto t = clock_type::now();
+    if(!cwg::graphics::parse_obj(path, &single, nullptr, &error)) {
+        std::cerr << "parse_obj failed: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "parse_obj, 1 thread: " << ms_since(t) << "ms, " << single.positions.size() / 3 << " positions, " << single.corners.size() / 3 << " triangles" << std::endl;
+
+    cwg::graphics::obj_mesh parallel;
+    {
+        cwg::graphics::thread_pool pool(threads);
+        t = clock_type::now();
+        if(!cwg::graphics::parse_obj(path, &parallel, &pool, &error)) {
+            std::cerr << "parse_obj failed: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "parse_obj, " << threads << " threads: " << ms_since(t) << "ms" << std::endl;
+    }
+    bool deterministic = single.positions == parallel.positions && single.texcoords == parallel.texcoords && single.normals == parallel.normals
+        && single.corners.size() == parallel.corners.size()
+        && std::memcmp(single.corners.data(), parallel.corners.data(), single.corners.size() * sizeof(cwg::graphics::obj_corner)) == 0;
+    std::cout << "single and multi threaded results " << (deterministic ? "match" : "DIFFER") << std::endl;
+    single = cwg::graphics::obj_mesh();
+
+    if(tinyobj_too) {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        t = clock_type::now();
+        if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &error, path.c_str())) {
+            std::cerr << "tinyobj failed: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "tiny_obj_loader: " << ms_since(t) << "ms" << std::endl;
+        bool match = same(attrib, shapes, parallel);
+        std::cout << "parse_obj and tiny_obj_loader results " << (match ? "match" : "DIFFER") << std::endl;
+        return deterministic && match ? 0 : 1;
+    }
+    return deterministic ? 0 : 1;
+}
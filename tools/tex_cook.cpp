@@ -0,0 +1,142 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "dependencies/stb_image.h"
+#include "block_compression.h"
+#include "ktx2.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Usage: tex_cook <image> [--format bc1|bc3|bc7|rgba8] [--out <file.ktx2>] [--threads n]
+Loads a png/jpg, builds the full mip chain on the cpu (2x2 box filter), compresses every level and writes a ktx2 next to
+the image (<image>.ktx2), which is where renderer::create_texture looks for it. bc7 is the default, bc1 halves that again
+for opaque textures that can live with 565 colour. Prints the psnr of the top level against the source.
+*/
+
+namespace {
+
+using namespace cwg::graphics;
+using clock_type = std::chrono::steady_clock;
+
+double ms_since(clock_type::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t).count();
+}
+
+std::vector<uint8_t> downsample(const std::vector<uint8_t>& src, uint32_t width, uint32_t height, uint32_t *out_width, uint32_t *out_height)
+{
+    uint32_t w = std::max(1u, width / 2), h = std::max(1u, height / 2);
+    std::vector<uint8_t> dst(static_cast<size_t>(w) * h * 4);
+    for(uint32_t y = 0; y < h; y++) {
+        uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for(uint32_t x = 0; x < w; x++) {
+            uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for(uint32_t ch = 0; ch < 4; ch++) {
+                uint32_t sum = src[4 * (static_cast<size_t>(y0) * width + x0) + ch] + src[4 * (static_cast<size_t>(y0) * width + x1) + ch]
+                    + src[4 * (static_cast<size_t>(y1) * width + x0) + ch] + src[4 * (static_cast<size_t>(y1) * width + x1) + ch];
+                dst[4 * (static_cast<size_t>(y) * w + x) + ch] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    *out_width = w;
+    *out_height = h;
+    return dst;
+}
+
+double psnr(const uint8_t *a, const uint8_t *b, size_t bytes)
+{
+    double error = 0.0;
+    for(size_t i = 0; i < bytes; i++) {
+        double d = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+        error += d * d;
+    }
+    if(error == 0.0) {
+        return INFINITY;
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / (error / static_cast<double>(bytes)));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2) {
+        std::cerr << "usage: tex_cook <image> [--format bc1|bc3|bc7|rgba8] [--out <file.ktx2>] [--threads n]" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    std::string out_path = path + ".ktx2";
+    texture_format format = texture_format::bc7;
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for(int i = 2; i + 1 < argc; i += 2) {
+        std::string value = argv[i + 1];
+        if(std::strcmp(argv[i], "--format") == 0) {
+            if(value == "bc1") { format = texture_format::bc1; }
+            else if(value == "bc3") { format = texture_format::bc3; }
+            else if(value == "bc7") { format = texture_format::bc7; }
+            else if(value == "rgba8") { format = texture_format::rgba8; }
+            else {
+                std::cerr << "unknown format " << value << std::endl;
+                return 1;
+            }
+        }
+        else if(std::strcmp(argv[i], "--out") == 0) {
+            out_path = value;
+        }
+        else if(std::strcmp(argv[i], "--threads") == 0) {
+            threads = static_cast<uint32_t>(std::stoul(value));
+        }
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    int32_t width, height, channels;
+    unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if(pixels == nullptr) {
+        std::cerr << "could not load " << path << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> level(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+
+    auto t = clock_type::now();
+    thread_pool pool(threads);
+    std::vector<std::vector<uint8_t>> levels;
+    uint32_t w = static_cast<uint32_t>(width), h = static_cast<uint32_t>(height);
+    size_t source_bytes = 0;
+    for(;;) {
+        levels.push_back(encode_image(format, level.data(), w, h, &pool));
+        source_bytes += level.size();
+        if(levels.size() == 1) {
+            std::vector<uint8_t> decoded;
+            decode_image(format, levels[0].data(), w, h, &decoded);
+            std::cout << "level 0: " << w << "x" << h << ", psnr " << psnr(level.data(), decoded.data(), decoded.size()) << " dB" << std::endl;
+        }
+        if(w == 1 && h == 1) {
+            break;
+        }
+        level = downsample(level, w, h, &w, &h);
+    }
+    size_t cooked_bytes = 0;
+    for(const auto& l : levels) {
+        cooked_bytes += l.size();
+    }
+    std::cout << format_name(format) << ": " << levels.size() << " levels, " << source_bytes << " -> " << cooked_bytes << " bytes in " << ms_since(t) << "ms on " << threads << " threads" << std::endl;
+
+    std::string error;
+    if(!ktx2::write(out_path, static_cast<uint32_t>(format), static_cast<uint32_t>(width), static_cast<uint32_t>(height), levels, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cout << "wrote " << out_path << std::endl;
+    return 0;
+}